@@ -2,8 +2,10 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,10 +33,23 @@ char notif_path[MAX_PIPE_PATH_LENGTH];
 
 int notifs = 1;
 int current_subs = 0;
+int keep_session = 0; // Set if the client reconnects when the session ends
+int session_lost = 0;
+
+// Keys subscribed to, and the sequence number of the last notification of
+// each, sent to the server to resume them after reconnecting
+char watched_keys[MAX_NUMBER_SUB][MAX_STRING_SIZE];
+uint64_t watched_seqs[MAX_NUMBER_SUB];
 pthread_rwlock_t subs_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 pthread_mutex_t stdout_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t notifs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// EXEC request of the transaction being queued: the opcode, the number of
+// commands and then each command
+char tx_request[2 + MAX_TX_COMMANDS * (2 + MAX_NUMBER_SUB * MAX_STRING_SIZE +
+                                       sizeof(uint32_t))];
+size_t tx_size = 0;
+
 /*----------------------------CLEANUP FUNCTIONS------------------------------*/
 
 // Unlink all client side fifo pipes
@@ -55,10 +70,81 @@ void close_client_pipes() {
   pthread_mutex_unlock(&stdout_mutex);
 }
 
+/*-------------------------SUBSCRIPTION FUNCTIONS----------------------------*/
+
+/// Finds a key the client is subscribed to. Must be called with subs_rwlock
+/// locked.
+/// @return Position of the key, -1 if it isn't subscribed.
+static int find_watched(const char *key) {
+  for (int i = 0; i < current_subs; i++) {
+    if (strncmp(watched_keys[i], key, MAX_STRING_SIZE) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/// Adds a key the client was subscribed to.
+/// @param seq Sequence number of the key's last change when it was
+///            subscribed to, as sent by the server.
+static void watch_key(const char *key, uint64_t seq) {
+  pthread_rwlock_wrlock(&subs_rwlock);
+  if (find_watched(key) == -1 && current_subs < MAX_NUMBER_SUB) {
+    strncpy(watched_keys[current_subs], key, MAX_STRING_SIZE);
+    watched_seqs[current_subs++] = seq;
+  }
+  pthread_rwlock_unlock(&subs_rwlock);
+}
+
+/// Removes a key the client is no longer subscribed to.
+/// @return 1 if it was subscribed, 0 otherwise.
+static int unwatch_key(const char *key) {
+  pthread_rwlock_wrlock(&subs_rwlock);
+  int i = find_watched(key);
+  if (i != -1) {
+    current_subs--;
+    memcpy(watched_keys[i], watched_keys[current_subs], MAX_STRING_SIZE);
+    watched_seqs[i] = watched_seqs[current_subs];
+  }
+  pthread_rwlock_unlock(&subs_rwlock);
+  return i != -1;
+}
+
+/// Records a notification of a key. Notifications are numbered by the
+/// server's feed, so one that isn't newer than the last of its key was
+/// already received, as happens when a resumed subscription is caught up.
+/// @param seq Sequence number of the notification, 0 if it has none.
+/// @param deleted Set if the key was deleted, ending its subscription.
+/// @return 1 if the notification was received before, 0 otherwise.
+static int record_notification(const char *key, uint64_t seq, int deleted) {
+  pthread_rwlock_wrlock(&subs_rwlock);
+  int i = find_watched(key);
+  if (seq != 0 && i != -1 && seq <= watched_seqs[i]) {
+    pthread_rwlock_unlock(&subs_rwlock);
+    return 1;
+  }
+  if (i != -1) {
+    watched_seqs[i] = seq;
+  }
+  pthread_rwlock_unlock(&subs_rwlock);
+  if (deleted) {
+    unwatch_key(key);
+  }
+  return 0;
+}
+
 /*------------------------------KVS FUNCTIONS--------------------------------*/
 
 int kvs_connect(char const *req_pipe_path, char const *resp_pipe_path,
                 char const *server_pipe_path, char const *notif_pipe_path) {
+  pthread_mutex_lock(&notifs_mutex);
+  int lost = session_lost;
+  pthread_mutex_unlock(&notifs_mutex);
+  if (lost) {
+    // The pipes of the session the server ended are still open
+    close_client_pipes();
+    unlink_client_pipes();
+  }
 
   // store the paths
   strncpy(req_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
@@ -113,6 +199,7 @@ int kvs_connect(char const *req_pipe_path, char const *resp_pipe_path,
     safe_close(resp_pipe_fd);
     return 1;
   }
+  already_closed = 0;
   char resp[2];
   if (read_all(resp_pipe_fd, resp, sizeof(resp), 0) <= 0) {
     close_client_pipes();
@@ -128,6 +215,10 @@ int kvs_connect(char const *req_pipe_path, char const *resp_pipe_path,
     return 1;
   }
   safe_close(server_id);
+  pthread_mutex_lock(&notifs_mutex);
+  notifs = 1;
+  session_lost = 0;
+  pthread_mutex_unlock(&notifs_mutex);
   return 0;
 }
 
@@ -198,8 +289,9 @@ int kvs_subscribe(const char *key) {
     return 3;
   }
 
-  char response[2];
-  if (read_all(resp_pipe_fd, response, 2, NULL) <= 0) {
+  // The sequence number of the key's last change follows the result
+  char response[2 + sizeof(uint64_t)];
+  if (read_all(resp_pipe_fd, response, sizeof(response), NULL) <= 0) {
     fprintf(stderr, "Error reading from request pipe\n");
     close_client_pipes();
     unlink_client_pipes();
@@ -209,9 +301,9 @@ int kvs_subscribe(const char *key) {
   printf("Server returned %d for operation: subscribe\n", response[1]);
   pthread_mutex_unlock(&stdout_mutex);
   if (response[1]) {
-    pthread_rwlock_wrlock(&subs_rwlock);
-    current_subs++;
-    pthread_rwlock_unlock(&subs_rwlock);
+    uint64_t seq;
+    memcpy(&seq, response + 2, sizeof(seq));
+    watch_key(key, seq);
   }
   return 0;
 }
@@ -247,13 +339,376 @@ int kvs_unsubscribe(const char *key) {
     return 1;
   }
   if (response[1] == 0) {
-    pthread_rwlock_wrlock(&subs_rwlock);
-    current_subs--;
-    pthread_rwlock_unlock(&subs_rwlock);
+    unwatch_key(key);
+  }
+  return 0;
+}
+
+int kvs_write(const char *key, const char *value, unsigned int ttl_ms) {
+  char request[1 + 2 * MAX_STRING_SIZE + sizeof(uint32_t)] = {0};
+  uint32_t ttl32 = ttl_ms;
+  request[0] = OP_CODE_WRITE;
+  strncpy(request + 1, key, MAX_STRING_SIZE);
+  strncpy(request + 1 + MAX_STRING_SIZE, value, MAX_STRING_SIZE);
+  memcpy(request + 1 + 2 * MAX_STRING_SIZE, &ttl32, sizeof(ttl32));
+
+  int write_result = safe_write(req_pipe_fd, request, sizeof(request));
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending write request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2];
+  if (read_all(resp_pipe_fd, response, 2, 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: write\n", response[1]);
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+int kvs_cas(const char *key, const char *expected, const char *value) {
+  char request[1 + 3 * MAX_STRING_SIZE] = {0};
+  size_t size = 1;
+  request[0] = expected != NULL ? OP_CODE_CAS : OP_CODE_PUTNX;
+  strncpy(request + size, key, MAX_STRING_SIZE);
+  size += MAX_STRING_SIZE;
+  if (expected != NULL) {
+    strncpy(request + size, expected, MAX_STRING_SIZE);
+    size += MAX_STRING_SIZE;
+  }
+  strncpy(request + size, value, MAX_STRING_SIZE);
+  size += MAX_STRING_SIZE;
+
+  int write_result = safe_write(req_pipe_fd, request, size);
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending cas request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2];
+  if (read_all(resp_pipe_fd, response, 2, 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: %s\n", response[1],
+         expected != NULL ? "cas" : "putnx");
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+int kvs_add(const char *key, long long delta) {
+  char request[1 + MAX_STRING_SIZE + sizeof(int64_t)] = {0};
+  int64_t delta64 = delta;
+  request[0] = OP_CODE_ADD;
+  strncpy(request + 1, key, MAX_STRING_SIZE);
+  memcpy(request + 1 + MAX_STRING_SIZE, &delta64, sizeof(delta64));
+
+  int write_result = safe_write(req_pipe_fd, request, sizeof(request));
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending add request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2 + sizeof(int64_t)];
+  int64_t value;
+  if (read_all(resp_pipe_fd, response, sizeof(response), 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  memcpy(&value, response + 2, sizeof(value));
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: add\n", response[1]);
+  if (response[1] == 0) {
+    printf("(%s,%" PRId64 ")\n", key, value);
+  }
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+void kvs_multi(void) {
+  tx_request[0] = OP_CODE_EXEC;
+  tx_request[1] = 0;
+  tx_size = 2;
+}
+
+int kvs_tx_write(const char *key, const char *value, unsigned int ttl_ms) {
+  if (tx_request[1] == MAX_TX_COMMANDS) {
+    return 1;
+  }
+  uint32_t ttl32 = ttl_ms;
+  char *command = tx_request + tx_size;
+  memset(command, 0, 2 + 2 * MAX_STRING_SIZE);
+  command[0] = TX_OP_WRITE;
+  command[1] = 1;
+  strncpy(command + 2, key, MAX_STRING_SIZE);
+  strncpy(command + 2 + MAX_STRING_SIZE, value, MAX_STRING_SIZE);
+  memcpy(command + 2 + 2 * MAX_STRING_SIZE, &ttl32, sizeof(ttl32));
+  tx_size += 2 + 2 * MAX_STRING_SIZE + sizeof(ttl32);
+  tx_request[1]++;
+  return 0;
+}
+
+int kvs_tx_keys(int tx_op, char keys[][MAX_STRING_SIZE], size_t num_keys) {
+  if (tx_request[1] == MAX_TX_COMMANDS) {
+    return 1;
+  }
+  char *command = tx_request + tx_size;
+  memset(command, 0, 2 + num_keys * MAX_STRING_SIZE);
+  command[0] = (char)tx_op;
+  command[1] = (char)num_keys;
+  for (size_t i = 0; i < num_keys; i++) {
+    strncpy(command + 2 + i * MAX_STRING_SIZE, keys[i], MAX_STRING_SIZE);
+  }
+  tx_size += 2 + num_keys * MAX_STRING_SIZE;
+  tx_request[1]++;
+  return 0;
+}
+
+int kvs_exec(void) {
+  int write_result = safe_write(req_pipe_fd, tx_request, tx_size);
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending exec request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2 + sizeof(uint32_t)];
+  if (read_all(resp_pipe_fd, response, sizeof(response), 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  uint32_t len;
+  memcpy(&len, response + 2, sizeof(len));
+
+  // The output is printed as it arrives, without notifications in between
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: exec\n", response[1]);
+  while (len > 0) {
+    char chunk[256];
+    size_t size = len < sizeof(chunk) ? len : sizeof(chunk);
+    if (read_all(resp_pipe_fd, chunk, size, 0) <= 0) {
+      pthread_mutex_unlock(&stdout_mutex);
+      close_client_pipes();
+      unlink_client_pipes();
+      return 3;
+    }
+    fwrite(chunk, 1, size, stdout);
+    len -= (uint32_t)size;
+  }
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+/// Sends a SCAN or PREFIX request, then reads and prints the pairs the server
+/// returns for it.
+/// @param request Request to be sent.
+/// @param size Size of the request.
+/// @param operation Name of the operation, for the output.
+/// @return 0 if the pairs were received, 1 if the server failed, 3 if the
+/// connection was lost.
+static int request_pairs(const char *request, size_t size,
+                         const char *operation) {
+  int write_result = safe_write(req_pipe_fd, request, size);
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending %s request\n", operation);
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2 + sizeof(uint32_t)];
+  if (read_all(resp_pipe_fd, response, sizeof(response), 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  uint32_t count;
+  memcpy(&count, response + 2, sizeof(count));
+
+  // Pairs are printed as they arrive, without notifications in between
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: %s\n", response[1], operation);
+  for (uint32_t i = 0; i < count; i++) {
+    char pair[2 * MAX_STRING_SIZE];
+    if (read_all(resp_pipe_fd, pair, sizeof(pair), 0) <= 0) {
+      pthread_mutex_unlock(&stdout_mutex);
+      close_client_pipes();
+      unlink_client_pipes();
+      return 3;
+    }
+    printf("(%.*s,%.*s)\n", MAX_STRING_SIZE, pair, MAX_STRING_SIZE,
+           pair + MAX_STRING_SIZE);
+  }
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+int kvs_scan(const char *start, const char *end, unsigned int limit) {
+  char request[1 + 2 * MAX_STRING_SIZE + sizeof(uint32_t)] = {0};
+  uint32_t limit32 = limit;
+  request[0] = OP_CODE_SCAN;
+  strncpy(request + 1, start, MAX_STRING_SIZE);
+  strncpy(request + 1 + MAX_STRING_SIZE, end, MAX_STRING_SIZE);
+  memcpy(request + 1 + 2 * MAX_STRING_SIZE, &limit32, sizeof(limit32));
+  return request_pairs(request, sizeof(request), "scan");
+}
+
+int kvs_prefix(const char *prefix) {
+  char request[1 + MAX_STRING_SIZE] = {0};
+  request[0] = OP_CODE_PREFIX;
+  strncpy(request + 1, prefix, MAX_STRING_SIZE);
+  return request_pairs(request, sizeof(request), "prefix");
+}
+
+int kvs_tail(unsigned long long from_seq) {
+  char request[1 + sizeof(uint64_t)];
+  uint64_t seq = from_seq;
+  request[0] = OP_CODE_TAIL;
+  memcpy(request + 1, &seq, sizeof(seq));
+
+  int write_result = safe_write(req_pipe_fd, request, sizeof(request));
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending tail request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  char response[2 + sizeof(uint64_t)];
+  if (read_all(resp_pipe_fd, response, sizeof(response), 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  memcpy(&seq, response + 2, sizeof(seq));
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: tail\n", response[1]);
+  if (response[1] == 0) {
+    printf("Tailing from change %" PRIu64 "\n", seq);
+  } else if (response[1] == 1) {
+    printf("Oldest change kept is %" PRIu64 "\n", seq);
+  }
+  pthread_mutex_unlock(&stdout_mutex);
+  return response[1] != 0;
+}
+
+int kvs_resume(void) {
+  char request[2 + MAX_NUMBER_SUB * (MAX_STRING_SIZE + sizeof(uint64_t))];
+  char keys[MAX_NUMBER_SUB][MAX_STRING_SIZE];
+  char *ptr = request + 2;
+  pthread_rwlock_rdlock(&subs_rwlock);
+  size_t count = (size_t)current_subs;
+  for (size_t i = 0; i < count; i++) {
+    memcpy(keys[i], watched_keys[i], MAX_STRING_SIZE);
+    memcpy(ptr, watched_keys[i], MAX_STRING_SIZE);
+    memcpy(ptr + MAX_STRING_SIZE, &watched_seqs[i], sizeof(uint64_t));
+    ptr += MAX_STRING_SIZE + sizeof(uint64_t);
+  }
+  pthread_rwlock_unlock(&subs_rwlock);
+  request[0] = OP_CODE_RESUME;
+  request[1] = (char)count;
+
+  int write_result = safe_write(req_pipe_fd, request, (size_t)(ptr - request));
+  if (write_result == -1) {
+    fprintf(stderr, "Error sending resume request\n");
+    return -1;
+  } else if (write_result == 1 || write_result == 2) {
+    close_client_pipes();
+    unlink_client_pipes();
+    pthread_mutex_lock(&notifs_mutex);
+    notifs = 0;
+    pthread_mutex_unlock(&notifs_mutex);
+    return 3;
+  }
+
+  // The status of every key follows the result
+  char response[2 + MAX_NUMBER_SUB];
+  if (read_all(resp_pipe_fd, response, 2 + count, 0) <= 0) {
+    close_client_pipes();
+    unlink_client_pipes();
+    return 3;
+  }
+  pthread_mutex_lock(&stdout_mutex);
+  printf("Server returned %d for operation: resume\n", response[1]);
+  pthread_mutex_unlock(&stdout_mutex);
+  for (size_t i = 0; i < count; i++) {
+    char key[MAX_STRING_SIZE + 1] = {0};
+    strncpy(key, keys[i], MAX_STRING_SIZE);
+    if (response[2 + i] == 1) {
+      // Changes were missed, so the key must be read again, and numbering
+      // its notifications starts over
+      pthread_rwlock_wrlock(&subs_rwlock);
+      int watched = find_watched(key);
+      if (watched != -1) {
+        watched_seqs[watched] = 0;
+      }
+      pthread_rwlock_unlock(&subs_rwlock);
+      pthread_mutex_lock(&stdout_mutex);
+      printf("(%s,RESYNC)\n", key);
+      pthread_mutex_unlock(&stdout_mutex);
+    } else if (response[2 + i] == 2 && unwatch_key(key)) {
+      pthread_mutex_lock(&stdout_mutex);
+      printf("(%s,DELETED)\n", key);
+      pthread_mutex_unlock(&stdout_mutex);
+    }
   }
   return 0;
 }
 
+void kvs_keep_session(void) { keep_session = 1; }
+
+int kvs_session_lost(void) {
+  pthread_mutex_lock(&notifs_mutex);
+  int lost = session_lost;
+  pthread_mutex_unlock(&notifs_mutex);
+  return lost;
+}
+
 /*--------------------------NOTIFICATIONS THREAD-----------------------------*/
 
 void *notifications_thread() {
@@ -266,23 +721,61 @@ void *notifications_thread() {
     }
     pthread_mutex_unlock(&notifs_mutex);
     if (read_all(notif_pipe_fd, buffer, 1 + MAX_STRING_SIZE * 2, 0) != 1) {
-      close_client_pipes();
-      unlink_client_pipes();
-      exit(1);
+      if (!keep_session) {
+        close_client_pipes();
+        unlink_client_pipes();
+        exit(1);
+      }
+      // The pipes are left to a pending disconnect, or closed when the
+      // client reconnects at its next command
+      pthread_mutex_lock(&notifs_mutex);
+      notifs = 0;
+      session_lost = 1;
+      pthread_mutex_unlock(&notifs_mutex);
+      break;
     }
     char notif_code = buffer[0];
     char key[MAX_STRING_SIZE + 1] = {0};
     char value[MAX_STRING_SIZE + 1] = {0};
     strncpy(key, buffer + 1, MAX_STRING_SIZE);
     strncpy(value, buffer + 1 + MAX_STRING_SIZE, MAX_STRING_SIZE);
+    if (notif_code == NOTIF_CODE_CHANGE) {
+      // Changes of the feed are followed by their kind and sequence number
+      char change[1 + sizeof(uint64_t)];
+      uint64_t seq;
+      if (read_all(notif_pipe_fd, change, sizeof(change), 0) != 1) {
+        close_client_pipes();
+        unlink_client_pipes();
+        exit(1);
+      }
+      memcpy(&seq, change + 1, sizeof(seq));
+      pthread_mutex_lock(&stdout_mutex);
+      if (change[0] == CDC_OP_DROPPED) {
+        fprintf(stdout, "Tail dropped, TAIL %" PRIu64 " to resume\n", seq);
+        pthread_mutex_unlock(&stdout_mutex);
+        continue;
+      }
+      fprintf(stdout, "#%" PRIu64 " %s (%s,%s)\n", seq,
+              change[0] == CDC_OP_INSERT   ? "insert"
+              : change[0] == CDC_OP_UPDATE ? "update"
+                                           : "delete",
+              key, change[0] == CDC_OP_DELETE ? "DELETED" : value);
+      pthread_mutex_unlock(&stdout_mutex);
+      continue;
+    }
+    // Other notifications are followed by their sequence number
+    uint64_t seq;
+    if (read_all(notif_pipe_fd, &seq, sizeof(seq), 0) != 1) {
+      close_client_pipes();
+      unlink_client_pipes();
+      exit(1);
+    }
+    if (notif_code != 3 && record_notification(key, seq, notif_code == 2)) {
+      continue;
+    }
     pthread_mutex_lock(&stdout_mutex);
     fprintf(stdout, "(%s,%s)\n", key, value);
     pthread_mutex_unlock(&stdout_mutex);
-    if (notif_code == 2) {
-      pthread_rwlock_wrlock(&subs_rwlock);
-      current_subs--;
-      pthread_rwlock_unlock(&subs_rwlock);
-    }
   }
   return NULL;
 }
\ No newline at end of file
@@ -32,6 +32,94 @@ int kvs_subscribe(const char *key);
 
 int kvs_unsubscribe(const char *key);
 
+/// Writes a pair, which is deleted once its TTL expires if it has one.
+/// @param key Key of the pair.
+/// @param value Value of the pair.
+/// @param ttl_ms Milliseconds until the pair expires, 0 if it never does.
+/// @return 0 if the pair was written, 1 if the server failed, 3 if the
+/// connection was lost.
+int kvs_write(const char *key, const char *value, unsigned int ttl_ms);
+
+/// Writes a pair only if its key holds the expected value (compare-and-swap),
+/// or only if the key doesn't exist (put-if-absent).
+/// @param key Key of the pair.
+/// @param expected Value the key must hold, NULL if it must not exist.
+/// @param value Value to be written.
+/// @return 0 if the pair was written, 1 if it wasn't, 3 if the connection was
+/// lost.
+int kvs_cas(const char *key, const char *expected, const char *value);
+
+/// Adds a delta to the counter held by a key, a missing key counting as 0,
+/// and prints its new value.
+/// @param key Key of the counter.
+/// @param delta Value to be added.
+/// @return 0 if the counter was updated, 1 if the key holds something else
+/// or the server failed, 3 if the connection was lost.
+int kvs_add(const char *key, long long delta);
+
+/// Starts queueing the commands of a transaction, sent together by kvs_exec.
+void kvs_multi(void);
+
+/// Queues a WRITE of a pair in the transaction.
+/// @param key Key of the pair.
+/// @param value Value of the pair.
+/// @param ttl_ms Milliseconds until the pair expires, 0 if it never does.
+/// @return 0 if the command was queued, 1 if the transaction is full.
+int kvs_tx_write(const char *key, const char *value, unsigned int ttl_ms);
+
+/// Queues a READ or DELETE of some keys in the transaction.
+/// @param tx_op TX_OP_READ or TX_OP_DELETE.
+/// @param keys Keys to be read or deleted.
+/// @param num_keys Number of keys, at most MAX_NUMBER_SUB.
+/// @return 0 if the command was queued, 1 if the transaction is full.
+int kvs_tx_keys(int tx_op, char keys[][MAX_STRING_SIZE], size_t num_keys);
+
+/// Sends the queued commands to be run atomically as one transaction, and
+/// prints the output of its READ and DELETE commands.
+/// @return 0 if the transaction was committed, 1 if the server failed, 3 if
+/// the connection was lost.
+int kvs_exec(void);
+
+/// Requests the pairs whose keys are between start and end, both included,
+/// in alphabetical order of the keys, and prints them.
+/// @param start First key of the range.
+/// @param end Last key of the range.
+/// @param limit Maximum number of pairs, 0 for no limit.
+/// @return 0 if the pairs were received, 1 if the server failed, 3 if the
+/// connection was lost.
+int kvs_scan(const char *start, const char *end, unsigned int limit);
+
+/// Requests the pairs whose keys start with a prefix, in alphabetical order of
+/// the keys, and prints them.
+/// @param prefix Prefix of the keys.
+/// @return 0 if the pairs were received, 1 if the server failed, 3 if the
+/// connection was lost.
+int kvs_prefix(const char *prefix);
+
+/// Starts receiving every change of the server's feed from a sequence
+/// number on, printed by the notifications thread as they arrive.
+/// @param from_seq First change to be received, 0 for the next one.
+/// @return 0 if the feed is being received, 1 if from_seq isn't kept anymore
+/// or the server failed, 3 if the connection was lost.
+int kvs_tail(unsigned long long from_seq);
+
+/// Resumes the subscriptions of the client after it connected again: the
+/// server subscribes it to its keys again and notifies it of the last
+/// change of each it missed. A key whose changes the server no longer keeps
+/// is printed as (key,RESYNC), and must be read again.
+/// @return 0 if the subscriptions were resumed, 3 if the connection was
+/// lost.
+int kvs_resume(void);
+
+/// Makes the notifications thread end instead of exiting the client when
+/// the server ends the session, e.g. when it receives SIGUSR1, so the
+/// client can connect again and resume its subscriptions.
+void kvs_keep_session(void);
+
+/// Checks if the server ended the session of a client that keeps it.
+/// @return 1 if the session was lost, 0 otherwise.
+int kvs_session_lost(void);
+
 /*--------------------------NOTIFICATIONS THREAD-----------------------------*/
 
 /// Thread function for handling notifications sent to a client.
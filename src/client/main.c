@@ -11,9 +11,37 @@
 #include "src/common/io.h"
 #include "src/common/protocol.h"
 
+/// Connects to the server again after it ended the session, restarting the
+/// notifications thread and resuming the subscriptions.
+/// @param notif_thread Notifications thread of the lost session, replaced by
+///                     the new one.
+/// @return 0 on success, 1 otherwise.
+static int reconnect(char const *req_pipe_path, char const *resp_pipe_path,
+                     char const *server_pipe_path,
+                     char const *notif_pipe_path, pthread_t *notif_thread) {
+  pthread_join(*notif_thread, NULL);
+  if (kvs_connect(req_pipe_path, resp_pipe_path, server_pipe_path,
+                  notif_pipe_path) != 0) {
+    return 1;
+  }
+  // Started first, so the notifications of the resumed keys are read
+  if (pthread_create(notif_thread, NULL, notifications_thread, NULL) != 0) {
+    return 1;
+  }
+  return kvs_resume() != 0;
+}
+
 int main(int argc, char *argv[]) {
+  int keep_session = 0;
+  if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+    // Reconnect and resume the subscriptions when the session ends
+    keep_session = 1;
+    argc--;
+    argv++;
+  }
   if (argc < 3) {
-    fprintf(stderr, "Usage: %s <client_unique_id> <register_pipe_path>\n",
+    fprintf(stderr,
+            "Usage: %s [-r] <client_unique_id> <register_pipe_path>\n",
             argv[0]);
     return 1;
   }
@@ -25,7 +53,10 @@ int main(int argc, char *argv[]) {
 
   char keys[MAX_NUMBER_SUB][MAX_STRING_SIZE] = {0};
   unsigned int delay_ms;
+  unsigned int limit;
+  unsigned int ttl_ms;
   size_t num;
+  int in_tx = 0; // Set between MULTI and EXEC
 
   strncat(req_pipe_path, argv[1], strlen(argv[1]) * sizeof(char));
   strncat(resp_pipe_path, argv[1], strlen(argv[1]) * sizeof(char));
@@ -36,6 +67,9 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Failed to connect to the server\n");
     return 1;
   }
+  if (keep_session) {
+    kvs_keep_session();
+  }
 
   pthread_t notif_thread;
   if (pthread_create(&notif_thread, NULL, notifications_thread, NULL) != 0) {
@@ -48,7 +82,14 @@ int main(int argc, char *argv[]) {
   /*-----------------------PROCESSING CLIENT COMMANDS------------------------*/
   int result;
   while (!should_exit) {
-    switch (get_next(STDIN_FILENO)) {
+    enum Command command = get_next(STDIN_FILENO);
+    if (keep_session && kvs_session_lost() &&
+        reconnect(req_pipe_path, resp_pipe_path, server_pipe_path,
+                  notif_pipe_path, &notif_thread)) {
+      fprintf(stderr, "Failed to reconnect to the server\n");
+      return 1;
+    }
+    switch (command) {
     case CMD_DISCONNECT:
       result = kvs_disconnect();
       if (result == 3) {
@@ -91,6 +132,144 @@ int main(int argc, char *argv[]) {
       }
       break;
 
+    case CMD_WRITE:
+      if (parse_write(STDIN_FILENO, keys[0], keys[1], &ttl_ms) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      if (in_tx) {
+        if (kvs_tx_write(keys[0], keys[1], ttl_ms)) {
+          fprintf(stderr, "Transaction is full\n");
+        }
+        break;
+      }
+      result = kvs_write(keys[0], keys[1], ttl_ms);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command write failed\n");
+      }
+      break;
+
+    case CMD_CAS:
+    case CMD_PUTNX:
+      if (parse_cas(STDIN_FILENO, keys[0], command == CMD_CAS ? keys[1] : NULL,
+                    keys[2]) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      result = kvs_cas(keys[0], command == CMD_CAS ? keys[1] : NULL, keys[2]);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command %s failed\n",
+                command == CMD_CAS ? "cas" : "putnx");
+      }
+      break;
+
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_ADD: {
+      long long delta = command == CMD_INCR ? 1 : -1;
+      if (parse_add(STDIN_FILENO, keys[0],
+                    command == CMD_ADD ? &delta : NULL) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      result = kvs_add(keys[0], delta);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command add failed\n");
+      }
+      break;
+    }
+
+    case CMD_READ:
+    case CMD_DELETE:
+      // Only queued in transactions
+      num = parse_list(STDIN_FILENO, keys, MAX_NUMBER_SUB, MAX_STRING_SIZE);
+      if (num == 0 || !in_tx) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      if (kvs_tx_keys(command == CMD_READ ? TX_OP_READ : TX_OP_DELETE, keys,
+                      num)) {
+        fprintf(stderr, "Transaction is full\n");
+      }
+      break;
+
+    case CMD_MULTI:
+      if (in_tx) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      kvs_multi();
+      in_tx = 1;
+      break;
+
+    case CMD_EXEC:
+      if (!in_tx) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      in_tx = 0;
+      result = kvs_exec();
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command exec failed\n");
+      }
+      break;
+
+    case CMD_SCAN:
+      if (parse_scan(STDIN_FILENO, keys[0], keys[1], &limit) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      result = kvs_scan(keys[0], keys[1], limit);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command scan failed\n");
+      }
+      break;
+
+    case CMD_PREFIX:
+      if (parse_prefix(STDIN_FILENO, keys[0]) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      result = kvs_prefix(keys[0]);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command prefix failed\n");
+      }
+      break;
+
+    case CMD_TAIL: {
+      unsigned long long from_seq;
+      if (parse_tail(STDIN_FILENO, &from_seq) == -1) {
+        fprintf(stderr, "Invalid command. See HELP for usage\n");
+        continue;
+      }
+      result = kvs_tail(from_seq);
+      if (result == 3) {
+        should_exit = 1; // Set flag to exit main loop
+        break;
+      } else if (result != 0) {
+        fprintf(stderr, "Command tail failed\n");
+      }
+      break;
+    }
+
     case CMD_DELAY:
       if (parse_delay(STDIN_FILENO, &delay_ms) == -1) {
         fprintf(stderr, "Invalid command. See HELP for usage\n");
@@ -113,6 +292,15 @@ int main(int argc, char *argv[]) {
       // input should end in a disconnect, or it will loop here forever
       break;
     }
+    if (should_exit && keep_session) {
+      // The server ended the session, e.g. on SIGUSR1
+      if (reconnect(req_pipe_path, resp_pipe_path, server_pipe_path,
+                    notif_pipe_path, &notif_thread)) {
+        fprintf(stderr, "Failed to reconnect to the server\n");
+        return 1;
+      }
+      should_exit = 0;
+    }
   }
   pthread_join(notif_thread, NULL);
 }
@@ -1,5 +1,6 @@
 #include "parser.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
@@ -92,6 +93,39 @@ static void cleanup(int fd) {
     ;
 }
 
+// Reads a word ended by a space, a newline or the end of the input.
+// @param fd File to read from.
+// @param buffer To write the word in, null-terminated.
+// @param max Size of the buffer.
+// @return The character ending the word ('\0' at the end of the input), or -1
+//         if the word is empty or doesn't fit the buffer, in which case the
+//         rest of the line is skipped.
+static int read_word(int fd, char *buffer, size_t max) {
+  size_t i = 0;
+  char ch;
+  while (1) {
+    if (read(fd, &ch, 1) != 1) {
+      ch = '\0';
+    }
+    if (ch == ' ' || ch == '\n' || ch == '\0') {
+      break;
+    }
+    if (i == max - 1) {
+      cleanup(fd);
+      return -1;
+    }
+    buffer[i++] = ch;
+  }
+  buffer[i] = '\0';
+  if (i == 0) {
+    if (ch == ' ') {
+      cleanup(fd);
+    }
+    return -1;
+  }
+  return ch;
+}
+
 enum Command get_next(int fd) {
   char buf[16];
   if (read(fd, buf, 1) != 1) {
@@ -100,13 +134,113 @@ enum Command get_next(int fd) {
 
   switch (buf[0]) {
   case 'S':
-    if (read(fd, buf + 1, 9) != 9 || strncmp(buf, "SUBSCRIBE ", 10) != 0) {
+    if (read(fd, buf + 1, 4) != 4) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+    if (strncmp(buf, "SCAN ", 5) == 0) {
+      return CMD_SCAN;
+    }
+    if (memchr(buf + 1, '\n', 4) != NULL) {
+      return CMD_INVALID;
+    }
+    if (read(fd, buf + 5, 5) != 5 || strncmp(buf, "SUBSCRIBE ", 10) != 0) {
       cleanup(fd);
       return CMD_INVALID;
     }
 
     return CMD_SUBSCRIBE;
 
+  case 'W':
+    if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "WRITE ", 6) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_WRITE;
+
+  case 'P':
+    if (read(fd, buf + 1, 5) != 5) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+    if (strncmp(buf, "PUTNX ", 6) == 0) {
+      return CMD_PUTNX;
+    }
+    if (memchr(buf + 1, '\n', 5) != NULL) {
+      return CMD_INVALID;
+    }
+    if (read(fd, buf + 6, 1) != 1 || strncmp(buf, "PREFIX ", 7) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_PREFIX;
+
+  case 'C':
+    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "CAS ", 4) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_CAS;
+
+  case 'I':
+    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "INCR ", 5) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_INCR;
+
+  case 'A':
+    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "ADD ", 4) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_ADD;
+
+  case 'R':
+    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_READ;
+
+  case 'M':
+    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "MULTI", 5) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+    if (read(fd, buf + 5, 1) != 0 && buf[5] != '\n') {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_MULTI;
+
+  case 'E':
+    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "EXEC", 4) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_EXEC;
+
+  case 'T':
+    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "TAIL ", 5) != 0) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+
+    return CMD_TAIL;
+
   case 'U':
     if (read(fd, buf + 1, 11) != 11 || strncmp(buf, "UNSUBSCRIBE ", 12) != 0) {
       cleanup(fd);
@@ -116,7 +250,24 @@ enum Command get_next(int fd) {
     return CMD_UNSUBSCRIBE;
 
   case 'D':
-    if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "DELAY ", 6) != 0) {
+    if (read(fd, buf + 1, 4) != 4) {
+      cleanup(fd);
+      return CMD_INVALID;
+    }
+    if (strncmp(buf, "DECR ", 5) == 0) {
+      return CMD_DECR;
+    }
+    if (memchr(buf + 1, '\n', 4) != NULL) {
+      return CMD_INVALID;
+    }
+    if (read(fd, buf + 5, 1) == 1 && strncmp(buf, "DELETE", 6) == 0) {
+      if (read(fd, buf + 6, 1) != 1 || buf[6] != ' ') {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+      return CMD_DELETE;
+    }
+    if (strncmp(buf, "DELAY ", 6) != 0) {
       if (read(fd, buf + 6, 4) != 4 || strncmp(buf, "DISCONNECT", 10) != 0) {
         cleanup(fd);
         return CMD_INVALID;
@@ -192,3 +343,129 @@ int parse_delay(int fd, unsigned int *delay) {
 
   return 0;
 }
+
+int parse_write(int fd, char key[MAX_STRING_SIZE], char value[MAX_STRING_SIZE],
+                unsigned int *ttl_ms) {
+  char ch;
+  *ttl_ms = 0;
+
+  if (read(fd, &ch, 1) != 1 || ch != '[' || read(fd, &ch, 1) != 1 ||
+      ch != '(' || read_string(fd, key, MAX_STRING_SIZE - 1) != 0 ||
+      read_string(fd, value, MAX_STRING_SIZE - 1) != 1 ||
+      read(fd, &ch, 1) != 1 || ch != ']') {
+    cleanup(fd);
+    return -1;
+  }
+
+  if (read(fd, &ch, 1) != 1 || ch == '\n') {
+    return 0;
+  }
+
+  char buf[4];
+  if (ch != ' ' || read(fd, buf, 4) != 4 || strncmp(buf, "TTL ", 4) != 0 ||
+      read_uint(fd, ttl_ms, &ch) != 0 || *ttl_ms == 0 ||
+      (ch != '\n' && ch != '\0')) {
+    if (ch != '\n') {
+      cleanup(fd);
+    }
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_scan(int fd, char start[MAX_STRING_SIZE], char end[MAX_STRING_SIZE],
+               unsigned int *limit) {
+  *limit = 0;
+  if (read_word(fd, start, MAX_STRING_SIZE) != ' ') {
+    return -1;
+  }
+
+  int next = read_word(fd, end, MAX_STRING_SIZE);
+  if (next == ' ') {
+    char ch;
+    if (read_uint(fd, limit, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      if (ch != '\n') {
+        cleanup(fd);
+      }
+      return -1;
+    }
+  } else if (next == -1) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_prefix(int fd, char prefix[MAX_STRING_SIZE]) {
+  int next = read_word(fd, prefix, MAX_STRING_SIZE);
+  if (next == ' ') {
+    cleanup(fd);
+  }
+  if (next != '\n' && next != '\0') {
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_cas(int fd, char key[MAX_STRING_SIZE], char *expected,
+              char value[MAX_STRING_SIZE]) {
+  if (read_word(fd, key, MAX_STRING_SIZE) != ' ' ||
+      (expected != NULL && read_word(fd, expected, MAX_STRING_SIZE) != ' ')) {
+    return -1;
+  }
+
+  int next = read_word(fd, value, MAX_STRING_SIZE);
+  if (next == ' ') {
+    cleanup(fd);
+  }
+  if (next != '\n' && next != '\0') {
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_add(int fd, char key[MAX_STRING_SIZE], long long *delta) {
+  int next = read_word(fd, key, MAX_STRING_SIZE);
+  if (delta == NULL) {
+    if (next == ' ') {
+      cleanup(fd);
+    }
+    return next == '\n' || next == '\0' ? 0 : -1;
+  }
+  if (next != ' ') {
+    return -1;
+  }
+
+  char buf[MAX_STRING_SIZE];
+  next = read_word(fd, buf, MAX_STRING_SIZE);
+  if (next == ' ') {
+    cleanup(fd);
+  }
+  if (next != '\n' && next != '\0') {
+    return -1;
+  }
+
+  char *end;
+  errno = 0;
+  *delta = strtoll(buf, &end, 10);
+  return errno != 0 || *end != '\0' ? -1 : 0;
+}
+
+int parse_tail(int fd, unsigned long long *seq) {
+  char buf[MAX_STRING_SIZE];
+  int next = read_word(fd, buf, MAX_STRING_SIZE);
+  if (next == ' ') {
+    cleanup(fd);
+  }
+  if ((next != '\n' && next != '\0') || buf[0] < '0' || buf[0] > '9') {
+    return -1;
+  }
+
+  char *end;
+  errno = 0;
+  *seq = strtoull(buf, &end, 10);
+  return errno != 0 || *end != '\0' ? -1 : 0;
+}
@@ -10,6 +10,19 @@ enum Command {
   CMD_SUBSCRIBE,
   CMD_UNSUBSCRIBE,
   CMD_DELAY,
+  CMD_SCAN,
+  CMD_PREFIX,
+  CMD_WRITE,
+  CMD_CAS,
+  CMD_PUTNX,
+  CMD_INCR,
+  CMD_DECR,
+  CMD_ADD,
+  CMD_READ,
+  CMD_DELETE,
+  CMD_MULTI,
+  CMD_EXEC,
+  CMD_TAIL,
   CMD_EMPTY,
   CMD_INVALID,
   EOC // End of commands
@@ -40,4 +53,56 @@ size_t parse_list(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
 // error.
 int parse_delay(int fd, unsigned int *delay);
 
+// Parses a WRITE command of a single pair, optionally followed by "TTL <ms>".
+// @param fd File descriptor to read from.
+// @param key Buffer to store the key in.
+// @param value Buffer to store the value in.
+// @param ttl_ms Pointer to the variable to store the TTL in, 0 if none.
+// @return 0 on success, -1 on error.
+int parse_write(int fd, char key[MAX_STRING_SIZE], char value[MAX_STRING_SIZE],
+                unsigned int *ttl_ms);
+
+// Parses a SCAN command: a start key, an end key and an optional limit of
+// pairs, separated by spaces.
+// @param fd File descriptor to read from.
+// @param start Buffer to store the start key in.
+// @param end Buffer to store the end key in.
+// @param limit Pointer to the variable to store the limit in, 0 if none.
+// @return 0 on success, -1 on error.
+int parse_scan(int fd, char start[MAX_STRING_SIZE], char end[MAX_STRING_SIZE],
+               unsigned int *limit);
+
+// Parses a PREFIX command, made of a single key prefix.
+// @param fd File descriptor to read from.
+// @param prefix Buffer to store the prefix in.
+// @return 0 on success, -1 on error.
+int parse_prefix(int fd, char prefix[MAX_STRING_SIZE]);
+
+// Parses a CAS command, a key, the value it must hold and the value to be
+// written, or a PUTNX command, a key and its value, separated by spaces.
+// @param fd File descriptor to read from.
+// @param key Buffer to store the key in.
+// @param expected Buffer to store the expected value of a CAS in, NULL for a
+// PUTNX.
+// @param value Buffer to store the value to be written in.
+// @return 0 on success, -1 on error.
+int parse_cas(int fd, char key[MAX_STRING_SIZE], char *expected,
+              char value[MAX_STRING_SIZE]);
+
+// Parses an INCR or DECR command, a key, or an ADD command, a key and a
+// signed delta, separated by a space.
+// @param fd File descriptor to read from.
+// @param key Buffer to store the key in.
+// @param delta Pointer to the variable to store the delta of an ADD in, NULL
+// for an INCR or DECR.
+// @return 0 on success, -1 on error.
+int parse_add(int fd, char key[MAX_STRING_SIZE], long long *delta);
+
+// Parses a TAIL command, the sequence number of the first change to be
+// received, 0 for the next one.
+// @param fd File descriptor to read from.
+// @param seq Pointer to the variable to store the sequence number in.
+// @return 0 on success, -1 on error.
+int parse_tail(int fd, unsigned long long *seq);
+
 #endif // KVS_PARSER_H
@@ -10,7 +10,37 @@ enum {
   OP_CODE_DISCONNECT = 2,
   OP_CODE_SUB = 3,
   OP_CODE_UNSUB = 4,
+  OP_CODE_SCAN = 5,
+  OP_CODE_PREFIX = 6,
+  OP_CODE_WRITE = 7,
+  OP_CODE_CAS = 8,
+  OP_CODE_PUTNX = 9,
+  OP_CODE_ADD = 10,
+  OP_CODE_EXEC = 11,
+  OP_CODE_TAIL = 12,
+  OP_CODE_RESUME = 13,
   // TODO mais opcodes para cada operacao
 };
 
+// Kinds of the commands of an EXEC request
+enum {
+  TX_OP_READ = 0,
+  TX_OP_WRITE = 1,
+  TX_OP_DELETE = 2,
+};
+
+// Notification of a change of the feed, followed by its kind and sequence
+// number
+enum { NOTIF_CODE_CHANGE = 4 };
+
+// Kinds of the changes of the feed
+enum {
+  CDC_OP_INSERT = 1,
+  CDC_OP_UPDATE = 2,
+  CDC_OP_DELETE = 3,
+  // Not a change: the client stopped being sent changes, and can TAIL again
+  // from the sequence number of the marker
+  CDC_OP_DROPPED = 4,
+};
+
 #endif // COMMON_PROTOCOL_H
@@ -0,0 +1,316 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backup.h"
+#include "lz.h"
+#include "operations.h"
+
+/// A contiguous range of buckets rendered and written by one backup worker.
+typedef struct {
+  int first_bucket; // First bucket of the range
+  int last_bucket;  // One past the last bucket of the range
+  char *data;       // Rendered pairs of the range
+  size_t len;       // Number of bytes in data
+  off_t offset;     // Position of the range inside the backup file
+  int rendered;     // Set once data and len are final
+  int failed;       // Set if rendering or writing the range failed
+} BackupSegment;
+
+/// A queued backup, shared by the workers handling its segments.
+typedef struct {
+  HashTable *snapshot;
+  int bck_fd;
+  int mft_fd;
+  int num_segments;
+  int remaining; // Segments not written yet
+  BackupSegment segments[TABLE_SIZE];
+  pthread_mutex_t lock;
+  pthread_cond_t rendered_cond;
+} BackupJob;
+
+typedef struct BackupTask {
+  BackupJob *job;
+  int segment;
+  struct BackupTask *next;
+} BackupTask;
+
+/*----------------------------GLOBAL VARIABLES-------------------------------*/
+
+static BackupTask *queue_head = NULL;
+static BackupTask *queue_tail = NULL;
+static int stopping = 0;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t *workers = NULL;
+static int num_workers = 0;
+static int compress_backups = 0;
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Splits the buckets of a snapshot into contiguous ranges holding roughly the
+/// same number of pairs, one per backup worker.
+/// @param job Backup whose segments will be filled.
+static void split_segments(BackupJob *job) {
+  size_t counts[TABLE_SIZE] = {0};
+  size_t total = 0;
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    for (KeyNode *node = job->snapshot->table[i].head; node;
+         node = node->next) {
+      counts[i]++;
+    }
+    total += counts[i];
+  }
+
+  int max_segments = num_workers < TABLE_SIZE ? num_workers : TABLE_SIZE;
+  size_t target = total / (size_t)max_segments + 1;
+  size_t acc = 0;
+  int first = 0;
+  job->num_segments = 0;
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    acc += counts[i];
+    if ((acc >= target && job->num_segments < max_segments - 1) ||
+        i == TABLE_SIZE - 1) {
+      job->segments[job->num_segments++] =
+          (BackupSegment){.first_bucket = first,
+                          .last_bucket = i + 1,
+                          .data = NULL,
+                          .len = 0,
+                          .offset = 0,
+                          .rendered = 0,
+                          .failed = 0};
+      first = i + 1;
+      acc = 0;
+    }
+  }
+  job->remaining = job->num_segments;
+}
+
+/// Renders every pair of a bucket range in the backup format, compressing the
+/// result when backups are compressed.
+/// @param snapshot Snapshot being backed up.
+/// @param segment Segment to be rendered.
+static void render_segment(HashTable *snapshot, BackupSegment *segment) {
+  size_t cap = 0;
+
+  for (int i = segment->first_bucket; i < segment->last_bucket; i++) {
+    for (KeyNode *node = snapshot->table[i].head; node; node = node->next) {
+      size_t key_len = node->key_len;
+      size_t value_len = strlen(node->value);
+      size_t needed = segment->len + key_len + value_len + 5;
+      if (needed > cap) {
+        cap = needed * 2;
+        char *data = realloc(segment->data, cap);
+        if (data == NULL) {
+          segment->failed = 1;
+          return;
+        }
+        segment->data = data;
+      }
+      // Same "(key, value)\n" lines SHOW writes
+      char *ptr = segment->data + segment->len;
+      *ptr++ = '(';
+      memcpy(ptr, node->key, key_len);
+      ptr += key_len;
+      *ptr++ = ',';
+      *ptr++ = ' ';
+      memcpy(ptr, node->value, value_len);
+      ptr += value_len;
+      *ptr++ = ')';
+      *ptr++ = '\n';
+      segment->len = needed;
+    }
+  }
+
+  if (compress_backups && segment->len > 0) {
+    char *compressed = malloc(lz_compress_bound(segment->len));
+    if (compressed == NULL) {
+      segment->failed = 1;
+      return;
+    }
+    segment->len = lz_compress(segment->data, segment->len, compressed);
+    free(segment->data);
+    segment->data = compressed;
+  }
+}
+
+/// Writes a rendered bucket range at its offset inside the backup file.
+/// @param bck_fd File descriptor of the backup file.
+/// @param segment Segment to be written.
+static void write_segment(int bck_fd, BackupSegment *segment) {
+  size_t total_written = 0;
+
+  while (total_written < segment->len) {
+    ssize_t num_written =
+        pwrite(bck_fd, segment->data + total_written,
+               segment->len - total_written,
+               segment->offset + (off_t)total_written);
+    if (num_written == -1) {
+      perror("Failed to write backup segment");
+      segment->failed = 1;
+      return;
+    }
+    total_written += (size_t)num_written;
+  }
+}
+
+/// Writes the manifest of a finished backup and releases all its resources.
+/// @param job Backup to be finished.
+static void finish_job(BackupJob *job) {
+  int failed = 0;
+  for (int i = 0; i < job->num_segments; i++) {
+    failed |= job->segments[i].failed;
+    if (!failed && job->mft_fd >= 0) {
+      char buf[BUF_SIZE];
+      snprintf(buf, sizeof(buf), "%d %d %d %lld %zu\n", i,
+               job->segments[i].first_bucket, job->segments[i].last_bucket,
+               (long long)job->segments[i].offset, job->segments[i].len);
+      failed |= write_to_file(job->mft_fd, buf);
+    }
+    free(job->segments[i].data);
+  }
+  if (failed) {
+    fprintf(stderr, "Failed to perform backup.\n");
+  }
+
+  if (close(job->bck_fd) == -1) {
+    fprintf(stderr, "Failed to close .bck file\n");
+  }
+  if (job->mft_fd >= 0 && close(job->mft_fd) == -1) {
+    fprintf(stderr, "Failed to close .mft file\n");
+  }
+  free_table(job->snapshot);
+  pthread_mutex_destroy(&job->lock);
+  pthread_cond_destroy(&job->rendered_cond);
+  free(job);
+}
+
+/// Handles one segment of a backup. The segment is rendered without any lock
+/// and then waits for the previous segments to be rendered, since its offset
+/// is the sum of their sizes. Segments are queued in order, so the ones it
+/// waits for have already been taken by other workers.
+/// @param job Backup the segment belongs to.
+/// @param index Index of the segment.
+static void process_segment(BackupJob *job, int index) {
+  BackupSegment *segment = &job->segments[index];
+  render_segment(job->snapshot, segment);
+
+  safe_mutex_lock(&job->lock);
+  segment->rendered = 1;
+  pthread_cond_broadcast(&job->rendered_cond);
+
+  off_t offset = 0;
+  for (int i = 0; i < index; i++) {
+    while (!job->segments[i].rendered) {
+      pthread_cond_wait(&job->rendered_cond, &job->lock);
+    }
+    offset += (off_t)job->segments[i].len;
+  }
+  segment->offset = offset;
+  safe_mutex_unlock(&job->lock);
+
+  if (index == job->num_segments - 1 &&
+      ftruncate(job->bck_fd, offset + (off_t)segment->len) == -1) {
+    perror("Failed to preallocate backup file");
+  }
+  if (!segment->failed) {
+    write_segment(job->bck_fd, segment);
+  }
+
+  safe_mutex_lock(&job->lock);
+  int last = --job->remaining == 0;
+  safe_mutex_unlock(&job->lock);
+  if (last) {
+    finish_job(job);
+  }
+}
+
+/// Main loop of a backup worker.
+/// @return NULL.
+static void *backup_worker(void *arg) {
+  (void)arg;
+  while (1) {
+    safe_mutex_lock(&queue_lock);
+    while (queue_head == NULL && !stopping) {
+      pthread_cond_wait(&queue_cond, &queue_lock);
+    }
+    if (queue_head == NULL) { // Stopping and nothing left to do
+      safe_mutex_unlock(&queue_lock);
+      return NULL;
+    }
+    BackupTask *task = queue_head;
+    queue_head = task->next;
+    if (queue_head == NULL) {
+      queue_tail = NULL;
+    }
+    safe_mutex_unlock(&queue_lock);
+
+    process_segment(task->job, task->segment);
+    free(task);
+  }
+}
+
+/*----------------------------BACKUP FUNCTIONS-------------------------------*/
+
+int backup_workers_start(int workers_count, int compress) {
+  if (workers_count < 1) {
+    workers_count = 1;
+  }
+  compress_backups = compress;
+  workers = safe_malloc((size_t)workers_count * sizeof(pthread_t));
+  for (int i = 0; i < workers_count; i++) {
+    if (pthread_create(&workers[i], NULL, backup_worker, NULL) != 0) {
+      fprintf(stderr, "Error creating backup worker number: %d\n", i);
+      if (i == 0) {
+        return 1;
+      }
+      break;
+    }
+    num_workers++;
+  }
+  return 0;
+}
+
+void backup_enqueue(HashTable *snapshot, int bck_fd, int mft_fd) {
+  BackupJob *job = safe_malloc(sizeof(BackupJob));
+  job->snapshot = snapshot;
+  job->bck_fd = bck_fd;
+  job->mft_fd = mft_fd;
+  pthread_mutex_init(&job->lock, NULL);
+  pthread_cond_init(&job->rendered_cond, NULL);
+  split_segments(job);
+
+  // All segments of a backup are queued together and in order
+  safe_mutex_lock(&queue_lock);
+  for (int i = 0; i < job->num_segments; i++) {
+    BackupTask *task = safe_malloc(sizeof(BackupTask));
+    task->job = job;
+    task->segment = i;
+    task->next = NULL;
+    if (queue_tail == NULL) {
+      queue_head = task;
+    } else {
+      queue_tail->next = task;
+    }
+    queue_tail = task;
+  }
+  pthread_cond_broadcast(&queue_cond);
+  safe_mutex_unlock(&queue_lock);
+}
+
+void backup_workers_stop() {
+  safe_mutex_lock(&queue_lock);
+  stopping = 1;
+  pthread_cond_broadcast(&queue_cond);
+  safe_mutex_unlock(&queue_lock);
+
+  for (int i = 0; i < num_workers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+  workers = NULL;
+  num_workers = 0;
+}
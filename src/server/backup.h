@@ -0,0 +1,25 @@
+#ifndef KVS_BACKUP_H
+#define KVS_BACKUP_H
+
+#include "kvs.h"
+
+/// Starts the pool of long-lived backup workers. Every backup is split into
+/// bucket ranges that are rendered and written by these workers, so the
+/// number of workers is the global budget shared by all pending backups.
+/// @param num_workers Number of worker threads to create.
+/// @param compress 1 to compress the backup files, 0 otherwise.
+/// @return 0 if the workers were started successfully, 1 otherwise.
+int backup_workers_start(int num_workers, int compress);
+
+/// Queues the backup of a snapshot. The call returns immediately and the
+/// backup is completed asynchronously by the workers, which take ownership
+/// of the snapshot and of both file descriptors.
+/// @param snapshot Private copy of the table to be backed up.
+/// @param bck_fd File descriptor of the backup file.
+/// @param mft_fd File descriptor of the manifest file, -1 to skip it.
+void backup_enqueue(HashTable *snapshot, int bck_fd, int mft_fd);
+
+/// Waits for every queued backup to be completed and stops the workers.
+void backup_workers_stop();
+
+#endif // KVS_BACKUP_H
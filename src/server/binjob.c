@@ -0,0 +1,378 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "binjob.h"
+#include "constants.h"
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+static int put_byte(OutputBuffer *out, unsigned int value) {
+  char byte = (char)(unsigned char)value;
+  return output_write(out, &byte, 1);
+}
+
+static int put_slice(OutputBuffer *out, Slice slice) {
+  return output_write(out, slice.ptr, slice.len);
+}
+
+/// Reads a little-endian unsigned integer of the given size.
+/// @return 0 on success, 1 if the reader ended early.
+static int get_uint(JobReader *reader, size_t size, uint32_t *value) {
+  if (reader->len - reader->pos < size) {
+    return 1;
+  }
+  *value = 0;
+  for (size_t i = 0; i < size; i++) {
+    *value |= (uint32_t)(unsigned char)reader->data[reader->pos + i]
+              << (8 * i);
+  }
+  reader->pos += size;
+  return 0;
+}
+
+/// Reads a little-endian u64.
+/// @return 0 on success, 1 if the reader ended early.
+static int get_u64(JobReader *reader, uint64_t *value) {
+  uint32_t low;
+  uint32_t high;
+  if (get_uint(reader, 4, &low) || get_uint(reader, 4, &high)) {
+    return 1;
+  }
+  *value = (uint64_t)high << 32 | low;
+  return 0;
+}
+
+/// Reads a key hash, a length and that many bytes as a slice. The hash is
+/// trusted as written by the compiler, only the key's table index is checked.
+/// @return 0 on success, 1 if the slice is malformed or has no table index.
+static int get_key(JobReader *reader, Slice *key, uint64_t *key_hash,
+                   uint32_t *value_len) {
+  uint32_t key_len;
+  if (get_u64(reader, key_hash) || get_uint(reader, 1, &key_len) ||
+      key_len == 0 ||
+      key_len >= MAX_STRING_SIZE ||
+      (value_len != NULL && get_uint(reader, 1, value_len))) {
+    return 1;
+  }
+  if (reader->len - reader->pos < key_len) {
+    return 1;
+  }
+  key->ptr = reader->data + reader->pos;
+  key->len = key_len;
+  reader->pos += key_len;
+  return hash(key->ptr) < 0;
+}
+
+/// Appends a length byte followed by the bytes of a slice.
+static int put_word(OutputBuffer *out, Slice word) {
+  return put_byte(out, (unsigned int)word.len) | put_slice(out, word);
+}
+
+/// Appends a little-endian u32.
+static int put_uint(OutputBuffer *out, unsigned int value) {
+  int failed = 0;
+  for (int i = 0; i < 4; i++) {
+    failed |= put_byte(out, value >> (8 * i));
+  }
+  return failed;
+}
+
+/// Appends the hash of a key as a little-endian u64.
+static int put_hash(OutputBuffer *out, Slice key) {
+  uint64_t key_hash = hash_key(key);
+  return put_uint(out, (unsigned int)key_hash) |
+         put_uint(out, (unsigned int)(key_hash >> 32));
+}
+
+/// Reads a length byte and that many bytes as a slice.
+/// @return 0 on success, 1 if the slice is malformed.
+static int get_word(JobReader *reader, Slice *word) {
+  uint32_t len;
+  if (get_uint(reader, 1, &len) || len == 0 || len >= MAX_STRING_SIZE ||
+      reader->len - reader->pos < len) {
+    return 1;
+  }
+  word->ptr = reader->data + reader->pos;
+  word->len = len;
+  reader->pos += len;
+  return 0;
+}
+
+/*---------------------------BINJOB FUNCTIONS--------------------------------*/
+
+int binjob_is_compiled(const char *data, size_t len) {
+  return len >= BINJOB_HEADER_SIZE &&
+         memcmp(data, BINJOB_MAGIC, BINJOB_HEADER_SIZE) == 0;
+}
+
+int binjob_write_header(OutputBuffer *out) {
+  return output_write(out, BINJOB_MAGIC, BINJOB_HEADER_SIZE);
+}
+
+int binjob_encode(OutputBuffer *out, enum Command command, const Slice *keys,
+                  const Slice *values, size_t num_pairs, unsigned int number) {
+  int has_buckets = command == CMD_WRITE || command == CMD_READ ||
+                    command == CMD_DELETE || command == CMD_CAS ||
+                    command == CMD_PUTNX || command == CMD_ADD ||
+                    command == CMD_HISTORY;
+  for (size_t i = 0; has_buckets && i < num_pairs; i++) {
+    if (hash(keys[i].ptr) < 0) {
+      return -1;
+    }
+  }
+
+  int failed = 0;
+  switch (command) {
+  case CMD_WRITE:
+  case CMD_READ:
+  case CMD_DELETE:
+    if (command == CMD_WRITE && number > 0) {
+      failed |= put_byte(out, BINJOB_WRITE_TTL);
+      failed |= put_uint(out, number);
+    } else if (command == CMD_READ && values[0].len > 0) {
+      failed |= put_byte(out, BINJOB_READ_AT);
+      failed |= put_word(out, values[0]);
+    } else {
+      failed |= put_byte(out, command == CMD_WRITE  ? BINJOB_WRITE
+                              : command == CMD_READ ? BINJOB_READ
+                                                    : BINJOB_DELETE);
+    }
+    failed |= put_byte(out, (unsigned int)num_pairs);
+    failed |= put_byte(out, (unsigned int)(num_pairs >> 8));
+    for (size_t i = 0; i < num_pairs; i++) {
+      failed |= put_hash(out, keys[i]);
+      failed |= put_byte(out, (unsigned int)keys[i].len);
+      if (command == CMD_WRITE) {
+        failed |= put_byte(out, (unsigned int)values[i].len);
+      }
+      failed |= put_slice(out, keys[i]);
+      if (command == CMD_WRITE) {
+        failed |= put_slice(out, values[i]);
+      }
+    }
+    break;
+
+  case CMD_WAIT:
+    failed |= put_byte(out, BINJOB_WAIT);
+    failed |= put_uint(out, number);
+    break;
+
+  case CMD_SCAN:
+    failed |= put_byte(out, BINJOB_SCAN);
+    failed |= put_word(out, keys[0]);
+    failed |= put_word(out, keys[1]);
+    failed |= put_uint(out, number);
+    break;
+
+  case CMD_PREFIX:
+    failed |= put_byte(out, BINJOB_PREFIX);
+    failed |= put_word(out, keys[0]);
+    break;
+
+  case CMD_CAS:
+  case CMD_PUTNX:
+    failed |= put_byte(out, command == CMD_CAS ? BINJOB_CAS : BINJOB_PUTNX);
+    failed |= put_hash(out, keys[0]);
+    failed |= put_word(out, keys[0]);
+    if (command == CMD_CAS) {
+      failed |= put_word(out, values[1]);
+    }
+    failed |= put_word(out, values[0]);
+    break;
+
+  case CMD_ADD:
+    failed |= put_byte(out, BINJOB_ADD);
+    failed |= put_hash(out, keys[0]);
+    failed |= put_word(out, keys[0]);
+    failed |= put_word(out, values[0]);
+    break;
+
+  case CMD_INCR:
+  case CMD_DECR:
+    return -1; // Parsed as an ADD
+
+  case CMD_HISTORY:
+    failed |= put_byte(out, BINJOB_HISTORY);
+    failed |= put_hash(out, keys[0]);
+    failed |= put_word(out, keys[0]);
+    failed |= put_uint(out, number);
+    break;
+
+  case CMD_LOAD:
+  case CMD_EXPORT:
+    failed |= put_byte(out, command == CMD_LOAD ? BINJOB_LOAD : BINJOB_EXPORT);
+    failed |= put_byte(out, (unsigned int)keys[0].len);
+    failed |= put_byte(out, (unsigned int)(keys[0].len >> 8));
+    failed |= put_slice(out, keys[0]);
+    break;
+
+  case CMD_SHOW:
+    failed |= put_byte(out, BINJOB_SHOW);
+    break;
+
+  case CMD_BACKUP:
+    failed |= put_byte(out, BINJOB_BACKUP);
+    break;
+
+  case CMD_HELP:
+    failed |= put_byte(out, BINJOB_HELP);
+    break;
+
+  case CMD_MULTI:
+  case CMD_EXEC:
+    failed |= put_byte(out, command == CMD_MULTI ? BINJOB_MULTI : BINJOB_EXEC);
+    break;
+
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    break;
+  }
+  return failed;
+}
+
+enum Command binjob_next(JobReader *reader, Slice *keys, uint64_t *hashes,
+                         Slice *values, size_t *num_pairs,
+                         unsigned int *number) {
+  uint32_t opcode;
+  if (get_uint(reader, 1, &opcode)) {
+    return EOC;
+  }
+
+  uint32_t count;
+  uint32_t value;
+  *number = 0;
+  if (opcode == BINJOB_WRITE_TTL) {
+    if (get_uint(reader, 4, &value) || value == 0) {
+      fprintf(stderr, "Corrupted compiled job file\n");
+      reader->pos = reader->len;
+      return EOC;
+    }
+    *number = value;
+    opcode = BINJOB_WRITE;
+  } else if (opcode == BINJOB_READ_AT) {
+    uint64_t version;
+    if (get_word(reader, &values[0]) || parse_version(values[0], &version)) {
+      fprintf(stderr, "Corrupted compiled job file\n");
+      reader->pos = reader->len;
+      return EOC;
+    }
+    opcode = BINJOB_READ;
+  } else if (opcode == BINJOB_READ) {
+    values[0] = (Slice){NULL, 0};
+  }
+
+  switch (opcode) {
+  case BINJOB_WRITE:
+  case BINJOB_READ:
+  case BINJOB_DELETE:
+    if (get_uint(reader, 2, &count) || count == 0 || count >= MAX_WRITE_SIZE) {
+      break;
+    }
+    for (*num_pairs = 0; *num_pairs < count; (*num_pairs)++) {
+      uint32_t value_len = 0;
+      if (get_key(reader, &keys[*num_pairs], &hashes[*num_pairs],
+                  opcode == BINJOB_WRITE ? &value_len : NULL) ||
+          value_len >= MAX_STRING_SIZE ||
+          reader->len - reader->pos < value_len) {
+        break;
+      }
+      if (opcode == BINJOB_WRITE) {
+        values[*num_pairs].ptr = reader->data + reader->pos;
+        values[*num_pairs].len = value_len;
+        reader->pos += value_len;
+      }
+    }
+    if (*num_pairs < count) {
+      break;
+    }
+    return opcode == BINJOB_WRITE  ? CMD_WRITE
+           : opcode == BINJOB_READ ? CMD_READ
+                                   : CMD_DELETE;
+
+  case BINJOB_WAIT:
+    if (get_uint(reader, 4, &value)) {
+      break;
+    }
+    *number = value;
+    return CMD_WAIT;
+
+  case BINJOB_SCAN:
+    if (get_word(reader, &keys[0]) || get_word(reader, &keys[1]) ||
+        get_uint(reader, 4, &value)) {
+      break;
+    }
+    *num_pairs = 2;
+    *number = value;
+    return CMD_SCAN;
+
+  case BINJOB_PREFIX:
+    if (get_word(reader, &keys[0])) {
+      break;
+    }
+    *num_pairs = 1;
+    return CMD_PREFIX;
+
+  case BINJOB_CAS:
+  case BINJOB_PUTNX:
+    if (get_key(reader, &keys[0], &hashes[0], NULL) ||
+        (opcode == BINJOB_CAS && get_word(reader, &values[1])) ||
+        get_word(reader, &values[0])) {
+      break;
+    }
+    *num_pairs = 1;
+    return opcode == BINJOB_CAS ? CMD_CAS : CMD_PUTNX;
+
+  case BINJOB_ADD: {
+    int64_t delta;
+    if (get_key(reader, &keys[0], &hashes[0], NULL) ||
+        get_word(reader, &values[0]) || parse_counter(values[0], &delta)) {
+      break;
+    }
+    *num_pairs = 1;
+    return CMD_ADD;
+  }
+
+  case BINJOB_LOAD:
+  case BINJOB_EXPORT:
+    if (get_uint(reader, 2, &value) || value == 0 || value >= PATH_MAX ||
+        reader->len - reader->pos < value) {
+      break;
+    }
+    keys[0].ptr = reader->data + reader->pos;
+    keys[0].len = value;
+    reader->pos += value;
+    *num_pairs = 1;
+    return opcode == BINJOB_LOAD ? CMD_LOAD : CMD_EXPORT;
+
+  case BINJOB_SHOW:
+    return CMD_SHOW;
+
+  case BINJOB_BACKUP:
+    return CMD_BACKUP;
+
+  case BINJOB_HELP:
+    return CMD_HELP;
+
+  case BINJOB_MULTI:
+    return CMD_MULTI;
+
+  case BINJOB_EXEC:
+    return CMD_EXEC;
+
+  case BINJOB_HISTORY:
+    if (get_key(reader, &keys[0], &hashes[0], NULL) ||
+        get_uint(reader, 4, &value)) {
+      break;
+    }
+    *num_pairs = 1;
+    *number = value;
+    return CMD_HISTORY;
+  }
+
+  fprintf(stderr, "Corrupted compiled job file\n");
+  reader->pos = reader->len;
+  return EOC;
+}
@@ -0,0 +1,108 @@
+#ifndef KVS_BINJOB_H
+#define KVS_BINJOB_H
+
+#include <stddef.h>
+
+#include "io.h"
+#include "keys.h"
+#include "parser.h"
+
+// Compiled job files start with this magic and hold one command after the
+// other. Every command is an opcode byte followed by its arguments:
+//   WRITE         u16 count, then per pair u64 key hash, u8 key length,
+//                 u8 value length, key bytes, value bytes
+//   WRITE_TTL     u32 TTL in milliseconds, then as WRITE
+//   READ, DELETE  u16 count, then per key u64 key hash, u8 key length,
+//                 key bytes
+//   READ_AT       u8 version length, version digits, then as READ
+//   WAIT          u32 delay in milliseconds
+//   LOAD, EXPORT  u16 path length, path bytes
+//   SCAN          u8 first key length, first key bytes, u8 last key length,
+//                 last key bytes, u32 limit
+//   PREFIX        u8 prefix length, prefix bytes
+//   CAS           u64 key hash, u8 key length, key bytes, then the expected
+//                 and the new value, each as u8 length and bytes
+//   PUTNX         as CAS, without the expected value
+//   ADD           u64 key hash, u8 key length, key bytes, u8 delta length,
+//                 delta digits (INCR and DECR are compiled as ADD)
+//   HISTORY       u64 key hash, u8 key length, key bytes, u32 limit
+//   SHOW, BACKUP, HELP, MULTI, EXEC  no arguments
+// Integers are little-endian. Key hashes are hash_key of each key, used as
+// they are when the commands run, so no key is hashed again; commands with
+// a key that has no table index are rejected as corrupted.
+#define BINJOB_MAGIC "KJB2"
+#define BINJOB_HEADER_SIZE 4
+#define BINJOB_EXTENSION ".jobc"
+
+enum BinjobOpcode {
+  BINJOB_WRITE = 1,
+  BINJOB_READ,
+  BINJOB_DELETE,
+  BINJOB_SHOW,
+  BINJOB_WAIT,
+  BINJOB_BACKUP,
+  BINJOB_HELP,
+  BINJOB_LOAD,
+  BINJOB_EXPORT,
+  BINJOB_SCAN,
+  BINJOB_PREFIX,
+  BINJOB_WRITE_TTL,
+  BINJOB_CAS,
+  BINJOB_PUTNX,
+  BINJOB_ADD,
+  BINJOB_MULTI,
+  BINJOB_EXEC,
+  BINJOB_READ_AT,
+  BINJOB_HISTORY
+};
+
+/// Checks if a buffer holds a compiled job file.
+/// @param data Contents of the file.
+/// @param len Number of bytes in data.
+/// @return 1 if it starts with the magic, 0 otherwise.
+int binjob_is_compiled(const char *data, size_t len);
+
+/// Appends the magic of compiled job files to an output buffer.
+/// @param out Output buffer to append to.
+/// @return 0 on success, 1 if writing failed.
+int binjob_write_header(OutputBuffer *out);
+
+/// Appends a parsed command to an output buffer in the compiled format.
+/// @param out Output buffer to append to.
+/// @param command Command to be appended, neither CMD_INVALID nor CMD_EMPTY.
+/// @param keys Keys of a WRITE, READ or DELETE, the path of a LOAD or EXPORT,
+///             the keys of a SCAN, the prefix of a PREFIX or the key of a CAS,
+///             PUTNX, ADD or HISTORY.
+/// @param values Values of a WRITE, the version of a READ (empty if none),
+///               the value to be written by a CAS or PUTNX followed by the
+///               value a CAS expects, or the delta of an ADD.
+/// @param num_pairs Number of keys.
+/// @param number Delay of a WAIT, limit of a SCAN or HISTORY or TTL of a
+///               WRITE.
+/// @return 0 on success, -1 if a key has no table index (nothing is appended),
+///         1 if writing failed.
+int binjob_encode(OutputBuffer *out, enum Command command, const Slice *keys,
+                  const Slice *values, size_t num_pairs, unsigned int number);
+
+/// Decodes the next command of a compiled job file. Keys and values are
+/// slices into the reader's contents.
+/// @param reader Reader positioned at a command.
+/// @param keys Array of at least MAX_WRITE_SIZE slices for the keys, the
+///             path of a LOAD or EXPORT, the keys of a SCAN, the prefix of
+///             a PREFIX or the key of a CAS, PUTNX, ADD or HISTORY.
+/// @param hashes Array of at least MAX_WRITE_SIZE hashes, where the hash_key
+///               of each key of a WRITE, READ, DELETE, CAS, PUTNX, ADD or
+///               HISTORY is stored.
+/// @param values Array of at least MAX_WRITE_SIZE slices for the values, the
+///               version of a READ (empty if none), the value to be written
+///               by a CAS or PUTNX followed by the value a CAS expects, or
+///               the delta of an ADD.
+/// @param num_pairs Where the number of keys is stored.
+/// @param number Where the delay of a WAIT, the limit of a SCAN or HISTORY
+///               or the TTL of a WRITE is stored.
+/// @return The command decoded, EOC at the end or if the file is corrupted.
+enum Command binjob_next(JobReader *reader, Slice *keys, uint64_t *hashes,
+                         Slice *values, size_t *num_pairs,
+                         unsigned int *number);
+
+#endif // KVS_BINJOB_H
@@ -0,0 +1,67 @@
+#include <limits.h>
+#include <stdlib.h>
+
+#include "bloom.h"
+#include "operations.h"
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Gets the block of a key, chosen by the high bits of its hash.
+static atomic_uchar *key_block(Bloom *bloom, uint64_t hash) {
+  return bloom->counters[(hash >> 32) & (BLOOM_BLOCKS - 1)];
+}
+
+/// Gets the counter of a probe within its block, chosen by the low bits of
+/// the hash, six bits per probe.
+static int probe_slot(uint64_t hash, int probe) {
+  return (int)((hash >> (6 * probe)) & (BLOOM_BLOCK_SIZE - 1));
+}
+
+/*-----------------------------BLOOM FUNCTIONS-------------------------------*/
+
+Bloom *bloom_create() {
+  Bloom *bloom = safe_malloc(sizeof(Bloom));
+  for (int i = 0; i < BLOOM_BLOCKS; i++) {
+    for (int j = 0; j < BLOOM_BLOCK_SIZE; j++) {
+      atomic_init(&bloom->counters[i][j], 0);
+    }
+  }
+  return bloom;
+}
+
+void bloom_add(Bloom *bloom, uint64_t hash) {
+  atomic_uchar *block = key_block(bloom, hash);
+  for (int i = 0; i < BLOOM_PROBES; i++) {
+    atomic_uchar *counter = &block[probe_slot(hash, i)];
+    unsigned char count = atomic_load(counter);
+    while (count != UCHAR_MAX &&
+           !atomic_compare_exchange_weak(counter, &count,
+                                         (unsigned char)(count + 1))) {
+    }
+  }
+}
+
+void bloom_remove(Bloom *bloom, uint64_t hash) {
+  atomic_uchar *block = key_block(bloom, hash);
+  for (int i = 0; i < BLOOM_PROBES; i++) {
+    atomic_uchar *counter = &block[probe_slot(hash, i)];
+    unsigned char count = atomic_load(counter);
+    // A saturated counter lost track of its keys, so it is never lowered
+    while (count != UCHAR_MAX && count != 0 &&
+           !atomic_compare_exchange_weak(counter, &count,
+                                         (unsigned char)(count - 1))) {
+    }
+  }
+}
+
+int bloom_may_contain(Bloom *bloom, uint64_t hash) {
+  atomic_uchar *block = key_block(bloom, hash);
+  for (int i = 0; i < BLOOM_PROBES; i++) {
+    if (atomic_load(&block[probe_slot(hash, i)]) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void bloom_free(Bloom *bloom) { free(bloom); }
@@ -0,0 +1,44 @@
+#ifndef KVS_BLOOM_H
+#define KVS_BLOOM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define BLOOM_BLOCKS 16384 // Power of two
+#define BLOOM_BLOCK_SIZE 64 // Counters of a block, one cache line
+#define BLOOM_PROBES 4
+
+/// Counting Bloom filter of the keys of a hash table. Every key sets
+/// BLOOM_PROBES counters of a single block, so a lookup touches one cache
+/// line. Counters are atomic and never locked: a key is added before its node
+/// is linked and removed after it is unlinked, so a key the filter rules out
+/// is absent from the table. Counters that saturate stay saturated.
+typedef struct Bloom {
+  atomic_uchar counters[BLOOM_BLOCKS][BLOOM_BLOCK_SIZE];
+} Bloom;
+
+/// Creates an empty filter.
+/// @return Newly created filter.
+Bloom *bloom_create();
+
+/// Adds a key to the filter.
+/// @param bloom Filter to be modified.
+/// @param hash Hash of the key, as given by hash_key.
+void bloom_add(Bloom *bloom, uint64_t hash);
+
+/// Removes a key added before.
+/// @param bloom Filter to be modified.
+/// @param hash Hash of the key, as given by hash_key.
+void bloom_remove(Bloom *bloom, uint64_t hash);
+
+/// Checks if a key may be in the filter.
+/// @param bloom Filter to be checked.
+/// @param hash Hash of the key, as given by hash_key.
+/// @return 0 if the key was certainly not added, 1 if it may have been.
+int bloom_may_contain(Bloom *bloom, uint64_t hash);
+
+/// Frees a filter.
+/// @param bloom Filter to be freed, may be NULL.
+void bloom_free(Bloom *bloom);
+
+#endif // KVS_BLOOM_H
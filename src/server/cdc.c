@@ -0,0 +1,257 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cdc.h"
+#include "operations.h"
+#include "src/common/io.h"
+#include "src/common/protocol.h"
+
+#define CHANGE_SIZE (2 + 2 * MAX_STRING_SIZE + sizeof(uint64_t))
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Formats a change as sent to a notification pipe: the notification code,
+/// the key and the value, as for any notification, then the kind of the
+/// change and its sequence number as a native uint64_t.
+/// @param message Buffer of CHANGE_SIZE bytes.
+/// @param record Change to be formatted.
+static void format_change(char *message, const CdcRecord *record) {
+  message[0] = NOTIF_CODE_CHANGE;
+  memcpy(message + 1, record->key, MAX_STRING_SIZE);
+  memcpy(message + 1 + MAX_STRING_SIZE, record->value, MAX_STRING_SIZE);
+  message[1 + 2 * MAX_STRING_SIZE] = record->kind;
+  memcpy(message + 2 + 2 * MAX_STRING_SIZE, &record->seq, sizeof(uint64_t));
+}
+
+/// Sends a change to a notification pipe, waiting for room in it.
+/// @return 0 on success, 1 if the pipe couldn't be written.
+static int send_change(int notif_fd, const CdcRecord *record) {
+  char message[CHANGE_SIZE];
+  format_change(message, record);
+  return safe_write(notif_fd, message, sizeof(message)) != 0;
+}
+
+/// Sends a change to a tailer without waiting. Changes are smaller than
+/// PIPE_BUF, so they are written whole or not at all.
+/// @return 0 on success, 1 if the pipe is full or couldn't be written.
+static int push_change(int fd, const CdcRecord *record) {
+  char message[CHANGE_SIZE];
+  format_change(message, record);
+  ssize_t written;
+  do {
+    written = write(fd, message, sizeof(message));
+  } while (written == -1 && errno == EINTR);
+  return written != (ssize_t)sizeof(message);
+}
+
+/// Tells a dropped tailer the first change it missed, without waiting.
+/// @return 0 on success, 1 if the pipe is still full or couldn't be written.
+static int push_drop(int fd, uint64_t resume_seq) {
+  CdcRecord marker = {.seq = resume_seq, .kind = CDC_OP_DROPPED};
+  return push_change(fd, &marker);
+}
+
+/// Checks if a client is tailing a feed and wasn't dropped. Must be called
+/// with the feed locked.
+static int is_tailing(const Cdc *cdc, int notif_fd) {
+  for (int i = 0; i < cdc->num_tailers; i++) {
+    if (cdc->tailers[i].notif_fd == notif_fd &&
+        cdc->tailers[i].resume_seq == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Removes the tailer at the given position. Must be called with the feed
+/// locked.
+static void remove_tailer(Cdc *cdc, int i) {
+  close(cdc->tailers[i].fd);
+  cdc->tailers[i] = cdc->tailers[--cdc->num_tailers];
+}
+
+/*-------------------------------CDC FUNCTIONS-------------------------------*/
+
+Cdc *cdc_create(size_t cap) {
+  Cdc *cdc = safe_malloc(sizeof(Cdc));
+  cdc->records = safe_malloc(cap * sizeof(CdcRecord));
+  cdc->cap = cap;
+  cdc->next_seq = 1;
+  cdc->num_tailers = 0;
+  pthread_mutex_init(&cdc->lock, NULL);
+  return cdc;
+}
+
+uint64_t cdc_append(Cdc *cdc, char kind, const char *key,
+                    const char *value) {
+  safe_mutex_lock(&cdc->lock);
+  CdcRecord *record = &cdc->records[cdc->next_seq % cdc->cap];
+  uint64_t seq = record->seq = cdc->next_seq++;
+  record->kind = kind;
+  strncpy(record->key, key, MAX_STRING_SIZE);
+  strncpy(record->value, kind == CDC_OP_DELETE ? "" : value,
+          MAX_STRING_SIZE);
+  for (int i = cdc->num_tailers - 1; i >= 0; i--) {
+    CdcTailer *tailer = &cdc->tailers[i];
+    if (tailer->resume_seq != 0) {
+      if (!push_drop(tailer->fd, tailer->resume_seq)) {
+        remove_tailer(cdc, i);
+      }
+    } else if (push_change(tailer->fd, record)) {
+      fprintf(stderr, "Stopped sending changes to a client left behind\n");
+      tailer->resume_seq = seq;
+    }
+  }
+  safe_mutex_unlock(&cdc->lock);
+  return seq;
+}
+
+int cdc_tail(Cdc *cdc, int notif_fd, const char *notif_path, uint64_t from_seq,
+             uint64_t *start) {
+  safe_mutex_lock(&cdc->lock);
+  uint64_t oldest = cdc->next_seq > cdc->cap ? cdc->next_seq - cdc->cap : 1;
+  if (from_seq == 0) {
+    from_seq = cdc->next_seq;
+  }
+  if (from_seq < oldest || from_seq > cdc->next_seq) {
+    *start = oldest;
+    safe_mutex_unlock(&cdc->lock);
+    return 1;
+  }
+  *start = from_seq;
+  // A dropped client tailing again no longer needs to be told
+  for (int i = cdc->num_tailers - 1; i >= 0; i--) {
+    if (cdc->tailers[i].notif_fd == notif_fd &&
+        cdc->tailers[i].resume_seq != 0) {
+      remove_tailer(cdc, i);
+    }
+  }
+  int failed =
+      cdc->num_tailers == CDC_MAX_TAILERS || is_tailing(cdc, notif_fd);
+  safe_mutex_unlock(&cdc->lock);
+
+  // The client holds the read end, so opening it again doesn't block
+  int fd = failed ? -1 : open(notif_path, O_WRONLY | O_NONBLOCK);
+  if (fd == -1) {
+    return 2;
+  }
+
+  // Kept changes are sent in copies until none is left, then the changes
+  // appended later are sent by cdc_append, so none is missed or sent twice
+  CdcRecord *batch = NULL;
+  size_t batch_cap = 0;
+  uint64_t seq = from_seq;
+  int result = -1;
+  while (result == -1) {
+    size_t count = 0;
+    safe_mutex_lock(&cdc->lock);
+    oldest = cdc->next_seq > cdc->cap ? cdc->next_seq - cdc->cap : 1;
+    if (seq < oldest) {
+      *start = oldest; // Dropped before the client caught up
+      result = 1;
+    } else if (seq == cdc->next_seq) {
+      result =
+          cdc->num_tailers == CDC_MAX_TAILERS || is_tailing(cdc, notif_fd)
+              ? 2
+              : 0;
+      if (result == 0) {
+        cdc->tailers[cdc->num_tailers++] = (CdcTailer){notif_fd, fd, 0};
+      }
+    } else {
+      count = (size_t)(cdc->next_seq - seq);
+      if (count > batch_cap) {
+        free(batch);
+        batch_cap = count;
+        batch = safe_malloc(batch_cap * sizeof(CdcRecord));
+      }
+      for (size_t i = 0; i < count; i++) {
+        batch[i] = cdc->records[(seq + i) % cdc->cap];
+      }
+    }
+    safe_mutex_unlock(&cdc->lock);
+
+    for (size_t i = 0; i < count && result == -1; i++) {
+      if (send_change(notif_fd, &batch[i])) {
+        result = 2;
+      }
+    }
+    seq += count;
+  }
+
+  free(batch);
+  if (result != 0) {
+    close(fd);
+  }
+  return result;
+}
+
+void cdc_replay(Cdc *cdc, int notif_fd, char keys[][MAX_STRING_SIZE],
+                const uint64_t *after, size_t count, int *missed) {
+  // Copied under the lock and sent after it, so writers don't wait for the
+  // client
+  CdcRecord last[MAX_NUMBER_SUB];
+  int found[MAX_NUMBER_SUB] = {0};
+
+  safe_mutex_lock(&cdc->lock);
+  uint64_t oldest = cdc->next_seq > cdc->cap ? cdc->next_seq - cdc->cap : 1;
+  uint64_t from = cdc->next_seq;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t first = after[i] + 1 < oldest ? oldest : after[i] + 1;
+    from = first < from ? first : from;
+  }
+  for (uint64_t seq = from; seq < cdc->next_seq; seq++) {
+    const CdcRecord *record = &cdc->records[seq % cdc->cap];
+    for (size_t i = 0; i < count; i++) {
+      if (seq > after[i] &&
+          strncmp(record->key, keys[i], MAX_STRING_SIZE) == 0) {
+        last[i] = *record;
+        found[i] = 1;
+      }
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    // A change the feed never numbered was seen before the server restarted
+    missed[i] =
+        !found[i] && (after[i] + 1 < oldest || after[i] >= cdc->next_seq);
+  }
+  safe_mutex_unlock(&cdc->lock);
+
+  for (size_t i = 0; i < count; i++) {
+    if (found[i]) {
+      write_notification(notif_fd, keys[i], last[i].value,
+                         last[i].kind == CDC_OP_DELETE ? 2 : 1, last[i].seq);
+    }
+  }
+}
+
+void cdc_untail(Cdc *cdc, int notif_fd) {
+  safe_mutex_lock(&cdc->lock);
+  for (int i = cdc->num_tailers - 1; i >= 0; i--) {
+    if (cdc->tailers[i].notif_fd == notif_fd) {
+      remove_tailer(cdc, i);
+    }
+  }
+  safe_mutex_unlock(&cdc->lock);
+}
+
+void cdc_untail_all(Cdc *cdc) {
+  safe_mutex_lock(&cdc->lock);
+  while (cdc->num_tailers > 0) {
+    remove_tailer(cdc, cdc->num_tailers - 1);
+  }
+  safe_mutex_unlock(&cdc->lock);
+}
+
+void cdc_free(Cdc *cdc) {
+  if (cdc == NULL) {
+    return;
+  }
+  cdc_untail_all(cdc);
+  pthread_mutex_destroy(&cdc->lock);
+  free(cdc->records);
+  free(cdc);
+}
@@ -0,0 +1,105 @@
+#ifndef KVS_CDC_H
+#define KVS_CDC_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "src/common/constants.h"
+
+/// Change kept by a feed. Keys and values are padded with '\0', and aren't
+/// null-terminated if they fill all MAX_STRING_SIZE bytes.
+typedef struct CdcRecord {
+  uint64_t seq;
+  char kind; // CDC_OP_INSERT, CDC_OP_UPDATE or CDC_OP_DELETE
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE]; // Empty for a delete
+} CdcRecord;
+
+/// Client tailing a feed.
+typedef struct {
+  int notif_fd;        // Notification pipe of the session, identifies it
+  int fd;              // Non-blocking descriptor of the same pipe
+  uint64_t resume_seq; // First change it missed once dropped, 0 before
+} CdcTailer;
+
+/// Change data capture feed: a ring of the last changes of a hash table,
+/// numbered in the order they were applied, and the notification pipes of
+/// the clients tailing it. A change is appended while the bucket of its key
+/// is write locked, so the changes of a key are in the order they were
+/// applied. Every change is sent to every tailer as soon as it is appended,
+/// without blocking: a tailer whose pipe is full is dropped, so a slow client
+/// never holds up writers. A dropped tailer keeps its place until a later
+/// change finds room in its pipe for a CDC_OP_DROPPED marker, which carries
+/// the first change it missed so it can TAIL again from there.
+typedef struct Cdc {
+  CdcRecord *records; // Ring of the last cap changes
+  size_t cap;
+  uint64_t next_seq; // Sequence number of the next change, from 1
+  CdcTailer tailers[CDC_MAX_TAILERS];
+  int num_tailers;
+  pthread_mutex_t lock;
+} Cdc;
+
+/// Creates an empty feed.
+/// @param cap Number of changes kept.
+/// @return Newly created feed.
+Cdc *cdc_create(size_t cap);
+
+/// Appends a change and sends it to every tailer. Tailers whose pipe is full
+/// or can't be written are dropped, and told so by the first append that
+/// can write to them again.
+/// @param cdc Feed to be modified.
+/// @param kind CDC_OP_INSERT, CDC_OP_UPDATE or CDC_OP_DELETE.
+/// @param key Key that changed.
+/// @param value New value of the key, ignored for a delete.
+/// @return Sequence number of the change.
+uint64_t cdc_append(Cdc *cdc, char kind, const char *key, const char *value);
+
+/// Sends a client every kept change from a sequence number on, then every
+/// change appended after them. The kept changes are copied under the lock
+/// and sent after it, so writers don't wait for the client to catch up.
+/// @param cdc Feed to be tailed.
+/// @param notif_fd Notification pipe of the client.
+/// @param notif_path Path of the notification pipe, opened again without
+///                   blocking for the changes appended later.
+/// @param from_seq First change to be sent, 0 for the next one appended.
+/// @param start Where the first change to be sent is stored, or the oldest
+///              one kept if from_seq isn't.
+/// @return 0 on success, 1 if from_seq isn't kept or was dropped before the
+///         client caught up, 2 if the client is tailing already, there are
+///         too many tailers or the pipe can't be written. A client that was
+///         dropped and not told yet can tail again.
+int cdc_tail(Cdc *cdc, int notif_fd, const char *notif_path, uint64_t from_seq,
+             uint64_t *start);
+
+/// Catches a client up on some keys after it reconnects: the last kept
+/// change of each key newer than the one the client saw is sent to it as a
+/// notification, which is all a subscriber needs to know.
+/// @param cdc Feed to be searched.
+/// @param notif_fd Notification pipe of the client.
+/// @param keys Keys to catch up on.
+/// @param after Sequence number of the last change of each key the client
+///              saw, 0 if none.
+/// @param count Number of keys, at most MAX_NUMBER_SUB.
+/// @param missed Set for every key that may have changes the feed dropped
+///               and no newer one kept, or whose last change seen isn't in
+///               the feed at all, so the client must read it again.
+void cdc_replay(Cdc *cdc, int notif_fd, char keys[][MAX_STRING_SIZE],
+                const uint64_t *after, size_t count, int *missed);
+
+/// Stops sending changes to a client, if it was tailing the feed.
+/// @param cdc Feed being tailed.
+/// @param notif_fd Notification pipe of the client.
+void cdc_untail(Cdc *cdc, int notif_fd);
+
+/// Stops sending changes to every client.
+/// @param cdc Feed being tailed.
+void cdc_untail_all(Cdc *cdc);
+
+/// Frees a feed.
+/// @param cdc Feed to be freed, may be NULL.
+void cdc_free(Cdc *cdc);
+
+#endif // KVS_CDC_H
@@ -2,4 +2,15 @@
 #define MAX_STRING_SIZE 40
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define BUF_SIZE 256
-#define S 8
\ No newline at end of file
+#define S 8
+#define JOB_READ_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_FLUSH_SIZE (64 * 1024)
+#define JOB_SPLIT_MIN_SIZE (64 * 1024)
+#define JOB_BATCH_SIZE 32
+#define JOB_MAX_BATCH_SIZE 1024
+#define LOAD_CHUNK_MIN_SIZE (1024 * 1024)
+#define READ_FLIGHT_SLOTS 64
+#define MAX_HISTORY_LEN 1024
+#define CDC_MAX_RECORDS (1 << 20)
+#define CDC_MAX_TAILERS 16
+#define SCAN_CHUNK_SIZE 256
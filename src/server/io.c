@@ -1,8 +1,12 @@
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "constants.h"
+#include "io.h"
+
 void write_str(int fd, const char *str) {
   size_t len = strlen(str);
   const char *ptr = str;
@@ -43,3 +47,57 @@ size_t strn_memcpy(char *dest, const char *src, size_t n) {
   memcpy(dest, src, bytes_to_copy);
   return bytes_to_copy;
 }
+
+void init_output(OutputBuffer *out, int fd) {
+  out->data = NULL;
+  out->len = 0;
+  out->cap = 0;
+  out->fd = fd;
+}
+
+int output_write(OutputBuffer *out, const char *str, size_t len) {
+  if (out->len + len > out->cap) {
+    size_t cap = out->cap ? out->cap : BUF_SIZE;
+    while (cap < out->len + len) {
+      cap *= 2;
+    }
+    char *data = realloc(out->data, cap);
+    if (data == NULL) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(1);
+    }
+    out->data = data;
+    out->cap = cap;
+  }
+  memcpy(out->data + out->len, str, len);
+  out->len += len;
+
+  if (out->fd >= 0 && out->len >= OUTPUT_FLUSH_SIZE) {
+    return output_flush(out, out->fd);
+  }
+  return 0;
+}
+
+int output_str(OutputBuffer *out, const char *str) {
+  return output_write(out, str, strlen(str));
+}
+
+int output_flush(OutputBuffer *out, int fd) {
+  size_t total_written = 0;
+  while (total_written < out->len) {
+    ssize_t num_written =
+        write(fd, out->data + total_written, out->len - total_written);
+    if (num_written == -1) {
+      perror("Failed to write to file");
+      return 1;
+    }
+    total_written += (size_t)num_written;
+  }
+  out->len = 0;
+  return 0;
+}
+
+void free_output(OutputBuffer *out) {
+  free(out->data);
+  init_output(out, -1);
+}
@@ -3,6 +3,16 @@
 
 #include <unistd.h>
 
+/// Growable buffer collecting the output of job commands, so it can be written
+/// with few system calls and in the order of the commands that produced it.
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  int fd; // Flushed here once it grows past OUTPUT_FLUSH_SIZE, -1 to keep it
+          // all in memory
+} OutputBuffer;
+
 /// Writes a string to the given file descriptor.
 /// @param fd The file descriptor to write to.
 /// @param str The string to write.
@@ -20,4 +30,33 @@ void write_uint(int fd, int value);
 /// @return Number of bytes copied
 size_t strn_memcpy(char *dest, const char *src, size_t n);
 
+/// Initializes an empty output buffer.
+/// @param out Output buffer to be initialized.
+/// @param fd File descriptor where the buffer is flushed once it grows large,
+///           -1 to keep everything in memory until it is flushed explicitly.
+void init_output(OutputBuffer *out, int fd);
+
+/// Appends bytes to an output buffer.
+/// @param out Output buffer to append to.
+/// @param str Bytes to be appended.
+/// @param len Number of bytes to be appended.
+/// @return 0 on success, 1 if flushing a full buffer failed.
+int output_write(OutputBuffer *out, const char *str, size_t len);
+
+/// Appends a null-terminated string to an output buffer.
+/// @param out Output buffer to append to.
+/// @param str String to be appended.
+/// @return 0 on success, 1 if flushing a full buffer failed.
+int output_str(OutputBuffer *out, const char *str);
+
+/// Writes the whole content of an output buffer and empties it.
+/// @param out Output buffer to be flushed.
+/// @param fd File descriptor to write to.
+/// @return 0 on success, 1 otherwise.
+int output_flush(OutputBuffer *out, int fd);
+
+/// Releases the memory of an output buffer, discarding its content.
+/// @param out Output buffer to be freed.
+void free_output(OutputBuffer *out);
+
 #endif // KVS_IO_H
@@ -0,0 +1,161 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "binjob.h"
+#include "constants.h"
+#include "io.h"
+#include "parser.h"
+
+/// Compiles a .job file into the binary format run by the server with -c.
+/// Invalid commands are reported and left out, the rest are kept in order.
+int main(int argc, char *argv[]) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: %s <input.job> [output%s]\n", argv[0],
+            BINJOB_EXTENSION);
+    return 1;
+  }
+
+  char output_path[PATH_MAX];
+  if (argc == 3) {
+    snprintf(output_path, sizeof(output_path), "%s", argv[2]);
+  } else {
+    size_t len = strlen(argv[1]);
+    if (len > 4 && strcmp(argv[1] + len - 4, ".job") == 0) {
+      len -= 4;
+    }
+    snprintf(output_path, sizeof(output_path), "%.*s%s", (int)len, argv[1],
+             BINJOB_EXTENSION);
+  }
+
+  int jobs_fd = open(argv[1], O_RDONLY);
+  if (jobs_fd == -1) {
+    fprintf(stderr, "Failed to open .job file\n");
+    return 1;
+  }
+  JobReader reader;
+  if (init_reader(&reader, jobs_fd)) {
+    fprintf(stderr, "Failed to read .job file\n");
+    close(jobs_fd);
+    return 1;
+  }
+
+  int out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "Failed to create output file: %s\n", output_path);
+    close_reader(&reader);
+    close(jobs_fd);
+    return 1;
+  }
+
+  OutputBuffer out;
+  init_output(&out, out_fd);
+  int failed = binjob_write_header(&out);
+  size_t line = 0;
+  size_t num_commands = 0;
+  int done = 0;
+  while (!done && !failed) {
+    Slice keys[MAX_WRITE_SIZE];
+    Slice values[MAX_WRITE_SIZE];
+    size_t num_pairs = 0;
+    unsigned int number = 0; // Delay, limit of a SCAN or HISTORY or a TTL
+    int valid = 1;
+
+    line++;
+    enum Command command = get_next(&reader);
+    switch (command) {
+    case CMD_WRITE:
+      num_pairs = parse_write(&reader, keys, values, MAX_WRITE_SIZE,
+                              MAX_STRING_SIZE, &number);
+      valid = num_pairs > 0;
+      break;
+    case CMD_READ:
+    case CMD_DELETE:
+      num_pairs = parse_read_delete(&reader, keys, MAX_WRITE_SIZE,
+                                    MAX_STRING_SIZE,
+                                    command == CMD_READ ? values : NULL);
+      valid = num_pairs > 0;
+      break;
+    case CMD_WAIT:
+      valid = parse_wait(&reader, &number, NULL) != -1;
+      break;
+    case CMD_SCAN:
+      num_pairs = 2;
+      valid = parse_scan(&reader, &keys[0], &keys[1], &number,
+                         MAX_STRING_SIZE) != -1;
+      break;
+    case CMD_PREFIX:
+      num_pairs = 1;
+      valid = parse_prefix(&reader, keys, MAX_STRING_SIZE) != -1;
+      break;
+    case CMD_HISTORY:
+      num_pairs = 1;
+      valid = parse_history(&reader, keys, &number, MAX_STRING_SIZE) != -1;
+      break;
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_ADD:
+      // Compiled as an ADD of 1 or -1
+      num_pairs = 1;
+      valid = parse_add(&reader, keys, command == CMD_ADD ? values : NULL,
+                        MAX_STRING_SIZE) != -1;
+      if (command != CMD_ADD) {
+        values[0] = command == CMD_INCR ? (Slice){"1", 1} : (Slice){"-1", 2};
+        command = CMD_ADD;
+      }
+      break;
+    case CMD_CAS:
+    case CMD_PUTNX:
+      num_pairs = 1;
+      valid = parse_cas(&reader, keys,
+                        command == CMD_CAS ? &values[1] : NULL, &values[0],
+                        MAX_STRING_SIZE) != -1;
+      break;
+    case CMD_LOAD:
+    case CMD_EXPORT:
+      num_pairs = 1;
+      valid = parse_path(&reader, keys, PATH_MAX) != -1;
+      break;
+    case CMD_SHOW:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_MULTI:
+    case CMD_EXEC:
+      break;
+    case CMD_INVALID:
+      valid = 0;
+      break;
+    case CMD_EMPTY:
+      continue;
+    case EOC:
+      done = 1;
+      continue;
+    }
+
+    if (valid) {
+      int result =
+          binjob_encode(&out, command, keys, values, num_pairs, number);
+      failed = result == 1;
+      valid = result == 0;
+    }
+    if (!valid && !failed) {
+      fprintf(stderr, "Line %zu: invalid command, left out\n", line);
+      continue;
+    }
+    num_commands++;
+  }
+
+  failed |= output_flush(&out, out_fd);
+  free_output(&out);
+  close_reader(&reader);
+  close(jobs_fd);
+  if (close(out_fd) == -1 || failed) {
+    fprintf(stderr, "Failed to write %s\n", output_path);
+    return 1;
+  }
+
+  printf("Compiled %zu commands into %s\n", num_commands, output_path);
+  return 0;
+}
@@ -0,0 +1,1367 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "binjob.h"
+#include "constants.h"
+#include "io.h"
+#include "jobs.h"
+#include "operations.h"
+#include "parser.h"
+#include "pool.h"
+#include "timer.h"
+
+typedef struct FileJob FileJob;
+
+/// A range of commands of a job file, run as a single task. When commands run
+/// in parallel every command is a range of its own, started once the ranges
+/// it depends on are done.
+typedef struct {
+  FileJob *job;
+  size_t start;     // Position of the next command to run in the job file
+  size_t end;       // Position after the last command
+  OutputBuffer out; // Output of the range, until its turn to be written
+  int done;
+  size_t deps;        // Ranges that must be done before this one starts
+  size_t *successors; // Ranges depending on this one
+  size_t num_successors;
+  size_t successors_cap;
+} JobRange;
+
+/// A job file being run, shared by the tasks running its ranges.
+struct FileJob {
+  char *path;
+  int jobs_fd;
+  int out_fd;
+  JobReader reader;
+  int backups; // Number of the next backup
+  size_t num_ranges;
+  JobRange *ranges;
+  size_t next_flush; // First range whose output wasn't written yet
+  size_t remaining;  // Ranges not finished yet
+  pthread_mutex_t lock;
+};
+
+/// A command found while scanning a job file.
+typedef struct {
+  size_t start;     // Position of the command in the job file
+  size_t first_key; // Index of its first key in the scanned keys
+  size_t num_keys;
+  int writes;  // Set for WRITE and DELETE
+  int inserts; // Set for WRITE, which may add keys in front of their buckets
+  int barrier; // Set for commands using the whole table, and WAIT
+} ScannedCommand;
+
+/// Entry of the map from keys to the commands using them.
+typedef struct {
+  Slice key; // NULL ptr for empty entries
+  size_t first_command;
+  size_t last_command;
+} KeyUse;
+
+/// Entry of the map from keys to the commands the next command using them
+/// depends on.
+typedef struct {
+  Slice key;          // NULL ptr for empty entries
+  size_t epoch;       // Barriers seen when the entry was last used
+  size_t last_writer; // NO_COMMAND if no command since the barrier writes it
+  size_t *readers;    // Commands reading it since the last writer
+  size_t num_readers;
+  size_t readers_cap;
+} KeyState;
+
+#define NO_COMMAND SIZE_MAX
+
+/*----------------------------GLOBAL VARIABLES-------------------------------*/
+
+static SubscriptionList **subs = NULL;
+static int max_ranges = 1;
+static int parallel_commands = 0;
+static size_t batch_size = 1;
+static int compiled_jobs = 0;
+static const char *job_extension = ".job";
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+static uint64_t hash_slice(Slice key) {
+  uint64_t h = 14695981039346656037ull; // FNV-1a
+  for (size_t i = 0; i < key.len; i++) {
+    h = (h ^ (unsigned char)key.ptr[i]) * 1099511628211ull;
+  }
+  return h;
+}
+
+/// Appends an element to a growable array.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int grow_append(void **array, size_t *count, size_t *cap,
+                       const void *element, size_t size) {
+  if (*count == *cap) {
+    size_t new_cap = *cap ? *cap * 2 : 256;
+    void *grown = realloc(*array, new_cap * size);
+    if (grown == NULL) {
+      return 1;
+    }
+    *array = grown;
+    *cap = new_cap;
+  }
+  memcpy((char *)*array + *count * size, element, size);
+  (*count)++;
+  return 0;
+}
+
+/// Scans every command of a job file, collecting the keys each one uses. A
+/// MULTI block up to its EXEC is scanned as a single command.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int scan_commands(const JobReader *reader, ScannedCommand **commands,
+                         size_t *num_commands, Slice **keys, size_t *num_keys) {
+  JobReader scan = *reader;
+  scan.pos = 0;
+  size_t commands_cap = 0;
+  size_t keys_cap = 0;
+  ScannedCommand command;
+  int in_block = 0; // Set between a MULTI and its EXEC
+
+  while (1) {
+    Slice cmd_keys[MAX_WRITE_SIZE];
+    Slice cmd_values[MAX_WRITE_SIZE];
+    unsigned int number;
+    size_t found = 0; // Keys of the command
+    if (!in_block) {
+      command = (ScannedCommand){scan.pos, *num_keys, 0, 0, 0, 0};
+    }
+
+    enum Command kind = get_next(&scan);
+    switch (kind) {
+    case CMD_WRITE:
+      found = parse_write(&scan, cmd_keys, cmd_values, MAX_WRITE_SIZE,
+                          MAX_STRING_SIZE, &number);
+      command.writes = 1;
+      command.inserts = 1;
+      break;
+    case CMD_READ:
+      found = parse_read_delete(&scan, cmd_keys, MAX_WRITE_SIZE,
+                                MAX_STRING_SIZE, &cmd_values[0]);
+      break;
+    case CMD_DELETE:
+      found = parse_read_delete(&scan, cmd_keys, MAX_WRITE_SIZE,
+                                MAX_STRING_SIZE, NULL);
+      command.writes = 1;
+      break;
+    case CMD_HISTORY:
+      found = parse_history(&scan, cmd_keys, &number, MAX_STRING_SIZE) == 0;
+      break;
+    case CMD_WAIT:
+      parse_wait(&scan, &number, NULL);
+      command.barrier = 1;
+      break;
+    case CMD_LOAD:
+    case CMD_EXPORT:
+      parse_path(&scan, cmd_keys, PATH_MAX);
+      command.barrier = 1;
+      break;
+    case CMD_SCAN:
+      parse_scan(&scan, &cmd_keys[0], &cmd_keys[1], &number, MAX_STRING_SIZE);
+      command.barrier = 1;
+      break;
+    case CMD_PREFIX:
+      parse_prefix(&scan, cmd_keys, MAX_STRING_SIZE);
+      command.barrier = 1;
+      break;
+    case CMD_CAS:
+      found = parse_cas(&scan, cmd_keys, &cmd_values[1], &cmd_values[0],
+                        MAX_STRING_SIZE) == 0;
+      command.writes = 1;
+      break;
+    case CMD_PUTNX:
+      found = parse_cas(&scan, cmd_keys, NULL, &cmd_values[0],
+                        MAX_STRING_SIZE) == 0;
+      command.writes = 1;
+      command.inserts = 1;
+      break;
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_ADD:
+      found = parse_add(&scan, cmd_keys,
+                        kind == CMD_ADD ? &cmd_values[0] : NULL,
+                        MAX_STRING_SIZE) == 0;
+      command.writes = 1;
+      command.inserts = 1;
+      break;
+    case CMD_SHOW:
+    case CMD_BACKUP:
+      command.barrier = 1;
+      break;
+    case CMD_MULTI:
+      in_block = 1;
+      break;
+    case CMD_EXEC:
+      in_block = 0;
+      break;
+    case CMD_HELP:
+    case CMD_INVALID:
+    case CMD_EMPTY:
+      break;
+    case EOC:
+      // A block left open runs up to the end of the file
+      return in_block ? grow_append((void **)commands, num_commands,
+                                    &commands_cap, &command,
+                                    sizeof(ScannedCommand))
+                      : 0;
+    }
+
+    for (size_t i = 0; i < found; i++) {
+      if (grow_append((void **)keys, num_keys, &keys_cap, &cmd_keys[i],
+                      sizeof(Slice))) {
+        return 1;
+      }
+    }
+    command.num_keys += found;
+    if (!in_block && grow_append((void **)commands, num_commands,
+                                 &commands_cap, &command,
+                                 sizeof(ScannedCommand))) {
+      return 1;
+    }
+  }
+}
+
+/// Finds the points where a job file can be split: a cut after a command is
+/// possible when no key is used both before and after it.
+/// @param commands Commands of the job file.
+/// @param num_commands Number of commands.
+/// @param keys Keys used by the commands.
+/// @param num_keys Number of keys.
+/// @param can_cut Array where can_cut[i] is set if a cut after command i is
+///                possible.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int find_cuts(const ScannedCommand *commands, size_t num_commands,
+                     const Slice *keys, size_t num_keys, int *can_cut) {
+  size_t cap = 16;
+  while (cap < 2 * num_keys) {
+    cap *= 2;
+  }
+  KeyUse *uses = calloc(cap, sizeof(KeyUse));
+  long *crossing = calloc(num_commands + 1, sizeof(long));
+  if (uses == NULL || crossing == NULL) {
+    free(uses);
+    free(crossing);
+    return 1;
+  }
+
+  for (size_t c = 0; c < num_commands; c++) {
+    for (size_t k = commands[c].first_key;
+         k < commands[c].first_key + commands[c].num_keys; k++) {
+      size_t slot = (size_t)hash_slice(keys[k]) & (cap - 1);
+      while (uses[slot].key.ptr != NULL &&
+             (uses[slot].key.len != keys[k].len ||
+              memcmp(uses[slot].key.ptr, keys[k].ptr, keys[k].len) != 0)) {
+        slot = (slot + 1) & (cap - 1);
+      }
+      if (uses[slot].key.ptr == NULL) {
+        uses[slot] = (KeyUse){keys[k], c, c};
+      }
+      uses[slot].last_command = c;
+    }
+  }
+
+  // Every key is live from its first to its last command
+  for (size_t slot = 0; slot < cap; slot++) {
+    if (uses[slot].key.ptr != NULL &&
+        uses[slot].first_command < uses[slot].last_command) {
+      crossing[uses[slot].first_command]++;
+      crossing[uses[slot].last_command]--;
+    }
+  }
+  long live = 0;
+  for (size_t c = 0; c < num_commands; c++) {
+    live += crossing[c];
+    can_cut[c] = live == 0;
+  }
+
+  free(uses);
+  free(crossing);
+  return 0;
+}
+
+/// Finds the state of a key in the dependency map, resetting it if it wasn't
+/// used since the last barrier.
+/// @param states Map of key states.
+/// @param cap Number of entries of the map, a power of two.
+/// @param key Key to be found.
+/// @param epoch Number of barriers seen so far.
+/// @return State of the key.
+static KeyState *find_state(KeyState *states, size_t cap, Slice key,
+                            size_t epoch) {
+  size_t slot = (size_t)hash_slice(key) & (cap - 1);
+  while (states[slot].key.ptr != NULL &&
+         (states[slot].key.len != key.len ||
+          memcmp(states[slot].key.ptr, key.ptr, key.len) != 0)) {
+    slot = (slot + 1) & (cap - 1);
+  }
+  KeyState *state = &states[slot];
+  if (state->key.ptr == NULL || state->epoch != epoch) {
+    state->key = key;
+    state->epoch = epoch;
+    state->last_writer = NO_COMMAND;
+    state->num_readers = 0;
+  }
+  return state;
+}
+
+/// Allocates zeroed ranges, terminating the program if that fails.
+/// @param count Number of ranges.
+/// @return Array of ranges.
+static JobRange *alloc_ranges(size_t count) {
+  JobRange *ranges = calloc(count, sizeof(JobRange));
+  if (ranges == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(1);
+  }
+  return ranges;
+}
+
+/// Makes a range depend on another one.
+/// @param ranges Ranges of the job file.
+/// @param from Range that must be done first.
+/// @param to Range that depends on it.
+static void add_dependency(JobRange *ranges, size_t from, size_t to) {
+  JobRange *range = &ranges[from];
+  if (range->num_successors > 0 &&
+      range->successors[range->num_successors - 1] == to) {
+    return; // Same command through another key
+  }
+  if (grow_append((void **)&range->successors, &range->num_successors,
+                  &range->successors_cap, &to, sizeof(size_t))) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(1);
+  }
+  ranges[to].deps++;
+}
+
+/// Makes every command a range of its own and links it to the commands it
+/// depends on: a READ depends on the last command writing each of its keys,
+/// a WRITE or DELETE also on the commands reading them since, and SHOW, WAIT
+/// and BACKUP are barriers, ordered with respect to every other command. New
+/// keys go in front of their bucket, so a WRITE also depends on the last
+/// WRITE to each of its buckets, keeping SHOW and backups unchanged.
+/// @param job Job file whose ranges will be created.
+/// @param commands Commands of the job file.
+/// @param num_commands Number of commands.
+/// @param keys Keys used by the commands.
+/// @param num_keys Number of keys.
+static void build_graph(FileJob *job, const ScannedCommand *commands,
+                        size_t num_commands, const Slice *keys,
+                        size_t num_keys) {
+  size_t cap = 16;
+  while (cap < 2 * num_keys) {
+    cap *= 2;
+  }
+  KeyState *states = calloc(cap, sizeof(KeyState));
+  if (states == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(1);
+  }
+
+  job->ranges = alloc_ranges(num_commands);
+  job->num_ranges = num_commands;
+
+  size_t epoch = 0;
+  size_t last_barrier = NO_COMMAND;
+  size_t last_insert[TABLE_SIZE]; // Last WRITE to each bucket since a barrier
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    last_insert[i] = NO_COMMAND;
+  }
+  for (size_t c = 0; c < num_commands; c++) {
+    job->ranges[c].start = commands[c].start;
+    job->ranges[c].end =
+        c + 1 < num_commands ? commands[c + 1].start : job->reader.len;
+
+    if (commands[c].barrier) {
+      size_t first = last_barrier == NO_COMMAND ? 0 : last_barrier;
+      for (size_t i = first; i < c; i++) {
+        add_dependency(job->ranges, i, c);
+      }
+      last_barrier = c;
+      epoch++; // Later commands only need to depend on this one
+      for (int i = 0; i < TABLE_SIZE; i++) {
+        last_insert[i] = NO_COMMAND;
+      }
+      continue;
+    }
+
+    if (last_barrier != NO_COMMAND) {
+      add_dependency(job->ranges, last_barrier, c);
+    }
+    for (size_t k = commands[c].first_key;
+         k < commands[c].first_key + commands[c].num_keys; k++) {
+      int bucket = hash(keys[k].ptr);
+      if (commands[c].inserts && bucket >= 0) {
+        if (last_insert[bucket] != NO_COMMAND && last_insert[bucket] != c) {
+          add_dependency(job->ranges, last_insert[bucket], c);
+        }
+        last_insert[bucket] = c;
+      }
+
+      KeyState *state = find_state(states, cap, keys[k], epoch);
+      if (state->last_writer != NO_COMMAND && state->last_writer != c) {
+        add_dependency(job->ranges, state->last_writer, c);
+      }
+      if (commands[c].writes) {
+        for (size_t r = 0; r < state->num_readers; r++) {
+          if (state->readers[r] != c) {
+            add_dependency(job->ranges, state->readers[r], c);
+          }
+        }
+        state->num_readers = 0;
+        state->last_writer = c;
+      } else if (grow_append((void **)&state->readers, &state->num_readers,
+                             &state->readers_cap, &c, sizeof(size_t))) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(1);
+      }
+    }
+  }
+
+  for (size_t slot = 0; slot < cap; slot++) {
+    free(states[slot].readers);
+  }
+  free(states);
+}
+
+/// Splits a job file into the ranges run as separate tasks. When commands run
+/// in parallel, every command is a range ordered by its keys. Otherwise large
+/// files are split into ranges of commands that share no keys, with roughly
+/// the same number of bytes each, while files that are small or have commands
+/// that depend on every other command are kept in a single range.
+/// @param job Job file whose ranges will be created.
+static void plan_ranges(FileJob *job) {
+  size_t len = job->reader.len;
+  ScannedCommand *commands = NULL;
+  size_t num_commands = 0;
+  Slice *keys = NULL;
+  size_t num_keys = 0;
+  int *can_cut = NULL;
+  int has_barrier = 0;
+
+  int scanned = !compiled_jobs && (parallel_commands ||
+                 (max_ranges > 1 && len >= JOB_SPLIT_MIN_SIZE)) &&
+                !scan_commands(&job->reader, &commands, &num_commands, &keys,
+                               &num_keys);
+  for (size_t c = 0; scanned && c < num_commands; c++) {
+    has_barrier |= commands[c].barrier;
+  }
+
+  job->ranges = NULL;
+  job->num_ranges = 0;
+
+  if (compiled_jobs) {
+    // Compiled files are already cheap to run, they are never split
+    job->ranges = alloc_ranges(1);
+    job->ranges[0].start = BINJOB_HEADER_SIZE;
+    job->ranges[0].end = len;
+    job->num_ranges = 1;
+    if (!binjob_is_compiled(job->reader.data, len)) {
+      fprintf(stderr, "Not a compiled job file: %s\n", job->path);
+      job->ranges[0].start = len;
+    }
+  } else if (scanned && parallel_commands && num_commands > 0) {
+    build_graph(job, commands, num_commands, keys, num_keys);
+  } else if (scanned && !has_barrier && num_commands > 1 &&
+             (can_cut = malloc(num_commands * sizeof(int))) != NULL &&
+             !find_cuts(commands, num_commands, keys, num_keys, can_cut)) {
+    job->ranges = alloc_ranges((size_t)max_ranges);
+    size_t target = len / (size_t)max_ranges;
+    size_t start = 0;
+    for (size_t c = 0; c + 1 < num_commands &&
+                       job->num_ranges + 1 < (size_t)max_ranges;
+         c++) {
+      size_t end = commands[c + 1].start;
+      if (can_cut[c] && end - start >= target) {
+        job->ranges[job->num_ranges].start = start;
+        job->ranges[job->num_ranges++].end = end;
+        start = end;
+      }
+    }
+    job->ranges[job->num_ranges].start = start;
+    job->ranges[job->num_ranges++].end = len;
+  } else {
+    job->ranges = alloc_ranges(1);
+    job->ranges[job->num_ranges].start = 0;
+    job->ranges[job->num_ranges++].end = len;
+  }
+
+  free(commands);
+  free(keys);
+  free(can_cut);
+
+  for (size_t i = 0; i < job->num_ranges; i++) {
+    job->ranges[i].job = job;
+    job->ranges[i].done = 0;
+    // Only the first range may write its output as soon as it is produced
+    init_output(&job->ranges[i].out, i == 0 ? job->out_fd : -1);
+  }
+  job->next_flush = 0;
+  job->remaining = job->num_ranges;
+}
+
+/// Opens the backup and manifest files of a job file and queues a backup.
+/// @param jobs_file_path Path of the job file.
+/// @param backups Number of the backup.
+/// @return 0 if the backup was queued successfully, 1 otherwise.
+static int create_backup(const char *jobs_file_path, int backups) {
+  /*CREATING .BCK FILE*/
+  char temp_path[MAX_JOB_FILE_NAME_SIZE];
+  snprintf(temp_path, sizeof(temp_path), "%.*s",
+           (int)(strlen(jobs_file_path) - strlen(job_extension)),
+           jobs_file_path);
+
+  char backup_file_path[PATH_MAX];
+  snprintf(backup_file_path, sizeof(backup_file_path), "%s-%d.bck", temp_path,
+           backups);
+
+  int bck_fd = open(backup_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (bck_fd < 0) {
+    fprintf(stderr, "Failed to create backup file: %s\n", backup_file_path);
+    return 1;
+  }
+  /*OPENED .BCK FILE*/
+
+  char manifest_file_path[PATH_MAX];
+  snprintf(manifest_file_path, sizeof(manifest_file_path), "%s-%d.mft",
+           temp_path, backups);
+  int mft_fd = open(manifest_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (mft_fd < 0) {
+    fprintf(stderr, "Failed to create manifest file: %s\n",
+            manifest_file_path);
+  }
+
+  /*HANDING THE BACKUP TO THE BACKUP WORKERS*/
+  if (kvs_backup(bck_fd, mft_fd)) {
+    close(bck_fd);
+    if (mft_fd >= 0) {
+      close(mft_fd);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/// Keys and values of a run of adjacent WRITE or DELETE commands.
+typedef struct {
+  size_t num_commands;
+  size_t num_pairs[JOB_MAX_BATCH_SIZE];   // Pairs of each command
+  unsigned int ttl_ms[JOB_MAX_BATCH_SIZE]; // TTL of each WRITE, 0 for none
+  size_t total_pairs;
+  Slice *keys;      // Room for MAX_WRITE_SIZE pairs per command
+  uint64_t *hashes; // Hashes of the keys, only read from compiled job files
+  Slice *values;    // Unused for DELETE
+} CommandBatch;
+
+/// Reads the next command of a job file, parsing its arguments.
+/// @param reader Reader over the job file.
+/// @param keys Array of MAX_WRITE_SIZE slices for the keys, or the path of a
+///             LOAD or EXPORT, the keys of a SCAN or the prefix of a PREFIX.
+/// @param hashes Array of MAX_WRITE_SIZE hashes, where the hashes stored
+///               with the keys of a compiled job file are stored. Left
+///               untouched for a .job file, whose keys are hashed when run.
+/// @param values Array of MAX_WRITE_SIZE slices for the values, or the
+///               version of a READ, empty if none.
+/// @param num_pairs Where the number of keys is stored.
+/// @param number Where the delay of a WAIT, the limit of a SCAN or HISTORY
+///               or the TTL of a WRITE is stored.
+/// @return The command read, CMD_INVALID if its arguments are invalid.
+static enum Command read_command(JobReader *reader, Slice *keys,
+                                 uint64_t *hashes, Slice *values,
+                                 size_t *num_pairs, unsigned int *number) {
+  if (compiled_jobs) {
+    return binjob_next(reader, keys, hashes, values, num_pairs, number);
+  }
+
+  enum Command command = get_next(reader);
+  switch (command) {
+  case CMD_WRITE:
+    *num_pairs = parse_write(reader, keys, values, MAX_WRITE_SIZE,
+                             MAX_STRING_SIZE, number);
+    return *num_pairs == 0 ? CMD_INVALID : command;
+
+  case CMD_READ:
+  case CMD_DELETE:
+    *num_pairs = parse_read_delete(reader, keys, MAX_WRITE_SIZE,
+                                   MAX_STRING_SIZE,
+                                   command == CMD_READ ? &values[0] : NULL);
+    return *num_pairs == 0 ? CMD_INVALID : command;
+
+  case CMD_WAIT:
+    return parse_wait(reader, number, NULL) == -1 ? CMD_INVALID : command;
+
+  case CMD_SCAN:
+    *num_pairs = 2;
+    if (parse_scan(reader, &keys[0], &keys[1], number, MAX_STRING_SIZE)) {
+      return CMD_INVALID;
+    }
+    return command;
+
+  case CMD_PREFIX:
+    *num_pairs = 1;
+    if (parse_prefix(reader, keys, MAX_STRING_SIZE)) {
+      return CMD_INVALID;
+    }
+    return command;
+
+  case CMD_HISTORY:
+    *num_pairs = 1;
+    if (parse_history(reader, keys, number, MAX_STRING_SIZE)) {
+      return CMD_INVALID;
+    }
+    return command;
+
+  case CMD_CAS:
+  case CMD_PUTNX:
+    *num_pairs = 1;
+    if (parse_cas(reader, keys, command == CMD_CAS ? &values[1] : NULL,
+                  &values[0], MAX_STRING_SIZE)) {
+      return CMD_INVALID;
+    }
+    return command;
+
+  case CMD_INCR:
+  case CMD_DECR:
+  case CMD_ADD:
+    // Run as an ADD of 1 or -1
+    *num_pairs = 1;
+    if (parse_add(reader, keys, command == CMD_ADD ? &values[0] : NULL,
+                  MAX_STRING_SIZE)) {
+      return CMD_INVALID;
+    }
+    if (command != CMD_ADD) {
+      values[0] = command == CMD_INCR ? (Slice){"1", 1} : (Slice){"-1", 2};
+    }
+    return CMD_ADD;
+
+  case CMD_LOAD:
+  case CMD_EXPORT:
+    *num_pairs = 1;
+    return parse_path(reader, keys, PATH_MAX) == -1 ? CMD_INVALID : command;
+
+  case CMD_SHOW:
+  case CMD_BACKUP:
+  case CMD_HELP:
+  case CMD_MULTI:
+  case CMD_EXEC:
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    return command;
+  }
+  return command;
+}
+
+/// Reads the commands following a WRITE or DELETE that was just read into a
+/// batch, as long as they are of the same kind and the batch isn't full.
+/// Empty lines are skipped and invalid commands don't end the batch.
+/// @param reader Reader positioned after the first command of the batch.
+/// @param batch Batch holding the first command.
+/// @param command Kind of command being batched.
+static void extend_batch(JobReader *reader, CommandBatch *batch,
+                         enum Command command) {
+  while (batch->num_commands < batch_size) {
+    size_t pos = reader->pos;
+    size_t num_pairs;
+    unsigned int number = 0;
+    enum Command next =
+        read_command(reader, batch->keys + batch->total_pairs,
+                     batch->hashes + batch->total_pairs,
+                     batch->values + batch->total_pairs, &num_pairs, &number);
+    if (next == CMD_EMPTY) {
+      continue;
+    }
+    if (next == CMD_INVALID) {
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      continue;
+    }
+    if (next != command) {
+      reader->pos = pos; // Left for the caller
+      return;
+    }
+    batch->ttl_ms[batch->num_commands] = number;
+    batch->num_pairs[batch->num_commands++] = num_pairs;
+    batch->total_pairs += num_pairs;
+  }
+}
+
+/// Reads the commands of a MULTI block up to its EXEC and runs them as one
+/// transaction. Only READ, WRITE and DELETE can be queued: any other command,
+/// or a block without EXEC, discards the whole transaction.
+/// @param reader Reader positioned after the MULTI.
+/// @param out Output buffer of the range.
+static void run_transaction(JobReader *reader, OutputBuffer *out) {
+  TxCommand *commands = NULL;
+  size_t num_commands = 0;
+  size_t commands_cap = 0;
+  Slice *keys = NULL;
+  uint64_t *hashes = NULL;
+  Slice *values = NULL;
+  size_t num_keys = 0;
+  size_t num_hashes = 0;
+  size_t num_values = 0;
+  size_t keys_cap = 0;
+  size_t hashes_cap = 0;
+  size_t values_cap = 0;
+  int valid = 1;
+  int failed = 0;
+
+  enum Command command = CMD_EMPTY;
+  while (command != CMD_EXEC && command != EOC && !failed) {
+    Slice cmd_keys[MAX_WRITE_SIZE];
+    uint64_t cmd_hashes[MAX_WRITE_SIZE];
+    Slice cmd_values[MAX_WRITE_SIZE];
+    size_t num_pairs = 0;
+    unsigned int number = 0;
+    command = read_command(reader, cmd_keys, cmd_hashes, cmd_values,
+                           &num_pairs, &number);
+
+    TxCommand tx = {TX_READ, num_pairs, NULL, NULL, NULL, number};
+    switch (command) {
+    case CMD_READ:
+      if (cmd_values[0].len > 0) {
+        fprintf(stderr, "Invalid command in a transaction, discarded\n");
+        valid = 0;
+        continue;
+      }
+      break;
+    case CMD_WRITE:
+      tx.kind = TX_WRITE;
+      break;
+    case CMD_DELETE:
+      tx.kind = TX_DELETE;
+      break;
+    case EOC:
+      fprintf(stderr, "MULTI without EXEC, transaction discarded\n");
+      valid = 0;
+      continue;
+    case CMD_EXEC:
+    case CMD_EMPTY:
+      continue;
+    case CMD_WAIT:
+    case CMD_SHOW:
+    case CMD_BACKUP:
+    case CMD_HELP:
+    case CMD_LOAD:
+    case CMD_EXPORT:
+    case CMD_SCAN:
+    case CMD_PREFIX:
+    case CMD_CAS:
+    case CMD_PUTNX:
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_ADD:
+    case CMD_MULTI:
+    case CMD_HISTORY:
+    case CMD_INVALID:
+      fprintf(stderr, "Invalid command in a transaction, discarded\n");
+      valid = 0;
+      continue;
+    }
+
+    for (size_t i = 0; i < num_pairs && !failed; i++) {
+      failed = grow_append((void **)&keys, &num_keys, &keys_cap, &cmd_keys[i],
+                           sizeof(Slice)) ||
+               (compiled_jobs &&
+                grow_append((void **)&hashes, &num_hashes, &hashes_cap,
+                            &cmd_hashes[i], sizeof(uint64_t))) ||
+               grow_append((void **)&values, &num_values, &values_cap,
+                           &cmd_values[i], sizeof(Slice));
+    }
+    failed = failed || grow_append((void **)&commands, &num_commands,
+                                   &commands_cap, &tx, sizeof(TxCommand));
+  }
+
+  if (failed) {
+    fprintf(stderr, "Failed to allocate memory\n");
+  } else if (valid && num_commands > 0) {
+    // The arrays are only complete now, so the slices are set last
+    size_t first_key = 0;
+    for (size_t c = 0; c < num_commands; c++) {
+      commands[c].keys = keys + first_key;
+      commands[c].hashes = hashes != NULL ? hashes + first_key : NULL;
+      commands[c].values = values + first_key;
+      first_key += commands[c].num_pairs;
+    }
+    if (kvs_transaction(num_commands, commands, out, *subs)) {
+      fprintf(stderr, "Failed to run transaction\n");
+    }
+  }
+  free(commands);
+  free(keys);
+  free(hashes);
+  free(values);
+}
+
+/// Writes a pair found by a SCAN or PREFIX as "(key,value)".
+/// @param node Node of the pair.
+/// @param arg Output buffer to write to.
+/// @return 0, so the scan goes on.
+static int output_pair(const KeyNode *node, void *arg) {
+  char buf[BUF_SIZE];
+  snprintf(buf, sizeof(buf), "(%s,%s)", node->key, node->value);
+  output_str(arg, buf);
+  return 0;
+}
+
+static void run_range(void *arg);
+
+/// Resumes a range parked by a WAIT, called by the timer thread.
+/// @param arg Range to be resumed.
+static void resume_range(void *arg) {
+  pool_submit(run_range, arg);
+  pool_release();
+}
+
+/// Runs the commands of a range until it reaches its end or a WAIT. A WAIT
+/// parks the range on a timer instead of sleeping, freeing the thread for
+/// other jobs until the range is resumed after the command.
+/// @param range Range whose commands will be run.
+/// @param reader Reader over the commands to be run.
+/// @return 0 if every command was run, 1 if the range was parked.
+static int run_commands(JobRange *range, JobReader *reader) {
+  FileJob *job = range->job;
+  OutputBuffer *out = &range->out;
+  // Slices into the mapped job file, nothing is copied
+  CommandBatch batch;
+  batch.keys = safe_malloc(batch_size * MAX_WRITE_SIZE * sizeof(Slice));
+  batch.hashes = safe_malloc(batch_size * MAX_WRITE_SIZE * sizeof(uint64_t));
+  batch.values = safe_malloc(batch_size * MAX_WRITE_SIZE * sizeof(Slice));
+  // Compiled job files carry the hash of every key, .job files are hashed
+  // by the operations
+  const uint64_t *hashes = compiled_jobs ? batch.hashes : NULL;
+
+  while (1) {
+    Slice *keys = batch.keys;
+    Slice *values = batch.values;
+    unsigned int number; // Delay of a WAIT, limit of a SCAN or TTL of a WRITE
+    size_t num_pairs;
+
+    enum Command command =
+        read_command(reader, keys, batch.hashes, values, &num_pairs, &number);
+    switch (command) {
+    case CMD_WRITE:
+      batch.num_commands = 1;
+      batch.num_pairs[0] = batch.total_pairs = num_pairs;
+      batch.ttl_ms[0] = number;
+      extend_batch(reader, &batch, CMD_WRITE);
+      if (kvs_write_batch(batch.num_commands, batch.num_pairs, keys, hashes,
+                          values, batch.ttl_ms, *subs)) {
+        fprintf(stderr, "Failed to write pair\n");
+      }
+      break;
+
+    case CMD_READ:
+      if (values[0].len > 0) {
+        uint64_t version;
+        parse_version(values[0], &version); // Checked by the parser
+        if (kvs_read_at(num_pairs, keys, hashes, version, out)) {
+          fprintf(stderr, "Failed to read pair\n");
+        }
+      } else if (kvs_read(num_pairs, keys, hashes, out)) {
+        fprintf(stderr, "Failed to read pair\n");
+      }
+      break;
+
+    case CMD_HISTORY:
+      if (kvs_history(keys[0], hashes, number, out)) {
+        fprintf(stderr, "Failed to read pair\n");
+      }
+      break;
+
+    case CMD_DELETE:
+      batch.num_commands = 1;
+      batch.num_pairs[0] = batch.total_pairs = num_pairs;
+      extend_batch(reader, &batch, CMD_DELETE);
+      if (kvs_delete_batch(batch.num_commands, batch.num_pairs, keys, hashes,
+                           out, *subs)) {
+        fprintf(stderr, "Failed to delete pair\n");
+      }
+      break;
+
+    case CMD_SHOW:
+      kvs_show(out, max_ranges);
+      break;
+
+    case CMD_WAIT:
+      if (number > 0) {
+        output_str(out, "Waiting...\n");
+        range->start = reader->pos;
+        pool_hold(); // Keeps the pool waiting for the parked range
+        timer_schedule(number, resume_range, range);
+        free(batch.keys);
+        free(batch.hashes);
+        free(batch.values);
+        return 1;
+      }
+      break;
+
+    case CMD_BACKUP:
+      if (create_backup(job->path, job->backups)) {
+        fprintf(stderr, "Failed to perform backup.\n");
+      }
+      job->backups++;
+      break;
+
+    case CMD_LOAD: {
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%.*s", (int)keys[0].len, keys[0].ptr);
+      if (kvs_load(path, max_ranges, *subs)) {
+        fprintf(stderr, "Failed to load %s\n", path);
+      }
+      break;
+    }
+
+    case CMD_EXPORT: {
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%.*s", (int)keys[0].len, keys[0].ptr);
+      if (kvs_export(path, max_ranges)) {
+        fprintf(stderr, "Failed to export %s\n", path);
+      }
+      break;
+    }
+
+    case CMD_SCAN:
+      output_str(out, "[");
+      if (kvs_scan(keys[0], keys[1], number, output_pair, out)) {
+        fprintf(stderr, "Failed to scan pairs\n");
+      }
+      output_str(out, "]\n");
+      break;
+
+    case CMD_PREFIX:
+      output_str(out, "[");
+      if (kvs_prefix(keys[0], 0, output_pair, out)) {
+        fprintf(stderr, "Failed to scan pairs\n");
+      }
+      output_str(out, "]\n");
+      break;
+
+    case CMD_CAS:
+    case CMD_PUTNX: {
+      // Like DELETE, only the pairs that weren't written are output
+      int result =
+          kvs_cas(keys[0], hashes, command == CMD_CAS ? &values[1] : NULL,
+                  values[0], *subs);
+      if (result == -1) {
+        fprintf(stderr, "Failed to write pair\n");
+      } else if (result != 0) {
+        char buf[BUF_SIZE];
+        snprintf(buf, sizeof(buf), "[(%.*s,%s)]\n", (int)keys[0].len,
+                 keys[0].ptr,
+                 result == 2            ? "KVSERROR"
+                 : command == CMD_CAS ? "KVSMISMATCH"
+                                      : "KVSEXISTS");
+        output_str(out, buf);
+      }
+      break;
+    }
+
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_ADD: {
+      int64_t delta;
+      int64_t result = 0;
+      parse_counter(values[0], &delta); // Checked by the parser
+      int status = kvs_add(keys[0], hashes, delta, &result, *subs);
+      if (status == -1) {
+        fprintf(stderr, "Failed to write pair\n");
+        break;
+      }
+      char buf[BUF_SIZE];
+      if (status == 0) {
+        snprintf(buf, sizeof(buf), "[(%.*s,%" PRId64 ")]\n",
+                 (int)keys[0].len, keys[0].ptr, result);
+      } else {
+        snprintf(buf, sizeof(buf), "[(%.*s,KVSNAN)]\n", (int)keys[0].len,
+                 keys[0].ptr);
+      }
+      output_str(out, buf);
+      break;
+    }
+
+    case CMD_MULTI:
+      run_transaction(reader, out);
+      break;
+
+    case CMD_EXEC:
+    case CMD_INVALID:
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      break;
+
+    case CMD_HELP:
+      printf("Available commands:\n"
+             "  WRITE [(key,value),(key2,value2),...]\n"
+             "  READ [key,key2,...] [@<version>]\n"
+             "  READ <key> @<version>\n"
+             "  DELETE [key,key2,...]\n"
+             "  SHOW\n"
+             "  WAIT <delay_ms>\n"
+             "  BACKUP\n"
+             "  LOAD <path>\n"
+             "  EXPORT <path>\n"
+             "  SCAN <start> <end> [limit]\n"
+             "  PREFIX <prefix>\n"
+             "  CAS <key> <expected> <value>\n"
+             "  PUTNX <key> <value>\n"
+             "  INCR <key>\n"
+             "  DECR <key>\n"
+             "  ADD <key> <delta>\n"
+             "  MULTI\n"
+             "  EXEC\n"
+             "  HISTORY <key> [limit]\n"
+             "  HELP\n");
+      break;
+
+    case CMD_EMPTY:
+      break;
+
+    case EOC:
+      free(batch.keys);
+      free(batch.hashes);
+      free(batch.values);
+      return 0;
+    }
+  }
+}
+
+/// Closes the files of a finished job file and releases its resources.
+/// @param job Job file to be finished.
+static void finish_job(FileJob *job) {
+  close_reader(&job->reader);
+  if (close(job->jobs_fd) == -1) {
+    fprintf(stderr, "Failed to close .jobs file\n");
+  }
+  if (close(job->out_fd) == -1) {
+    fprintf(stderr, "Failed to close .out file\n");
+  }
+  pthread_mutex_destroy(&job->lock);
+  for (size_t i = 0; i < job->num_ranges; i++) {
+    free(job->ranges[i].successors);
+  }
+  free(job->ranges);
+  free(job->path);
+  free(job);
+}
+
+/// Runs a range of commands, then writes the output of every finished range
+/// whose preceding ranges were already written and starts the ranges that
+/// were only waiting for this one.
+/// @param arg Range to be run.
+static void run_range(void *arg) {
+  JobRange *range = (JobRange *)arg;
+  FileJob *job = range->job;
+
+  JobReader reader = job->reader;
+  reader.pos = range->start;
+  reader.len = range->end;
+  if (run_commands(range, &reader)) {
+    return; // Parked until its WAIT is over
+  }
+
+  safe_mutex_lock(&job->lock);
+  range->done = 1;
+  while (job->next_flush < job->num_ranges &&
+         job->ranges[job->next_flush].done) {
+    if (output_flush(&job->ranges[job->next_flush].out, job->out_fd)) {
+      fprintf(stderr, "Failed to write to .out file\n");
+    }
+    free_output(&job->ranges[job->next_flush].out);
+    job->next_flush++;
+  }
+  for (size_t i = 0; i < range->num_successors; i++) {
+    JobRange *successor = &job->ranges[range->successors[i]];
+    if (--successor->deps == 0) {
+      pool_submit(run_range, successor);
+    }
+  }
+  int last = --job->remaining == 0;
+  safe_mutex_unlock(&job->lock);
+
+  if (last) {
+    finish_job(job);
+  }
+}
+
+/// Opens a job file and its .out file, splits it into ranges and runs them,
+/// the first one right away and the others as tasks other workers can steal.
+/// @param arg Path of the job file, owned by the task.
+static void run_file(void *arg) {
+  char *jobs_file_path = (char *)arg;
+
+  int jobs_fd = open(jobs_file_path, O_RDONLY);
+  if (jobs_fd == -1) {
+    fprintf(stderr, "Failed to open .job file\n");
+    free(jobs_file_path);
+    return;
+  }
+
+  char output_file_path[PATH_MAX];
+  snprintf(output_file_path, sizeof(output_file_path), "%.*s.out",
+           (int)(strlen(jobs_file_path) - strlen(job_extension)),
+           jobs_file_path);
+
+  int out_fd = open(output_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    fprintf(stderr, "Failed to create output file\n");
+    close(jobs_fd);
+    free(jobs_file_path);
+    return;
+  }
+
+  FileJob *job = safe_malloc(sizeof(FileJob));
+  job->path = jobs_file_path;
+  job->jobs_fd = jobs_fd;
+  job->out_fd = out_fd;
+  job->backups = 1;
+  pthread_mutex_init(&job->lock, NULL);
+  if (init_reader(&job->reader, jobs_fd)) {
+    fprintf(stderr, "Failed to read .job file\n");
+  }
+  plan_ranges(job);
+
+  // Ranges with dependencies are started by the last range they depend on,
+  // which may finish while the others are still being submitted
+  safe_mutex_lock(&job->lock);
+  for (size_t i = 1; i < job->num_ranges; i++) {
+    if (job->ranges[i].deps == 0) {
+      pool_submit(run_range, &job->ranges[i]);
+    }
+  }
+  safe_mutex_unlock(&job->lock);
+  run_range(&job->ranges[0]);
+}
+
+typedef struct {
+  char *path;
+  off_t size;
+  struct timespec mtime;
+} JobEntry;
+
+static int compare_entries(const void *a, const void *b) {
+  const JobEntry *entry_a = (const JobEntry *)a;
+  const JobEntry *entry_b = (const JobEntry *)b;
+  if (entry_a->size != entry_b->size) {
+    return entry_a->size < entry_b->size ? 1 : -1; // Largest first
+  }
+  return strcmp(entry_a->path, entry_b->path);
+}
+
+static int compare_paths(const void *a, const void *b) {
+  return strcmp(((const JobEntry *)a)->path, ((const JobEntry *)b)->path);
+}
+
+/// Builds the path of a file of the jobs directory if it is a job file.
+/// @param dir_path Path of the jobs directory.
+/// @param name Name of the file.
+/// @param entry Where the size and modification time of the file are stored.
+/// @return Dynamically allocated path, or NULL if it isn't a regular job file.
+static char *job_file_path(const char *dir_path, const char *name,
+                           JobEntry *entry) {
+  size_t name_len = strlen(name);
+  size_t extension_len = strlen(job_extension);
+  if (name_len < extension_len ||
+      strcmp(name + name_len - extension_len, job_extension) != 0) {
+    return NULL;
+  }
+
+  size_t len_path = strlen(dir_path) + 1 + name_len + 1;
+  char *path = safe_malloc(len_path);
+  snprintf(path, len_path, "%s/%s", dir_path, name);
+
+  struct stat st;
+  if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+    free(path);
+    return NULL;
+  }
+  entry->size = st.st_size;
+  entry->mtime = st.st_mtim;
+  return path;
+}
+
+#ifdef __linux__
+
+/// Starts watching the jobs directory for .job files being written or moved
+/// into it.
+/// @param dir_path Path of the jobs directory.
+/// @return File descriptor of the watch, -1 on error.
+static int watch_jobs(const char *dir_path) {
+  int watch_fd = inotify_init1(IN_CLOEXEC);
+  if (watch_fd == -1) {
+    perror("Failed to start watching the jobs directory");
+    return -1;
+  }
+  if (inotify_add_watch(watch_fd, dir_path, IN_CLOSE_WRITE | IN_MOVED_TO) ==
+      -1) {
+    perror("Failed to watch the jobs directory");
+    close(watch_fd);
+    return -1;
+  }
+  return watch_fd;
+}
+
+/// Submits every .job file closed after being written, or moved into the jobs
+/// directory, to the pool, for as long as the server runs. Events of files
+/// the scan already submitted, unchanged since, are skipped.
+/// @param watch_fd File descriptor of the watch.
+/// @param dir_path Path of the jobs directory.
+/// @param scanned Files submitted by the scan, sorted by path.
+/// @param num_scanned Number of files submitted by the scan.
+static void stream_jobs(int watch_fd, const char *dir_path,
+                        const JobEntry *scanned, size_t num_scanned) {
+  _Alignas(struct inotify_event) char buf[4096];
+
+  while (1) {
+    ssize_t len = read(watch_fd, buf, sizeof(buf));
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      perror("Failed to read jobs directory events");
+      return;
+    }
+
+    for (char *ptr = buf; ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event *)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "Too many new job files, some were skipped\n");
+      }
+      if (event->len == 0) {
+        continue;
+      }
+      JobEntry entry;
+      entry.path = job_file_path(dir_path, event->name, &entry);
+      if (entry.path == NULL) {
+        continue;
+      }
+      const JobEntry *seen = num_scanned == 0
+                                 ? NULL
+                                 : bsearch(&entry, scanned, num_scanned,
+                                           sizeof(JobEntry), compare_paths);
+      if (seen != NULL && seen->size == entry.size &&
+          seen->mtime.tv_sec == entry.mtime.tv_sec &&
+          seen->mtime.tv_nsec == entry.mtime.tv_nsec) {
+        free(entry.path);
+        continue;
+      }
+      pool_submit(run_file, entry.path);
+    }
+  }
+}
+
+#else
+
+static int watch_jobs(const char *dir_path) {
+  (void)dir_path;
+  fprintf(stderr, "Streaming mode needs inotify, only available on Linux\n");
+  return -1;
+}
+
+static void stream_jobs(int watch_fd, const char *dir_path,
+                        const JobEntry *scanned, size_t num_scanned) {
+  (void)watch_fd;
+  (void)dir_path;
+  (void)scanned;
+  (void)num_scanned;
+}
+
+#endif
+
+/*-----------------------------JOBS FUNCTIONS--------------------------------*/
+
+int jobs_run(DIR *dir, const char *dir_path, const JobsOptions *options,
+             SubscriptionList **sub_list) {
+  int num_threads = options->num_threads;
+  subs = sub_list;
+  max_ranges = num_threads;
+  parallel_commands = options->parallel_commands;
+  batch_size = options->batch_size;
+  compiled_jobs = options->compiled;
+  job_extension = compiled_jobs ? BINJOB_EXTENSION : ".job";
+
+  // Watching starts before the scan, so a file written in between is both
+  // scanned and reported; stream_jobs skips the report if it didn't change
+  int watch_fd = -1;
+  if (options->streaming && (watch_fd = watch_jobs(dir_path)) == -1) {
+    return 1;
+  }
+
+  JobEntry *entries = NULL;
+  size_t num_entries = 0;
+  size_t entries_cap = 0;
+  struct dirent *dp;
+  while ((dp = readdir(dir)) != NULL) {
+    JobEntry entry;
+    entry.path = job_file_path(dir_path, dp->d_name, &entry);
+    if (entry.path == NULL) {
+      continue;
+    }
+    if (grow_append((void **)&entries, &num_entries, &entries_cap, &entry,
+                    sizeof(JobEntry))) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(1);
+    }
+  }
+
+  // Largest files first, so the longest jobs don't start last
+  if (num_entries > 0) {
+    qsort(entries, num_entries, sizeof(JobEntry), compare_entries);
+  }
+
+  if (pool_start(num_threads)) {
+    for (size_t i = 0; i < num_entries; i++) {
+      free(entries[i].path);
+    }
+    free(entries);
+    if (watch_fd != -1) {
+      close(watch_fd);
+    }
+    return 1;
+  }
+  // The pool frees the paths it runs, the watch keeps copies to compare
+  JobEntry *scanned = NULL;
+  if (watch_fd != -1 && num_entries > 0) {
+    scanned = safe_malloc(num_entries * sizeof(JobEntry));
+    for (size_t i = 0; i < num_entries; i++) {
+      scanned[i] = entries[i];
+      scanned[i].path = safe_malloc(strlen(entries[i].path) + 1);
+      strcpy(scanned[i].path, entries[i].path);
+    }
+    qsort(scanned, num_entries, sizeof(JobEntry), compare_paths);
+  }
+  for (size_t i = 0; i < num_entries; i++) {
+    pool_submit(run_file, entries[i].path);
+  }
+  free(entries);
+
+  if (watch_fd != -1) {
+    // Only returns if watching fails
+    stream_jobs(watch_fd, dir_path, scanned, num_entries);
+    close(watch_fd);
+    for (size_t i = 0; scanned != NULL && i < num_entries; i++) {
+      free(scanned[i].path);
+    }
+    free(scanned);
+  }
+
+  pool_wait();
+  pool_stop();
+  return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef KVS_JOBS_H
+#define KVS_JOBS_H
+
+#include <dirent.h>
+
+#include "kvs.h"
+
+/// Options of the job executor.
+typedef struct {
+  int num_threads;       // Number of threads running the jobs
+  int parallel_commands; // Set to run the commands of each file in parallel
+  size_t batch_size;     // Adjacent WRITEs or DELETEs run as one, at most
+                         // JOB_MAX_BATCH_SIZE
+  int streaming;         // Set to keep running .job files added later
+  int compiled;          // Set to run compiled .jobc files instead of .job
+} JobsOptions;
+
+/// Runs every .job file of a directory on a work-stealing pool and waits for
+/// all of them to finish. The directory is scanned up front and the files are
+/// scheduled largest first. Large files are split into ranges of commands that
+/// share no keys, which run in parallel while their output is still written
+/// to the .out file in the order of the commands. With parallel_commands set,
+/// every command of a file runs as soon as the earlier commands sharing its
+/// keys are done, with SHOW, WAIT and BACKUP waiting for every command before
+/// them and holding back every command after them. With streaming set, the
+/// directory is watched and every .job file written or moved into it is run
+/// too, so the call only returns if watching fails. With compiled set, the
+/// files run are the ones produced by jobc instead. The timer thread must be
+/// running, since WAIT parks its job on it.
+/// @param dir Opened jobs directory.
+/// @param dir_path Path of the jobs directory.
+/// @param options Options of the job executor.
+/// @param sub_list Pointer to the current subscription list, which may be
+///                 replaced while the jobs run.
+/// @return 0 if the jobs were run, 1 if they couldn't be started.
+int jobs_run(DIR *dir, const char *dir_path, const JobsOptions *options,
+             SubscriptionList **sub_list);
+
+#endif // KVS_JOBS_H
@@ -0,0 +1,81 @@
+#include <ctype.h>
+
+#include "keys.h"
+
+/*-----------------------------KEY FUNCTIONS---------------------------------*/
+
+int hash(const char *key) {
+  int firstLetter = tolower(key[0]);
+  if (firstLetter >= 'a' && firstLetter <= 'z') {
+    return firstLetter - 'a';
+  } else if (firstLetter >= '0' && firstLetter <= '9') {
+    return firstLetter - '0';
+  }
+  return -1; // Invalid index for non-alphabetic or number strings
+}
+
+uint64_t hash_key(Slice key) {
+  // FNV-1a, then the finalizer of splitmix64 to spread it over every bit
+  uint64_t h = 14695981039346656037u;
+  for (size_t i = 0; i < key.len; i++) {
+    h = (h ^ (unsigned char)key.ptr[i]) * 1099511628211u;
+  }
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9u;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBu;
+  return h ^ (h >> 31);
+}
+
+int parse_counter(Slice text, int64_t *value) {
+  size_t i = 0;
+  int negative = 0;
+  if (text.len > 0 && (text.ptr[0] == '-' || text.ptr[0] == '+')) {
+    negative = text.ptr[0] == '-';
+    i++;
+  }
+  if (i == text.len) {
+    return 1;
+  }
+
+  uint64_t magnitude = 0;
+  for (; i < text.len; i++) {
+    if (text.ptr[i] < '0' || text.ptr[i] > '9') {
+      return 1;
+    }
+    uint64_t digit = (uint64_t)(text.ptr[i] - '0');
+    if (magnitude > (UINT64_MAX - digit) / 10) {
+      return 1;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+
+  if (magnitude > (uint64_t)INT64_MAX + (negative ? 1 : 0)) {
+    return 1;
+  }
+  // Negated one less, so INT64_MIN doesn't overflow
+  *value = !negative     ? (int64_t)magnitude
+           : magnitude == 0 ? 0
+                            : -(int64_t)(magnitude - 1) - 1;
+  return 0;
+}
+
+int parse_version(Slice text, uint64_t *version) {
+  if (text.len == 0) {
+    return 1;
+  }
+  uint64_t parsed = 0;
+  for (size_t i = 0; i < text.len; i++) {
+    if (text.ptr[i] < '0' || text.ptr[i] > '9') {
+      return 1;
+    }
+    uint64_t digit = (uint64_t)(text.ptr[i] - '0');
+    if (parsed > (UINT64_MAX - digit) / 10) {
+      return 1;
+    }
+    parsed = parsed * 10 + digit;
+  }
+  if (parsed == 0) {
+    return 1;
+  }
+  *version = parsed;
+  return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef KVS_KEYS_H
+#define KVS_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TABLE_SIZE 26
+
+/// Non-owning view of a string that isn't necessarily null-terminated.
+typedef struct Slice {
+  const char *ptr;
+  size_t len;
+} Slice;
+
+// Hash function based on key initial.
+// @param key Lowercase alphabetical string.
+// @return hash.
+// NOTE: This is not an ideal hash function, but is useful for test purposes of
+// the project
+int hash(const char *key);
+
+/// Hashes every byte of a key into 64 well mixed bits. A key is hashed once
+/// per request, then its hash picks its Bloom filter counters and rules out
+/// most other keys of a bucket or a subscription list without comparing them.
+/// @param key Key to be hashed.
+/// @return Hash of the key.
+uint64_t hash_key(Slice key);
+
+/// Parses a counter: an optional sign followed by decimal digits, which must
+/// fit in 64 bits.
+/// @param text Text to be parsed.
+/// @param value Where the counter is stored.
+/// @return 0 on success, 1 if the text isn't a counter.
+int parse_counter(Slice text, int64_t *value);
+
+/// Parses a version: decimal digits, which must fit in 64 bits and not be 0.
+/// @param text Text to be parsed.
+/// @param version Where the version is stored.
+/// @return 0 on success, 1 if the text isn't a version.
+int parse_version(Slice text, uint64_t *version);
+
+#endif // KVS_KEYS_H
@@ -1,22 +1,272 @@
-#include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bloom.h"
+#include "cdc.h"
 #include "kvs.h"
 #include "operations.h"
+#include "skiplist.h"
 #include "src/common/io.h"
+#include "src/common/protocol.h"
 #include "string.h"
 
 /*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
 
-int hash(const char *key) {
-  int firstLetter = tolower(key[0]);
-  if (firstLetter >= 'a' && firstLetter <= 'z') {
-    return firstLetter - 'a';
-  } else if (firstLetter >= '0' && firstLetter <= '9') {
-    return firstLetter - '0';
+/// Checks if a node holds the given key.
+/// Keys with another hash or length are told apart without reading the
+/// node's key.
+/// @param node Node to be checked.
+/// @param key Key to compare against.
+/// @param key_hash Hash of the key.
+/// @return 1 if the node holds the key, 0 otherwise.
+static int key_matches(const KeyNode *node, Slice key, uint64_t key_hash) {
+  return node->key_hash == key_hash && node->key_len == key.len &&
+         memcmp(node->key, key.ptr, key.len) == 0;
+}
+
+/// Notifies the subscribers of a key that its value was updated.
+/// @param sub_list Subscription list to search for the key.
+/// @param keyNode Node holding the key and its new value.
+static void notify_update(SubscriptionList *sub_list, const KeyNode *keyNode) {
+  safe_rdlock(&sub_list->subs_lock);
+  Subscription *current = sub_list->head;
+  while (current != NULL) {
+    if (current->key_hash == keyNode->key_hash &&
+        strcmp(current->key, keyNode->key) == 0) {
+      int notif_fd;
+      for (int i = 0; i < current->subscriber_count; i++) {
+        notif_fd = current->subscribers[i];
+        // Send a notification to all subscribers
+        write_notification(notif_fd, keyNode->key, keyNode->value, 1,
+                           keyNode->change_seq);
+      }
+    }
+    current = current->next;
+  }
+  safe_rdwrunlock(&sub_list->subs_lock);
+}
+
+/// Gets the bytes a pair takes, as counted in the memory used by a table.
+/// @param key_len Length of the key.
+/// @param value_len Length of the value.
+/// @return Bytes of the node, the key and the value.
+static size_t pair_size(size_t key_len, size_t value_len) {
+  return sizeof(KeyNode) + key_len + value_len + 2;
+}
+
+/// Allocates a node that isn't linked to any list or counted in any table yet.
+/// @return Newly created node, NULL if memory couldn't be allocated.
+static KeyNode *alloc_node(Slice key, uint64_t key_hash, Slice value,
+                           uint64_t ttl_id) {
+  KeyNode *keyNode = malloc(sizeof(KeyNode));
+  if (keyNode == NULL) {
+    return NULL;
+  }
+  keyNode->key = strndup(key.ptr, key.len);
+  keyNode->value = strndup(value.ptr, value.len);
+  if (keyNode->key == NULL || keyNode->value == NULL) {
+    free(keyNode->key);
+    free(keyNode->value);
+    free(keyNode);
+    return NULL;
   }
-  return -1; // Invalid index for non-alphabetic or number strings
+  keyNode->key_hash = key_hash;
+  keyNode->key_len = key.len;
+  keyNode->version = 0;
+  keyNode->change_seq = 0;
+  keyNode->history = NULL;
+  keyNode->ttl_id = ttl_id;
+  atomic_init(&keyNode->referenced, 1);
+  return keyNode;
+}
+
+/// Appends a change of a node to the table's feed, if it has one.
+/// @param kind CDC_OP_INSERT, CDC_OP_UPDATE or CDC_OP_DELETE.
+/// @return Sequence number of the change, 0 without a feed.
+static uint64_t record_change(HashTable *ht, char kind,
+                              const KeyNode *keyNode) {
+  if (ht->feed == NULL) {
+    return 0;
+  }
+  return cdc_append(ht->feed, kind, keyNode->key, keyNode->value);
+}
+
+/// Gets the version for a new value of the table.
+static uint64_t next_version(HashTable *ht) {
+  return atomic_fetch_add(&ht->last_version, 1) + 1;
+}
+
+/// Gets the bytes a history with the given number of slots takes, without
+/// the values it keeps.
+static size_t history_size(size_t cap) {
+  return sizeof(History) + cap * sizeof(HistoryEntry);
+}
+
+/// Allocates the history of a node before it keeps its first value, if the
+/// table keeps older values.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int reserve_history(HashTable *ht, KeyNode *keyNode) {
+  if (ht->history_len == 0 || keyNode->history != NULL) {
+    return 0;
+  }
+  History *history = malloc(history_size(ht->history_len));
+  if (history == NULL) {
+    return 1;
+  }
+  history->cap = ht->history_len;
+  history->start = 0;
+  history->count = 0;
+  atomic_fetch_add(&ht->memory_used, history_size(history->cap));
+  keyNode->history = history;
+  return 0;
+}
+
+/// Frees the history of a node, subtracting its memory from the table's.
+static void free_history(HashTable *ht, KeyNode *keyNode) {
+  History *history = keyNode->history;
+  if (history == NULL) {
+    return;
+  }
+  size_t bytes = history_size(history->cap);
+  for (size_t i = 0; i < history->count; i++) {
+    char *value = history->slots[(history->start + i) % history->cap].value;
+    bytes += strlen(value) + 1;
+    free(value);
+  }
+  atomic_fetch_sub(&ht->memory_used, bytes);
+  free(history);
+  keyNode->history = NULL;
+}
+
+/// Gives a node a new value and version. The old value is kept in the
+/// node's history if it has one, dropping the oldest value when it is full,
+/// otherwise it is freed.
+/// @param new_value Value allocated for the node, owned by it from now on.
+static void set_value(HashTable *ht, KeyNode *keyNode, char *new_value) {
+  History *history = keyNode->history;
+  size_t old_len = strlen(keyNode->value);
+  if (history == NULL) {
+    atomic_fetch_sub(&ht->memory_used, old_len);
+    free(keyNode->value);
+  } else {
+    size_t slot;
+    if (history->count == history->cap) {
+      slot = history->start;
+      atomic_fetch_sub(&ht->memory_used,
+                       strlen(history->slots[slot].value) + 1);
+      free(history->slots[slot].value);
+      history->start = (history->start + 1) % history->cap;
+    } else {
+      slot = (history->start + history->count++) % history->cap;
+    }
+    history->slots[slot].version = keyNode->version;
+    history->slots[slot].value = keyNode->value;
+    atomic_fetch_add(&ht->memory_used, 1); // Its length was counted already
+  }
+  atomic_fetch_add(&ht->memory_used, strlen(new_value));
+  keyNode->value = new_value;
+  keyNode->version = next_version(ht);
+  atomic_store(&keyNode->referenced, 1);
+  keyNode->change_seq = record_change(ht, CDC_OP_UPDATE, keyNode);
+}
+
+/// Links a new node at the start of its bucket and into the index, counting
+/// its memory and adding its key to the filter.
+/// @param index Bucket of the node's key.
+static void link_node(HashTable *ht, int index, KeyNode *keyNode) {
+  atomic_fetch_add(&ht->memory_used,
+                   pair_size(keyNode->key_len, strlen(keyNode->value)));
+  keyNode->version = next_version(ht);
+  if (ht->filter != NULL) {
+    bloom_add(ht->filter, keyNode->key_hash);
+  }
+  keyNode->next = ht->table[index].head; // Link to existing nodes
+  ht->table[index].head =
+      keyNode; // Place new key node at the start of the list
+  if (ht->index != NULL) {
+    skiplist_insert(ht->index, keyNode);
+  }
+  keyNode->change_seq = record_change(ht, CDC_OP_INSERT, keyNode);
+}
+
+/// Replaces the value of a node, as set_value does.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int replace_value(HashTable *ht, KeyNode *keyNode, Slice value) {
+  char *new_value = strndup(value.ptr, value.len);
+  if (new_value == NULL || reserve_history(ht, keyNode)) {
+    free(new_value);
+    return 1;
+  }
+  set_value(ht, keyNode, new_value);
+  return 0;
+}
+
+/// Creates a node for a key that isn't in its bucket and links it at the
+/// start of the bucket and into the index.
+/// @param index Bucket of the key.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int insert_node(HashTable *ht, int index, Slice key, uint64_t key_hash,
+                       Slice value, uint64_t ttl_id) {
+  KeyNode *keyNode = alloc_node(key, key_hash, value, ttl_id);
+  if (keyNode == NULL) {
+    return 1; // The store keeps running without the pair
+  }
+  link_node(ht, index, keyNode);
+  return 0;
+}
+
+/// Unlinks a node from its bucket, the index and the filter, notifies the
+/// subscribers of its key and frees it.
+/// @param sub_list Subscription list to notify, NULL to skip notifications.
+/// @param list Bucket holding the node.
+/// @param link Pointer to the node, in the bucket's list.
+/// @return Feed sequence number of the deletion, 0 without a feed.
+static uint64_t remove_node(HashTable *ht, SubscriptionList *sub_list,
+                            List *list, KeyNode **link) {
+  KeyNode *keyNode = *link;
+  *link = keyNode->next;
+  if (list->clock_prev == keyNode) {
+    // The hand moves back to the node before, the one link belongs to
+    list->clock_prev = link == &list->head
+                           ? NULL
+                           : (KeyNode *)((char *)link -
+                                         offsetof(KeyNode, next));
+  }
+  if (ht->index != NULL) {
+    skiplist_remove(ht->index, keyNode);
+  }
+  if (ht->filter != NULL) {
+    bloom_remove(ht->filter, keyNode->key_hash);
+  }
+  uint64_t seq = record_change(ht, CDC_OP_DELETE, keyNode);
+  // Send a notification to all subscribers
+  if (sub_list != NULL) {
+    remove_all_subscriptions_from_key(sub_list, keyNode->key,
+                                      keyNode->key_hash, seq);
+  }
+  atomic_fetch_sub(&ht->memory_used,
+                   pair_size(keyNode->key_len, strlen(keyNode->value)));
+  free_history(ht, keyNode);
+  free(keyNode->key);
+  free(keyNode->value);
+  free(keyNode);
+  return seq;
+}
+
+/// Finds the slot of a key in an open addressing index of nodes.
+/// @param index Index with a power of two number of slots, never full.
+/// @param mask Number of slots minus one.
+/// @param key Key to look for.
+/// @param key_hash Hash of the key.
+/// @return Slot holding the key's node, or the empty slot where it belongs.
+static KeyNode **find_slot(KeyNode **index, size_t mask, Slice key,
+                           uint64_t key_hash) {
+  size_t slot = (size_t)key_hash & mask;
+  while (index[slot] != NULL && !key_matches(index[slot], key, key_hash)) {
+    slot = (slot + 1) & mask;
+  }
+  return &index[slot];
 }
 
 void destroy_locks(HashTable *ht, int up_to_index) {
@@ -38,6 +288,7 @@ struct HashTable *create_hash_table() {
   // Initialize each bucket's list and its lock
   for (int i = 0; i < TABLE_SIZE; i++) {
     ht->table[i].head = NULL; // Set the head pointer to NULL
+    ht->table[i].clock_prev = NULL;
 
     if (pthread_rwlock_init(&ht->table[i].list_lock, NULL) != 0) {
       destroy_locks(ht, i);
@@ -52,13 +303,55 @@ struct HashTable *create_hash_table() {
     free(ht);
     return NULL;
   }
+  ht->index = skiplist_create();
+  ht->filter = bloom_create();
+  ht->feed = NULL;
+  atomic_init(&ht->memory_used, 0);
+  ht->memory_budget = 0;
+  ht->history_len = 0;
+  atomic_init(&ht->last_version, 0);
+  ht->clock_hand = 0;
+  pthread_mutex_init(&ht->eviction_lock, NULL);
   return ht; // Successfully created hash table
 }
 
+struct HashTable *copy_table(HashTable *ht) {
+  HashTable *copy = create_hash_table();
+  if (!copy) {
+    return NULL;
+  }
+  // Copies are only walked bucket by bucket, they aren't indexed
+  skiplist_free(copy->index);
+  copy->index = NULL;
+  bloom_free(copy->filter);
+  copy->filter = NULL;
+
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    KeyNode **tail = &copy->table[i].head;
+    for (KeyNode *node = ht->table[i].head; node; node = node->next) {
+      KeyNode *new_node = safe_malloc(sizeof(KeyNode));
+      new_node->key_hash = node->key_hash;
+      new_node->key_len = node->key_len;
+      new_node->key = strdup(node->key);
+      new_node->value = strdup(node->value);
+      new_node->version = node->version;
+      new_node->change_seq = node->change_seq;
+      new_node->history = NULL; // Backups only hold current values
+      new_node->ttl_id = node->ttl_id;
+      atomic_init(&new_node->referenced, 0);
+      new_node->next = NULL;
+      *tail = new_node;
+      tail = &new_node->next;
+    }
+  }
+  return copy;
+}
+
 SubscriptionList *create_subscription_list() {
   SubscriptionList *list = safe_malloc(sizeof(SubscriptionList));
 
   list->head = NULL;
+  pthread_rwlock_init(&list->subs_lock, NULL);
   return list;
 }
 
@@ -66,6 +359,8 @@ ActiveClientsList *create_active_clients_list() {
   ActiveClientsList *list = safe_malloc(sizeof(ActiveClientsList));
 
   list->head = NULL;
+  list->active_clients_counter = 0;
+  pthread_mutex_init(&list->active_clients_lock, NULL);
   return list;
 }
 
@@ -93,13 +388,14 @@ void remove_active_client(ActiveClientsList *list, int resp_fd) {
 }
 
 int add_subscription(SubscriptionList *list, const char *key, int notif_fd) {
+  uint64_t key_hash = hash_key((Slice){key, strlen(key)});
   safe_wrlock(&list->subs_lock); // Lock the list for thread safety
 
   Subscription *current = list->head;
 
   // Check if the key already exists in the list
   while (current != NULL) {
-    if (strcmp(current->key, key) == 0) {
+    if (current->key_hash == key_hash && strcmp(current->key, key) == 0) {
       // Key found, check if the subscriber is already there
       int *currentSubs = current->subscribers;
       for (int i = 0; i < current->subscriber_count; i++) {
@@ -116,8 +412,9 @@ int add_subscription(SubscriptionList *list, const char *key, int notif_fd) {
     }
     current = current->next;
   }
-  if (key_exists((char *)key)) {
+  if (key_exists(key, key_hash)) {
     Subscription *new_sub = safe_malloc(sizeof(Subscription));
+    new_sub->key_hash = key_hash;
     new_sub->key = strdup(key);
     if (!new_sub->key) {
       free(new_sub);
@@ -158,19 +455,19 @@ int remove_subscription_from_a_client(Subscription *subscription,
   return 0;
 }
 
-void remove_all_subscriptions_from_key(SubscriptionList *list,
-                                       const char *key) {
+void remove_all_subscriptions_from_key(SubscriptionList *list, const char *key,
+                                       uint64_t key_hash, uint64_t seq) {
   safe_wrlock(&list->subs_lock);
   Subscription *current = list->head;
   Subscription *prev = NULL;
 
   // Traverse the list to find the subscription for the given key
   while (current != NULL) {
-    if (strcmp(current->key, key) == 0) {
+    if (current->key_hash == key_hash && strcmp(current->key, key) == 0) {
       int notif_fd;
       for (int i = 0; i < current->subscriber_count; i++) {
         notif_fd = current->subscribers[i];
-        write_notification(notif_fd, key, NULL, 2);
+        write_notification(notif_fd, key, NULL, 2, seq);
       }
       if (prev == NULL) {
         // The node to be removed is the head of the list
@@ -203,12 +500,13 @@ int remove_all_subscriptions_from_client(SubscriptionList *list, int notif_fd) {
 
 int unsubscribe_from_key(SubscriptionList *list, const char *key,
                          int notif_fd) {
+  uint64_t key_hash = hash_key((Slice){key, strlen(key)});
   safe_wrlock(&list->subs_lock); // Lock the list for thread safety
   Subscription *current = list->head;
 
   // Traverse the list to find the subscription for the given key
   while (current != NULL) {
-    if (strcmp(current->key, key) == 0) {
+    if (current->key_hash == key_hash && strcmp(current->key, key) == 0) {
       // Key found, search for the subscriber
       if (remove_subscription_from_a_client(current, notif_fd) == 1) {
         safe_rdwrunlock(&list->subs_lock);
@@ -225,52 +523,272 @@ int unsubscribe_from_key(SubscriptionList *list, const char *key,
 
 /*-----------------------------KVS FUNCTIONS---------------------------------*/
 
-int write_pair(HashTable *ht, SubscriptionList *sub_list, const char *key,
-               const char *value) {
-  int index = hash(key);
+int write_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+               uint64_t key_hash, Slice value, uint64_t ttl_id) {
+  int index = hash(key.ptr);
+  if (index < 0) {
+    return 1; // No bucket to store the key in
+  }
   KeyNode *keyNode = ht->table[index].head;
   // Search for the key node
 
   while (keyNode != NULL) {
-    if (strcmp(keyNode->key, key) == 0) {
-      free(keyNode->value);
-      keyNode->value = strdup(value);
-      safe_rdlock(&sub_list->subs_lock);
-      Subscription *current = sub_list->head;
-      while (current != NULL) {
-        if (strcmp(current->key, key) == 0) {
-          int notif_fd;
-          for (int i = 0; i < current->subscriber_count; i++) {
-            notif_fd = current->subscribers[i];
-            // Send a notification to all subscribers
-            write_notification(notif_fd, key, value, 1);
-          }
-        }
-        current = current->next;
+    if (key_matches(keyNode, key, key_hash)) {
+      if (replace_value(ht, keyNode, value)) {
+        return 1;
       }
-      safe_rdwrunlock(&sub_list->subs_lock);
+      keyNode->ttl_id = ttl_id;
+      notify_update(sub_list, keyNode);
       return 0;
     }
     keyNode = keyNode->next; // Move to the next node
   }
 
   // Key not found, create a new key node
-  keyNode = safe_malloc(sizeof(KeyNode));
-  keyNode->key = strdup(key);            // Allocate memory for the key
-  keyNode->value = strdup(value);        // Allocate memory for the value
-  keyNode->next = ht->table[index].head; // Link to existing nodes
-  ht->table[index].head =
-      keyNode; // Place new key node at the start of the list
+  return insert_node(ht, index, key, key_hash, value, ttl_id);
+}
+
+int load_bucket(HashTable *ht, SubscriptionList *sub_list, int index,
+                const Slice *keys, const Slice *values, size_t num_pairs) {
+  List *list = &ht->table[index];
+  size_t chain_len = 0;
+  for (KeyNode *node = list->head; node != NULL; node = node->next) {
+    chain_len++;
+  }
+
+  // Sized for every key at once, so the index never grows
+  size_t cap = 16;
+  while (cap < 2 * (chain_len + num_pairs)) {
+    cap *= 2;
+  }
+  KeyNode **nodes = calloc(cap, sizeof(KeyNode *));
+  if (nodes == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+  for (KeyNode *node = list->head; node != NULL; node = node->next) {
+    Slice key = {node->key, node->key_len};
+    *find_slot(nodes, cap - 1, key, node->key_hash) = node;
+  }
+
+  for (size_t i = 0; i < num_pairs; i++) {
+    uint64_t key_hash = hash_key(keys[i]);
+    KeyNode **slot = find_slot(nodes, cap - 1, keys[i], key_hash);
+    if (*slot != NULL) {
+      if (replace_value(ht, *slot, values[i])) {
+        free(nodes);
+        fprintf(stderr, "Failed to allocate memory\n");
+        return 1;
+      }
+      (*slot)->ttl_id = 0;
+      if (sub_list != NULL) {
+        notify_update(sub_list, *slot);
+      }
+      continue;
+    }
+    KeyNode *keyNode = alloc_node(keys[i], key_hash, values[i], 0);
+    if (keyNode == NULL) {
+      free(nodes);
+      fprintf(stderr, "Failed to allocate memory\n");
+      return 1;
+    }
+    link_node(ht, index, keyNode);
+    *slot = keyNode;
+  }
+
+  free(nodes);
   return 0;
 }
 
-char *read_pair(HashTable *ht, const char *key) {
-  int index = hash(key);
+int cas_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+             uint64_t key_hash, const Slice *expected, Slice value) {
+  int index = hash(key.ptr);
+  for (KeyNode *keyNode = ht->table[index].head; keyNode;
+       keyNode = keyNode->next) {
+    if (key_matches(keyNode, key, key_hash)) {
+      if (expected == NULL || strlen(keyNode->value) != expected->len ||
+          memcmp(keyNode->value, expected->ptr, expected->len) != 0) {
+        return 1;
+      }
+      if (replace_value(ht, keyNode, value)) {
+        return -1;
+      }
+      keyNode->ttl_id = 0;
+      notify_update(sub_list, keyNode);
+      return 0;
+    }
+  }
+
+  if (expected != NULL) {
+    return 2;
+  }
+  return insert_node(ht, index, key, key_hash, value, 0) ? -1 : 0;
+}
+
+int add_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+             uint64_t key_hash, int64_t delta, int64_t *result) {
+  int index = hash(key.ptr);
+  char buf[24];
+  for (KeyNode *keyNode = ht->table[index].head; keyNode;
+       keyNode = keyNode->next) {
+    if (!key_matches(keyNode, key, key_hash)) {
+      continue;
+    }
+
+    size_t len = strlen(keyNode->value);
+    int64_t current;
+    if (parse_counter((Slice){keyNode->value, len}, &current) ||
+        (delta > 0 && current > INT64_MAX - delta) ||
+        (delta < 0 && current < INT64_MIN - delta)) {
+      return 1;
+    }
+    *result = current + delta;
+    size_t new_len = (size_t)snprintf(buf, sizeof(buf), "%" PRId64, *result);
+    if (new_len <= len && ht->history_len == 0) {
+      // Most updates fit the memory of the old value, so nothing is allocated
+      memcpy(keyNode->value, buf, new_len + 1);
+      atomic_fetch_sub(&ht->memory_used, len - new_len);
+      keyNode->version = next_version(ht);
+      atomic_store(&keyNode->referenced, 1);
+      keyNode->change_seq = record_change(ht, CDC_OP_UPDATE, keyNode);
+    } else if (replace_value(ht, keyNode, (Slice){buf, new_len})) {
+      return -1;
+    }
+    if (sub_list != NULL) {
+      notify_update(sub_list, keyNode);
+    }
+    return 0;
+  }
+
+  *result = delta;
+  size_t new_len = (size_t)snprintf(buf, sizeof(buf), "%" PRId64, delta);
+  return insert_node(ht, index, key, key_hash, (Slice){buf, new_len}, 0) ? -1
+                                                                        : 0;
+}
+
+void notify_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+                 uint64_t key_hash) {
+  int index = hash(key.ptr);
+  for (KeyNode *keyNode = ht->table[index].head; keyNode;
+       keyNode = keyNode->next) {
+    if (key_matches(keyNode, key, key_hash)) {
+      notify_update(sub_list, keyNode);
+      return;
+    }
+  }
+}
+
+/// Finds the node of a key, marking its pair as used.
+/// @return Node of the key, NULL if it doesn't exist.
+static KeyNode *find_node(HashTable *ht, Slice key, uint64_t key_hash) {
+  for (KeyNode *keyNode = ht->table[hash(key.ptr)].head; keyNode;
+       keyNode = keyNode->next) {
+    if (key_matches(keyNode, key, key_hash)) {
+      atomic_store(&keyNode->referenced, 1);
+      return keyNode;
+    }
+  }
+  return NULL;
+}
+
+const KeyNode *find_pair(HashTable *ht, Slice key, uint64_t key_hash) {
+  return find_node(ht, key, key_hash);
+}
+
+const char *node_version(const KeyNode *node, size_t age, uint64_t *version) {
+  if (age == 0) {
+    *version = node->version;
+    return node->value;
+  }
+  const History *history = node->history;
+  if (history == NULL || age > history->count) {
+    return NULL;
+  }
+  const HistoryEntry *entry =
+      &history->slots[(history->start + history->count - age) % history->cap];
+  *version = entry->version;
+  return entry->value;
+}
+
+int prepare_pair(HashTable *ht, StagedPair *pair) {
+  pair->new_value = NULL;
+  pair->new_node = NULL;
+  pair->changed = 0;
+  pair->seq = 0;
+  if (pair->deleted) {
+    return 0;
+  }
+  KeyNode *keyNode = find_node(ht, pair->key, pair->key_hash);
+  if (keyNode != NULL) {
+    // A history reserved for a change that is discarded stays with the node
+    pair->new_value = strndup(pair->value.ptr, pair->value.len);
+    return pair->new_value == NULL || reserve_history(ht, keyNode);
+  }
+  pair->new_node =
+      alloc_node(pair->key, pair->key_hash, pair->value, pair->ttl_id);
+  return pair->new_node == NULL;
+}
+
+void commit_pair(HashTable *ht, StagedPair *pair) {
+  int index = hash(pair->key.ptr);
+  List *list = &ht->table[index];
+  if (pair->new_node != NULL) {
+    link_node(ht, index, pair->new_node);
+    pair->new_node = NULL;
+    pair->changed = 1;
+    return;
+  }
+
+  for (KeyNode **link = &list->head; *link != NULL; link = &(*link)->next) {
+    KeyNode *keyNode = *link;
+    if (!key_matches(keyNode, pair->key, pair->key_hash)) {
+      continue;
+    }
+    if (pair->deleted) {
+      pair->seq = remove_node(ht, NULL, list, link);
+    } else {
+      set_value(ht, keyNode, pair->new_value);
+      keyNode->ttl_id = pair->ttl_id;
+      pair->new_value = NULL;
+    }
+    pair->changed = 1;
+    return;
+  }
+}
+
+void notify_commit(HashTable *ht, SubscriptionList *sub_list,
+                   const StagedPair *pair) {
+  if (!pair->changed) {
+    return;
+  }
+  if (!pair->deleted) {
+    notify_pair(ht, sub_list, pair->key, pair->key_hash);
+    return;
+  }
+  char key[MAX_STRING_SIZE + 1];
+  snprintf(key, sizeof(key), "%.*s", (int)pair->key.len, pair->key.ptr);
+  remove_all_subscriptions_from_key(sub_list, key, pair->key_hash, pair->seq);
+}
+
+void discard_pair(StagedPair *pair) {
+  free(pair->new_value);
+  if (pair->new_node != NULL) {
+    free(pair->new_node->key);
+    free(pair->new_node->value);
+    free(pair->new_node);
+  }
+  pair->new_value = NULL;
+  pair->new_node = NULL;
+}
+
+char *read_pair(HashTable *ht, Slice key, uint64_t key_hash) {
+  int index = hash(key.ptr);
   KeyNode *keyNode = ht->table[index].head;
   char *value;
 
   while (keyNode != NULL) {
-    if (strcmp(keyNode->key, key) == 0) {
+    if (key_matches(keyNode, key, key_hash)) {
+      atomic_store(&keyNode->referenced, 1);
       value = strdup(keyNode->value);
       return value; // Return copy of the value if found
     }
@@ -279,50 +797,71 @@ char *read_pair(HashTable *ht, const char *key) {
   return NULL; // Key not found
 }
 
-int delete_pair(HashTable *ht, SubscriptionList *sub_list, const char *key) {
-  int index = hash(key);
-  List *list = &ht->table[index];
-  KeyNode *keyNode = list->head;
-  KeyNode *prevNode = NULL;
+int delete_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+                uint64_t key_hash) {
+  List *list = &ht->table[hash(key.ptr)];
+  KeyNode **link = &list->head;
 
-  while (keyNode != NULL) {
-    if (strcmp(keyNode->key, key) == 0) {
-      if (prevNode == NULL) {
-        // Node to delete is the first node in the list
-        ht->table[index].head =
-            keyNode->next; // Update the table to point to the next node
-      } else {
-        // Node to delete is not the first; bypass it
-        prevNode->next =
-            keyNode->next; // Link the previous node to the next node
-      }
-
-      free(keyNode->key);
-      free(keyNode->value);
-      free(keyNode);
-      // Send a notification to all subscribers
-      remove_all_subscriptions_from_key(sub_list, key);
+  while (*link != NULL) {
+    if (key_matches(*link, key, key_hash)) {
+      remove_node(ht, sub_list, list, link);
       return 0;
     }
-    prevNode = keyNode;      // Move prevNode to current node
-    keyNode = keyNode->next; // Move to the next node
+    link = &(*link)->next; // Move to the next node
   }
 
   return 1;
 }
 
+int expire_pair(HashTable *ht, SubscriptionList *sub_list, Slice key,
+                uint64_t key_hash, uint64_t ttl_id) {
+  int index = hash(key.ptr);
+  for (KeyNode *node = ht->table[index].head; node; node = node->next) {
+    if (key_matches(node, key, key_hash)) {
+      return node->ttl_id == ttl_id
+                 ? delete_pair(ht, sub_list, key, key_hash)
+                 : 1;
+    }
+  }
+  return 1;
+}
+
+int evict_bucket(HashTable *ht, SubscriptionList *sub_list, int index) {
+  List *list = &ht->table[index];
+  KeyNode **link = list->clock_prev ? &list->clock_prev->next : &list->head;
+  while (*link != NULL) {
+    if (atomic_load(&ht->memory_used) <= ht->memory_budget) {
+      return 0;
+    }
+    if (atomic_exchange(&(*link)->referenced, 0)) {
+      // Used since the hand last passed it, kept this time
+      list->clock_prev = *link;
+      link = &(*link)->next;
+    } else {
+      remove_node(ht, sub_list, list, link);
+    }
+  }
+  list->clock_prev = NULL;
+  return 1;
+}
+
 void free_table(HashTable *ht) {
   for (int i = 0; i < TABLE_SIZE; i++) {
     KeyNode *keyNode = ht->table[i].head;
     while (keyNode != NULL) {
       KeyNode *temp = keyNode;
       keyNode = keyNode->next;
+      free_history(ht, temp);
       free(temp->key);
       free(temp->value);
       free(temp);
     }
     ht->table[i].head = NULL;
   }
+  skiplist_free(ht->index);
+  bloom_free(ht->filter);
+  cdc_free(ht->feed);
+  pthread_mutex_destroy(&ht->eviction_lock);
   destroy_locks(ht, TABLE_SIZE);
   pthread_rwlock_destroy(&ht->global_lock);
   free(ht);
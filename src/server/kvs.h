@@ -1,31 +1,79 @@
 #ifndef KEY_VALUE_STORE_H
 #define KEY_VALUE_STORE_H
 
-#define TABLE_SIZE 26
-
 #include "constants.h"
+#include "keys.h"
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /*---------------------------------STRUCTS-----------------------------------*/
 
+/// Value a key held before a newer one replaced it.
+typedef struct HistoryEntry {
+  uint64_t version;
+  char *value;
+} HistoryEntry;
+
+/// Ring of the values a key held before its current one, kept when the table
+/// has a history length. The oldest one is dropped to make room for another.
+typedef struct History {
+  size_t cap;   // Number of slots
+  size_t start; // Slot of the oldest value
+  size_t count; // Values kept
+  HistoryEntry slots[];
+} History;
+
 typedef struct KeyNode {
+  uint64_t key_hash; // hash_key of the key, compared before the key itself
+  size_t key_len;
   char *key;
   char *value;
+  uint64_t version; // Version of the value, newer than any it replaced
+  uint64_t change_seq; // Feed sequence number of its last change, 0 if none
+  History *history; // Older values, NULL until the first one is kept
+  uint64_t ttl_id; // TTL whose expiry deletes the pair, 0 if it never expires
+  atomic_bool referenced; // Set when the pair is used, cleared by evictions
   struct KeyNode *next;
 } KeyNode;
 
 typedef struct List {
   KeyNode *head;
+  KeyNode *clock_prev; // Evictions go on after this node, NULL for the head
   pthread_rwlock_t list_lock;
 } List;
 
 typedef struct HashTable {
   List table[TABLE_SIZE];
   pthread_rwlock_t global_lock;
+  struct SkipList *index; // Every node in key order, NULL in copies
+  struct Bloom *filter;    // Every key of the table, NULL in copies
+  struct Cdc *feed;        // Every change of the table, NULL if none
+  atomic_size_t memory_used; // Bytes of every node, key, value and history
+  size_t memory_budget;      // Limit kept by evicting pairs, 0 for none
+  size_t history_len;        // Older values kept per key, 0 for none
+  atomic_uint_least64_t last_version; // Version given to the last value
+  int clock_hand;            // Bucket evictions are sweeping
+  pthread_mutex_t eviction_lock;
 } HashTable;
 
+/// Change a transaction makes to a key. Its memory is allocated by
+/// prepare_pair before the table is modified, so commit_pair can't fail.
+typedef struct StagedPair {
+  Slice key;
+  uint64_t key_hash;
+  Slice value;       // Value written, unused if the key is deleted
+  int deleted;       // Set if the last change to the key deletes it
+  uint64_t ttl_id;   // TTL of the value written, 0 if it never expires
+  char *new_value;   // Copy of the value, for a key in the table
+  KeyNode *new_node; // Node of a key that isn't in the table yet
+  int changed;       // Set by commit_pair if the table was modified
+  uint64_t seq;      // Feed sequence number of the change, set by commit_pair
+} StagedPair;
+
 typedef struct Subscription {
+  uint64_t key_hash; // hash_key of the key
   char *key;
   int subscribers[10 * S];
   int subscriber_count;
@@ -52,13 +100,6 @@ typedef struct ActiveClientsList {
 
 /*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
 
-// Hash function based on key initial.
-// @param key Lowercase alphabetical string.
-// @return hash.
-// NOTE: This is not an ideal hash function, but is useful for test purposes of
-// the project
-int hash(const char *key);
-
 /// Destroys the locks associated with the hash table up to the given index.
 /// @param ht Pointer to the hash table whose locks will be destroyed.
 /// @param up_to_index The index up to which the locks should be destroyed.
@@ -72,6 +113,12 @@ void destroy_locks(HashTable *ht, int up_to_index);
 /// @return Newly created hash table, NULL on failure
 struct HashTable *create_hash_table();
 
+/// Creates a private copy of a hash table, keeping the order of every bucket.
+/// The caller must ensure the table isn't modified while it is copied.
+/// @param ht Hash table to be copied.
+/// @return Newly created copy, NULL on failure.
+struct HashTable *copy_table(HashTable *ht);
+
 /// Creates and initializes a SubscriptionList.
 /// @return Pointer to the newly created SubscriptionList, or NULL on failure.
 SubscriptionList *create_subscription_list();
@@ -110,7 +157,11 @@ int remove_subscription_from_a_client(Subscription *subscription, int notif_fd);
 /// subscription list.
 /// @param list Pointer to the SubscriptionList containing the subscriptions.
 /// @param key Key for which all associated subscriptions will be removed
-void remove_all_subscriptions_from_key(SubscriptionList *list, const char *key);
+/// @param key_hash Hash of the key.
+/// @param seq Feed sequence number of the deletion, sent with the
+///            notifications.
+void remove_all_subscriptions_from_key(SubscriptionList *list, const char *key,
+                                       uint64_t key_hash, uint64_t seq);
 
 /// Removes all subscriptions associated with a specific client from the 
 /// subscription list.
@@ -133,22 +184,141 @@ int unsubscribe_from_key(SubscriptionList *list, const char *key, int notif_fd);
 /// Appends a new key value pair to the hash table.
 /// @param ht Hash table to be modified.
 /// @param key Key of the pair to be written.
+/// @param key_hash Hash of the key.
 /// @param value Value of the pair to be written.
-/// @return 0 if the node was appended successfully, 1 otherwise.
-int write_pair(HashTable *ht, SubscriptionList *list, const char *key,
-               const char *value);
+/// @param ttl_id TTL that will expire the pair, 0 if it never expires. Any
+///               TTL the pair had before is dropped.
+/// @return 0 if the node was appended successfully, 1 otherwise, e.g. if the
+///         key has no bucket.
+int write_pair(HashTable *ht, SubscriptionList *list, Slice key,
+               uint64_t key_hash, Slice value, uint64_t ttl_id);
 
-/// Deletes the value of given key.
+/// Writes many pairs to one bucket, with the same result as giving them to
+/// write_pair in order. Keys are looked up in an index built once for the
+/// bucket instead of walking its list for every pair.
+/// @param ht Hash table to be modified.
+/// @param list Subscription list to notify of overwritten pairs, NULL to
+///             skip notifications.
+/// @param index Bucket of every key.
+/// @param keys Keys of the pairs to be written.
+/// @param values Values of the pairs to be written.
+/// @param num_pairs Number of pairs.
+/// @return 0 if the pairs were written successfully, 1 otherwise.
+int load_bucket(HashTable *ht, SubscriptionList *list, int index,
+                const Slice *keys, const Slice *values, size_t num_pairs);
+
+/// Writes a pair only if the key holds the expected value (compare-and-swap),
+/// or only if the key doesn't exist (put-if-absent). A successful write
+/// drops any TTL and notifies the subscribers as write_pair does.
+/// @param ht Hash table to be modified.
+/// @param key Key of the pair to be written.
+/// @param key_hash Hash of the key.
+/// @param expected Value the key must hold, NULL if it must not exist.
+/// @param value Value to be written.
+/// @return 0 if the pair was written, 1 if the key holds another value or
+///         exists, 2 if the key doesn't exist but was expected to, -1 if
+///         memory couldn't be allocated.
+int cas_pair(HashTable *ht, SubscriptionList *list, Slice key,
+             uint64_t key_hash, const Slice *expected, Slice value);
+
+/// Adds a delta to the counter held by a key, rewriting its decimal value in
+/// place when the new one isn't longer. A missing key counts as 0. The pair
+/// keeps its TTL.
+/// @param ht Hash table to be modified.
+/// @param list Subscription list to notify of the update, NULL to leave the
+///             notification to the caller.
+/// @param key Key of the counter.
+/// @param key_hash Hash of the key.
+/// @param delta Value to be added.
+/// @param result Where the new value of the counter is stored.
+/// @return 0 if the counter was updated, 1 if the value isn't a counter or
+///         the sum doesn't fit in 64 bits, -1 if memory couldn't be
+///         allocated.
+int add_pair(HashTable *ht, SubscriptionList *list, Slice key,
+             uint64_t key_hash, int64_t delta, int64_t *result);
+
+/// Notifies the subscribers of a key of its current value, if it exists.
+/// @param ht Hash table holding the key.
+/// @param list Subscription list to be notified.
+/// @param key Key of the pair.
+/// @param key_hash Hash of the key.
+void notify_pair(HashTable *ht, SubscriptionList *list, Slice key,
+                 uint64_t key_hash);
+
+/// Finds the node of a key, which counts as a use of its pair.
+/// @param ht Hash table to search.
+/// @param key Key to look for.
+/// @param key_hash Hash of the key.
+/// @return Node of the key, NULL if it doesn't exist.
+const KeyNode *find_pair(HashTable *ht, Slice key, uint64_t key_hash);
+
+/// Gets one of the values a node keeps, newest first.
+/// @param node Node of the key.
+/// @param age 0 for the current value, 1 for the one it replaced, and so on.
+/// @param version Where the version of the value is stored.
+/// @return The value, NULL if the node doesn't keep that many.
+const char *node_version(const KeyNode *node, size_t age, uint64_t *version);
+
+/// Allocates the memory a staged change will need, without modifying the
+/// table. The table must not change before the pair is committed.
+/// @param ht Hash table the change will be committed to.
+/// @param pair Staged change, whose key, value, deleted flag and TTL are set.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+int prepare_pair(HashTable *ht, StagedPair *pair);
+
+/// Applies a prepared change, using the memory prepare_pair allocated.
+/// Subscribers aren't notified, so that a transaction can notify them once
+/// every change is committed.
+/// @param ht Hash table to be modified.
+/// @param pair Prepared change.
+void commit_pair(HashTable *ht, StagedPair *pair);
+
+/// Notifies the subscribers of a committed change's key, as write_pair or
+/// delete_pair would have.
+/// @param ht Hash table holding the key.
+/// @param list Subscription list to be notified.
+/// @param pair Committed change.
+void notify_commit(HashTable *ht, SubscriptionList *list,
+                   const StagedPair *pair);
+
+/// Frees the memory of a change that was prepared but won't be committed.
+/// @param pair Prepared change.
+void discard_pair(StagedPair *pair);
+
+/// Reads the value of given key.
+/// @param ht Hash table to read from.
+/// @param key Key of the pair to be read.
+/// @param key_hash Hash of the key.
+/// @return Copy of the value, NULL if the key doesn't exist.
+char *read_pair(HashTable *ht, Slice key, uint64_t key_hash);
+
+/// Deletes the pair of given key.
 /// @param ht Hash table to delete from.
 /// @param key Key of the pair to be deleted.
+/// @param key_hash Hash of the key.
 /// @return 0 if the node was deleted successfully, 1 otherwise.
-char *read_pair(HashTable *ht, const char *key);
+int delete_pair(HashTable *ht, SubscriptionList *list, Slice key,
+                uint64_t key_hash);
+
+/// Deletes the pair of given key if it is still set to expire with the given
+/// TTL, i.e. it wasn't written again since.
+/// @param ht Hash table to delete from.
+/// @param key Key of the pair to be expired.
+/// @param key_hash Hash of the key.
+/// @param ttl_id TTL that expired.
+/// @return 0 if the pair was deleted, 1 otherwise.
+int expire_pair(HashTable *ht, SubscriptionList *list, Slice key,
+                uint64_t key_hash, uint64_t ttl_id);
 
-/// Appends a new node to the list.
-/// @param list Event list to be modified.
-/// @param key Key of the pair to read.
-/// @return 0 if the node was appended successfully, 1 otherwise.
-int delete_pair(HashTable *ht, SubscriptionList *list, const char *key);
+/// Sweeps a bucket like the hand of a CLOCK, from where its last sweep
+/// stopped, deleting pairs until the memory used fits the budget. Pairs used
+/// since the hand last passed them get a second chance instead. Subscribers
+/// of a deleted key are notified as for a DELETE.
+/// @param ht Hash table to evict from.
+/// @param index Bucket to be swept.
+/// @return 1 if the hand reached the end of the bucket, 0 if the memory used
+///         fits the budget first.
+int evict_bucket(HashTable *ht, SubscriptionList *list, int index);
 
 /// Frees the hashtable.
 /// @param ht Hash table to be deleted.
@@ -0,0 +1,208 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "load.h"
+#include "operations.h"
+#include "pool.h"
+
+/// Pairs of one bucket found in a chunk, in the order of their lines.
+typedef struct {
+  Slice *keys;
+  Slice *values;
+  size_t count;
+  size_t cap;
+} BucketPairs;
+
+/// Part of the buffer parsed by one thread.
+typedef struct {
+  const char *start;
+  const char *end;
+  BucketPairs buckets[TABLE_SIZE];
+  size_t malformed; // Lines skipped
+  int failed;
+} LoadChunk;
+
+/// State shared by the threads writing the buckets.
+typedef struct {
+  HashTable *ht;
+  SubscriptionList *sub_list;
+  LoadChunk *chunks;
+  int num_chunks;
+  int next_bucket; // First bucket not taken by a thread yet
+  int failed;
+  pthread_mutex_t lock;
+} LoadState;
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Appends a pair to the pairs of a bucket.
+/// @return 0 on success, 1 if memory couldn't be allocated.
+static int append_pair(BucketPairs *pairs, Slice key, Slice value) {
+  if (pairs->count == pairs->cap) {
+    size_t cap = pairs->cap ? pairs->cap * 2 : 64;
+    Slice *keys = realloc(pairs->keys, cap * sizeof(Slice));
+    if (keys == NULL) {
+      return 1;
+    }
+    pairs->keys = keys;
+    Slice *values = realloc(pairs->values, cap * sizeof(Slice));
+    if (values == NULL) {
+      return 1;
+    }
+    pairs->values = values;
+    pairs->cap = cap;
+  }
+  pairs->keys[pairs->count] = key;
+  pairs->values[pairs->count++] = value;
+  return 0;
+}
+
+/// Parses the "(key, value)" lines of a chunk, grouping them by bucket.
+/// @param arg Chunk to be parsed.
+/// @return NULL.
+static void *parse_chunk(void *arg) {
+  LoadChunk *chunk = arg;
+  const char *line = chunk->start;
+  while (line < chunk->end && !chunk->failed) {
+    const char *newline = memchr(line, '\n', (size_t)(chunk->end - line));
+    const char *line_end = newline ? newline : chunk->end;
+    const char *separator = memchr(line, ',', (size_t)(line_end - line));
+
+    if (line_end - line >= 5 && line[0] == '(' && line_end[-1] == ')' &&
+        separator != NULL && separator > line + 1 && separator[1] == ' ' &&
+        separator - line - 1 < MAX_STRING_SIZE &&
+        line_end - separator - 3 < MAX_STRING_SIZE) {
+      Slice key = {line + 1, (size_t)(separator - line - 1)};
+      Slice value = {separator + 2, (size_t)(line_end - separator - 3)};
+      int index = hash(key.ptr);
+      if (index < 0) {
+        chunk->malformed++;
+      } else if (append_pair(&chunk->buckets[index], key, value)) {
+        chunk->failed = 1;
+      }
+    } else if (line_end > line) {
+      chunk->malformed++;
+    }
+    line = line_end + 1;
+  }
+  return NULL;
+}
+
+/// Writes the pairs of the buckets not taken by other threads yet, joining
+/// the pairs every chunk found for a bucket in the order of the chunks.
+/// @param arg Shared load state.
+/// @return NULL.
+static void *write_buckets(void *arg) {
+  LoadState *state = arg;
+  while (1) {
+    safe_mutex_lock(&state->lock);
+    int index = state->next_bucket++;
+    safe_mutex_unlock(&state->lock);
+    if (index >= TABLE_SIZE) {
+      return NULL;
+    }
+
+    size_t total = 0;
+    for (int c = 0; c < state->num_chunks; c++) {
+      total += state->chunks[c].buckets[index].count;
+    }
+    if (total == 0) {
+      continue;
+    }
+
+    const Slice *keys = state->chunks[0].buckets[index].keys;
+    const Slice *values = state->chunks[0].buckets[index].values;
+    Slice *joined_keys = NULL;
+    Slice *joined_values = NULL;
+    if (total != state->chunks[0].buckets[index].count) {
+      joined_keys = safe_malloc(total * sizeof(Slice));
+      joined_values = safe_malloc(total * sizeof(Slice));
+      size_t count = 0;
+      for (int c = 0; c < state->num_chunks; c++) {
+        BucketPairs *pairs = &state->chunks[c].buckets[index];
+        memcpy(joined_keys + count, pairs->keys, pairs->count * sizeof(Slice));
+        memcpy(joined_values + count, pairs->values,
+               pairs->count * sizeof(Slice));
+        count += pairs->count;
+      }
+      keys = joined_keys;
+      values = joined_values;
+    }
+
+    safe_wrlock(&state->ht->table[index].list_lock);
+    int failed =
+        load_bucket(state->ht, state->sub_list, index, keys, values, total);
+    safe_rdwrunlock(&state->ht->table[index].list_lock);
+
+    free(joined_keys);
+    free(joined_values);
+    if (failed) {
+      safe_mutex_lock(&state->lock);
+      state->failed = 1;
+      safe_mutex_unlock(&state->lock);
+    }
+  }
+}
+
+/*------------------------------LOAD FUNCTIONS-------------------------------*/
+
+int load_pairs(HashTable *ht, SubscriptionList *sub_list, const char *data,
+               size_t len, int num_threads) {
+  // Small buffers aren't worth the threads
+  int num_chunks = (int)(len / LOAD_CHUNK_MIN_SIZE) + 1;
+  if (num_chunks > num_threads) {
+    num_chunks = num_threads > 0 ? num_threads : 1;
+  }
+
+  LoadChunk *chunks = calloc((size_t)num_chunks, sizeof(LoadChunk));
+  if (chunks == NULL) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+  const char *end = data + len;
+  const char *start = data;
+  for (int c = 0; c < num_chunks; c++) {
+    // Every chunk but the last ends after a newline, so no line is split
+    const char *chunk_end = end;
+    const char *target = data + len / (size_t)num_chunks * (size_t)(c + 1);
+    if (c < num_chunks - 1) {
+      const char *newline =
+          target < start ? NULL : memchr(target, '\n', (size_t)(end - target));
+      chunk_end = target < start ? start : newline ? newline + 1 : end;
+    }
+    chunks[c].start = start;
+    chunks[c].end = chunk_end;
+    start = chunk_end;
+  }
+  run_threads(num_chunks, parse_chunk, chunks, sizeof(LoadChunk));
+
+  LoadState state = {ht, sub_list, chunks, num_chunks, 0, 0,
+                     PTHREAD_MUTEX_INITIALIZER};
+  size_t malformed = 0;
+  for (int c = 0; c < num_chunks; c++) {
+    state.failed |= chunks[c].failed;
+    malformed += chunks[c].malformed;
+  }
+  if (state.failed) {
+    fprintf(stderr, "Failed to allocate memory\n");
+  } else {
+    int num_writers = num_threads < TABLE_SIZE ? num_threads : TABLE_SIZE;
+    run_threads(num_writers > 0 ? num_writers : 1, write_buckets, &state, 0);
+  }
+  if (malformed > 0) {
+    fprintf(stderr, "Skipped %zu malformed lines\n", malformed);
+  }
+
+  for (int c = 0; c < num_chunks; c++) {
+    for (int i = 0; i < TABLE_SIZE; i++) {
+      free(chunks[c].buckets[i].keys);
+      free(chunks[c].buckets[i].values);
+    }
+  }
+  free(chunks);
+  pthread_mutex_destroy(&state.lock);
+  return state.failed;
+}
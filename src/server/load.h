@@ -0,0 +1,23 @@
+#ifndef KVS_LOAD_H
+#define KVS_LOAD_H
+
+#include <stddef.h>
+
+#include "kvs.h"
+
+/// Writes the "(key, value)" lines of a buffer to a hash table, with the same
+/// result as writing them one at a time in order. The buffer is split in
+/// chunks parsed by separate threads, then every bucket is written by a
+/// single thread holding its lock once. Malformed lines are skipped.
+/// The caller must hold the table's global lock, but no bucket lock.
+/// @param ht Hash table to be modified.
+/// @param sub_list Subscription list to notify of overwritten pairs, NULL to
+///                 skip notifications.
+/// @param data Lines to be loaded.
+/// @param len Number of bytes in data.
+/// @param num_threads Maximum number of threads to use.
+/// @return 0 if the pairs were loaded successfully, 1 otherwise.
+int load_pairs(HashTable *ht, SubscriptionList *sub_list, const char *data,
+               size_t len, int num_threads);
+
+#endif // KVS_LOAD_H
@@ -0,0 +1,262 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_MAGIC "KVZ1"
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+static uint32_t read32(const unsigned char *ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+static uint32_t load_le32(const unsigned char *ptr) {
+  return (uint32_t)ptr[0] | (uint32_t)ptr[1] << 8 | (uint32_t)ptr[2] << 16 |
+         (uint32_t)ptr[3] << 24;
+}
+
+static void store_le32(unsigned char *ptr, uint32_t value) {
+  ptr[0] = (unsigned char)value;
+  ptr[1] = (unsigned char)(value >> 8);
+  ptr[2] = (unsigned char)(value >> 16);
+  ptr[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t hash_sequence(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/// Writes the extra bytes of a length that didn't fit in a token nibble.
+/// @param op Position to write to.
+/// @param len Remainder of the length, after subtracting 15.
+/// @return Position after the written bytes.
+static unsigned char *put_length(unsigned char *op, size_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (unsigned char)len;
+  return op;
+}
+
+/// Writes one sequence: a token, the literals and, unless it is the last
+/// sequence of the block, the offset and length of the match that follows.
+static unsigned char *put_sequence(unsigned char *op,
+                                   const unsigned char *literals,
+                                   size_t literal_len, size_t offset,
+                                   size_t match_len) {
+  unsigned char *token = op++;
+  *token = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4);
+  if (literal_len >= 15) {
+    op = put_length(op, literal_len - 15);
+  }
+  memcpy(op, literals, literal_len);
+  op += literal_len;
+
+  if (match_len == 0) {
+    return op; // Last sequence only carries literals
+  }
+
+  *op++ = (unsigned char)offset;
+  *op++ = (unsigned char)(offset >> 8);
+  match_len -= LZ_MIN_MATCH;
+  *token |= (unsigned char)(match_len < 15 ? match_len : 15);
+  if (match_len >= 15) {
+    op = put_length(op, match_len - 15);
+  }
+  return op;
+}
+
+/// Compresses a single block with a greedy hash-chained LZ77 pass.
+/// @return Number of bytes written to dst.
+static size_t compress_block(const unsigned char *src, size_t len,
+                             unsigned char *dst) {
+  uint32_t table[1 << LZ_HASH_BITS] = {0}; // Positions in the block plus one
+  const unsigned char *ip = src;
+  const unsigned char *anchor = src;
+  const unsigned char *end = src + len;
+  unsigned char *op = dst;
+
+  while (end - ip >= LZ_MIN_MATCH) {
+    uint32_t sequence = read32(ip);
+    uint32_t h = hash_sequence(sequence);
+    uint32_t candidate = table[h];
+    table[h] = (uint32_t)(ip - src) + 1;
+
+    if (candidate == 0 || read32(src + candidate - 1) != sequence ||
+        (size_t)(ip - (src + candidate - 1)) > LZ_MAX_OFFSET) {
+      ip++;
+      continue;
+    }
+
+    const unsigned char *ref = src + candidate - 1;
+    size_t match_len = LZ_MIN_MATCH;
+    while (ip + match_len < end && ip[match_len] == ref[match_len]) {
+      match_len++;
+    }
+
+    op = put_sequence(op, anchor, (size_t)(ip - anchor), (size_t)(ip - ref),
+                      match_len);
+    ip += match_len;
+    anchor = ip;
+  }
+
+  return (size_t)(put_sequence(op, anchor, (size_t)(end - anchor), 0, 0) - dst);
+}
+
+/// Reads the extra bytes of a length that didn't fit in a token nibble.
+/// @return 0 on success, 1 if the input ended early.
+static int get_length(const unsigned char **ip, const unsigned char *end,
+                      size_t *len) {
+  unsigned char byte;
+  do {
+    if (*ip >= end) {
+      return 1;
+    }
+    byte = *(*ip)++;
+    *len += byte;
+  } while (byte == 255);
+  return 0;
+}
+
+/// Decompresses a single block whose size is known beforehand.
+/// @return 0 on success, 1 if the block is corrupted.
+static int decompress_block(const unsigned char *src, size_t len,
+                            unsigned char *dst, size_t dst_len) {
+  const unsigned char *ip = src;
+  const unsigned char *end = src + len;
+  unsigned char *op = dst;
+  unsigned char *op_end = dst + dst_len;
+
+  while (ip < end) {
+    unsigned char token = *ip++;
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && get_length(&ip, end, &literal_len)) {
+      return 1;
+    }
+    if (literal_len > (size_t)(end - ip) ||
+        literal_len > (size_t)(op_end - op)) {
+      return 1;
+    }
+    memcpy(op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+
+    if (ip == end) {
+      break; // Last sequence
+    }
+
+    if (end - ip < 2) {
+      return 1;
+    }
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    size_t match_len = token & 15;
+    if (match_len == 15 && get_length(&ip, end, &match_len)) {
+      return 1;
+    }
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) ||
+        match_len > (size_t)(op_end - op)) {
+      return 1;
+    }
+
+    // Matches may overlap the bytes they produce
+    const unsigned char *ref = op - offset;
+    for (size_t i = 0; i < match_len; i++) {
+      op[i] = ref[i];
+    }
+    op += match_len;
+  }
+
+  return op != op_end;
+}
+
+/*-----------------------------LZ FUNCTIONS----------------------------------*/
+
+size_t lz_compress_bound(size_t len) {
+  size_t blocks = len / LZ_BLOCK_SIZE + 1;
+  return len + len / 255 + blocks * (LZ_HEADER_SIZE + 16);
+}
+
+size_t lz_compress(const char *src, size_t len, char *dst) {
+  const unsigned char *ip = (const unsigned char *)src;
+  unsigned char *op = (unsigned char *)dst;
+
+  for (size_t done = 0; done < len;) {
+    size_t raw_len = len - done < LZ_BLOCK_SIZE ? len - done : LZ_BLOCK_SIZE;
+    unsigned char *header = op;
+    op += LZ_HEADER_SIZE;
+
+    size_t comp_len = compress_block(ip + done, raw_len, op);
+    if (comp_len >= raw_len) { // Didn't shrink, store it as is
+      memcpy(op, ip + done, raw_len);
+      comp_len = raw_len;
+    }
+
+    memcpy(header, LZ_MAGIC, 4);
+    store_le32(header + 4, (uint32_t)raw_len);
+    store_le32(header + 8, (uint32_t)comp_len);
+    op += comp_len;
+    done += raw_len;
+  }
+  return (size_t)(op - (unsigned char *)dst);
+}
+
+int lz_is_compressed(const char *src, size_t len) {
+  return len >= LZ_HEADER_SIZE && memcmp(src, LZ_MAGIC, 4) == 0;
+}
+
+int lz_decompress(const char *src, size_t len, char **out, size_t *out_len) {
+  const unsigned char *ip = (const unsigned char *)src;
+  const unsigned char *end = ip + len;
+
+  // First pass only validates the headers and sums the block sizes
+  size_t total = 0;
+  for (const unsigned char *p = ip; p < end;) {
+    if (!lz_is_compressed((const char *)p, (size_t)(end - p))) {
+      return 1;
+    }
+    size_t raw_len = load_le32(p + 4);
+    size_t comp_len = load_le32(p + 8);
+    if (raw_len > LZ_BLOCK_SIZE || comp_len > raw_len ||
+        comp_len > (size_t)(end - p) - LZ_HEADER_SIZE) {
+      return 1;
+    }
+    total += raw_len;
+    p += LZ_HEADER_SIZE + comp_len;
+  }
+
+  char *result = malloc(total + 1);
+  if (result == NULL) {
+    return 1;
+  }
+
+  unsigned char *op = (unsigned char *)result;
+  while (ip < end) {
+    size_t raw_len = load_le32(ip + 4);
+    size_t comp_len = load_le32(ip + 8);
+    ip += LZ_HEADER_SIZE;
+    if (comp_len == raw_len) {
+      memcpy(op, ip, raw_len);
+    } else if (decompress_block(ip, comp_len, op, raw_len)) {
+      free(result);
+      return 1;
+    }
+    ip += comp_len;
+    op += raw_len;
+  }
+
+  result[total] = '\0';
+  *out = result;
+  *out_len = total;
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef KVS_LZ_H
+#define KVS_LZ_H
+
+#include <stddef.h>
+
+#define LZ_BLOCK_SIZE (64 * 1024)
+#define LZ_HEADER_SIZE 12
+
+/// Computes the maximum number of bytes that compressing a buffer may take.
+/// @param len Number of bytes to be compressed.
+/// @return Size the destination buffer of lz_compress must have.
+size_t lz_compress_bound(size_t len);
+
+/// Compresses a buffer into a stream of independent blocks. Each block is at
+/// most LZ_BLOCK_SIZE bytes long before compression and is stored as is when
+/// it doesn't shrink, so concatenating streams yields another valid stream.
+/// @param src Buffer to be compressed.
+/// @param len Number of bytes in src.
+/// @param dst Buffer with at least lz_compress_bound(len) bytes.
+/// @return Number of bytes written to dst.
+size_t lz_compress(const char *src, size_t len, char *dst);
+
+/// Checks if a buffer starts with a compressed block.
+/// @param src Buffer to be checked.
+/// @param len Number of bytes in src.
+/// @return 1 if the buffer is compressed, 0 otherwise.
+int lz_is_compressed(const char *src, size_t len);
+
+/// Decompresses a whole stream of blocks.
+/// @param src Compressed stream.
+/// @param len Number of bytes in src.
+/// @param out Pointer where the dynamically allocated result will be stored.
+/// @param out_len Pointer where the size of the result will be stored.
+/// @return 0 if the stream was decompressed successfully, 1 otherwise.
+int lz_decompress(const char *src, size_t len, char **out, size_t *out_len);
+
+#endif // KVS_LZ_H
@@ -1,11 +1,13 @@
 #define _DEFAULT_SOURCE
 
+#include "backup.h"
 #include "constants.h"
+#include "jobs.h"
 #include "operations.h"
-#include "parser.h"
 #include "src/common/constants.h"
 #include "src/common/io.h"
 #include "src/common/protocol.h"
+#include "timer.h"
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -14,10 +16,10 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 /*----------------------------CONSUMER/PRODUCER------------------------------*/
@@ -38,17 +40,14 @@ pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*----------------------------GLOBAL VARIABLES-------------------------------*/
 
-DIR *dir;
 int MAX_PROC;
-int active_child = 0;
-
-typedef struct {
-  char *dir_path;
-} ThreadArgs;
+int compress_backups = 0;
+int parallel_commands = 0;
+size_t batch_size = JOB_BATCH_SIZE;
+int streaming = 0;
+int compiled_jobs = 0;
 
 char pipe_name[MAX_PIPE_PATH_LENGTH];
-pthread_mutex_t dir_lock = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t active_child_mutex = PTHREAD_MUTEX_INITIALIZER;
 SubscriptionList *subs_list = NULL;
 ActiveClientsList *active_clients_list = NULL;
 
@@ -63,236 +62,137 @@ void sig_handler(int signo) {
   }
 }
 
-/*------------------------------FILES THREAD---------------------------------*/
-
-void *thread_operation(void *arg) {
-  /*---------Blocking the signal----------*/
-  sigset_t set;
-  sigemptyset(&set);
-  sigaddset(&set, SIGUSR1);
-  pthread_sigmask(SIG_BLOCK, &set, NULL);
-  /*--------------------------------------*/
-
-  ThreadArgs *args = (ThreadArgs *)arg;
-  char *dir_path = args->dir_path;
-
-  struct dirent *dp;
-  while (1) {
-
-    safe_mutex_lock(&dir_lock);
-    dp = readdir(dir);
-    safe_mutex_unlock(&dir_lock);
-
-    if (dp == NULL) { // If there are no more files to read
-      break;
-    }
-
-    /*--------------------------OPENING .JOB FILE----------------------------*/
-
-    if (dp->d_type == DT_REG && strlen(dp->d_name) > 3 &&
-        strcmp(dp->d_name + strlen(dp->d_name) - 4, ".job") == 0) {
-      int backups = 1;
-
-      size_t len_path = strlen(dir_path) + 1 + strlen(dp->d_name) + 1;
-      char *jobs_file_path = (char *)safe_malloc(len_path);
-      snprintf(jobs_file_path, len_path, "%s/%s", dir_path, dp->d_name);
-
-      int jobs_fd = open(jobs_file_path, O_RDONLY);
-      if (jobs_fd == -1) {
-        fprintf(stderr, "Failed to open .job file\n");
-        free(jobs_file_path);
-        return NULL;
-      }
-      /*JOB FILE OPENED*/
+/*------------------------------SCAN RESPONSES-------------------------------*/
 
-      /*------------------------OPENING .OUT FILE----------------------------*/
-
-      char output_file_path[PATH_MAX];
-      snprintf(output_file_path, sizeof(output_file_path), "%.*sout",
-               (int)(strlen(jobs_file_path) - 3), jobs_file_path);
-
-      int out_fd = open(output_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-      if (out_fd < 0) {
-        fprintf(stderr, "Failed to create output file\n");
-        free(jobs_file_path);
-        return NULL;
-      }
-
-      /*------------------------ANALIZING COMMANDS---------------------------*/
-
-      int should_exit = 0;
-      while (!should_exit) {
-        char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-        char values[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-        unsigned int delay;
-        size_t num_pairs;
-
-        switch (get_next(jobs_fd)) {
-        case CMD_WRITE:
-          num_pairs = parse_write(jobs_fd, keys, values, MAX_WRITE_SIZE,
-                                  MAX_STRING_SIZE);
-          if (num_pairs == 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
-          }
-
-          if (kvs_write(num_pairs, keys, values, subs_list)) {
-            fprintf(stderr, "Failed to write pair\n");
-          }
-          break;
-
-        case CMD_READ:
-          num_pairs =
-              parse_read_delete(jobs_fd, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-          if (num_pairs == 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
-          }
-
-          if (kvs_read(num_pairs, keys, out_fd)) {
-            fprintf(stderr, "Failed to read pair\n");
-          }
-          break;
-
-        case CMD_DELETE:
-          num_pairs =
-              parse_read_delete(jobs_fd, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-          if (num_pairs == 0) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
-          }
-
-          if (kvs_delete(num_pairs, keys, out_fd, subs_list)) {
-            fprintf(stderr, "Failed to delete pair\n");
-          }
-          break;
-
-        case CMD_SHOW:
-          kvs_show(out_fd);
-          break;
-
-        case CMD_WAIT:
-          if (parse_wait(jobs_fd, &delay, NULL) == -1) {
-            fprintf(stderr, "Invalid command. See HELP for usage\n");
-            continue;
-          }
-
-          if (delay > 0) {
-            write_to_file(out_fd, "Waiting...\n");
-            kvs_wait(delay);
-          }
-          break;
+/// Pairs found by a client's SCAN or PREFIX, kept in memory so they are only
+/// written to the client after every bucket lock has been released.
+typedef struct {
+  OutputBuffer pairs;
+  uint32_t count;
+} ScanResponse;
+
+/// Appends a pair to a scan response as a key and a value of MAX_STRING_SIZE
+/// bytes each, padded with '\0'.
+static int add_scan_pair(const KeyNode *node, void *arg) {
+  ScanResponse *response = arg;
+  char pair[2 * MAX_STRING_SIZE] = {0};
+  strncpy(pair, node->key, MAX_STRING_SIZE);
+  strncpy(pair + MAX_STRING_SIZE, node->value, MAX_STRING_SIZE);
+  output_write(&response->pairs, pair, sizeof(pair));
+  response->count++;
+  return 0;
+}
 
-        case CMD_BACKUP:
-          lock_table();
-          /*CHECKING IF MAX LIMIT OF CHILD PROCESS IS REACHED AND WAITING*/
-          safe_mutex_lock(&active_child_mutex);
-          if (active_child == MAX_PROC) {
-            pid_t pid = wait(NULL);
-            if (pid == -1) {
-              fprintf(stderr, "wait failed\n");
-            } else {
-              active_child--; // Decrement active children only if a child
-                              // process exits
-            }
-          }
-          /*WAIT ENDED - CREATING CHILD PROCESS*/
-          pid_t pid = fork();
-          unlock_table();
-
-          if (pid == -1) {
-            fprintf(stderr, "Failed to fork\n");
-            free(jobs_file_path);
-            exit(1);
-          }
-
-          /*-------------------------CHILD PROCESS---------------------------*/
-
-          if (pid == 0) {
-            /*CREATING .BCK FILE*/
-            safe_mutex_unlock(&active_child_mutex);
-            char temp_path[MAX_JOB_FILE_NAME_SIZE];
-            snprintf(temp_path, sizeof(temp_path), "%.*s",
-                     (int)(strlen(jobs_file_path) - 4), jobs_file_path);
-
-            char backup_file_path[PATH_MAX];
-            snprintf(backup_file_path, sizeof(backup_file_path), "%s-%d.bck",
-                     temp_path, backups);
-
-            int bck_fd =
-                open(backup_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (bck_fd < 0) {
-              fprintf(stderr, "Failed to create backup file: %s\n",
-                      backup_file_path);
-              exit(1); // Ensure child exits on error
-            }
-            /*OPENED .BCK FILE*/
-            if (kvs_backup(bck_fd)) { // Performing the backup
-              fprintf(stderr, "Failed to perform backup.\n");
-              if (close(bck_fd) == -1) {
-                fprintf(stderr, "Failed to close .bck file\n");
-                return NULL;
-              }
-              free(jobs_file_path);
-              exit(1);
-            }
-
-            free(jobs_file_path);
-            if (close(bck_fd) == -1) {
-              fprintf(stderr, "Failed to close .bck file\n");
-              return NULL;
-            }
-            kvs_terminate();
-            close(jobs_fd);
-            close(out_fd);
-            closedir(dir);
-            exit(0); // Child successfully exits after performing the backup
-          }
-        /*-------------------------------------------------------------------*/
-
-        /*-----------------------PARENT PROCESS JUMP-------------------------*/
-
-          safe_mutex_unlock(&active_child_mutex);
-          active_child++; // Increment active children count
-          backups++;
-          break;
+/// Reads a key sent by a client, which isn't null-terminated if it fills all
+/// MAX_STRING_SIZE bytes.
+/// @return 0 on success, 1 if the key couldn't be read.
+static int read_key(int req_fd, char key[MAX_STRING_SIZE + 1]) {
+  if (read_all(req_fd, key, MAX_STRING_SIZE, 0) != 1) {
+    fprintf(stderr, "Failed to read key from request pipe\n");
+    return 1;
+  }
+  key[MAX_STRING_SIZE] = '\0';
+  return 0;
+}
 
-        case CMD_INVALID:
-          fprintf(stderr, "Invalid command. See HELP for usage\n");
-          break;
+/// Sends the result of a SCAN or PREFIX: the opcode, the result, the number
+/// of pairs as a uint32_t and then the pairs.
+static void write_scan_response(int resp_fd, char op_code, int failed,
+                                ScanResponse *response) {
+  char header[2 + sizeof(uint32_t)];
+  uint32_t count = failed ? 0 : response->count;
+  header[0] = op_code;
+  header[1] = (char)(failed ? 1 : 0);
+  memcpy(header + 2, &count, sizeof(count));
+  if (safe_write(resp_fd, header, sizeof(header)) == 0 && count > 0) {
+    safe_write(resp_fd, response->pairs.data, response->pairs.len);
+  }
+}
 
-        case CMD_HELP:
-          printf("Available commands:\n"
-                 "  WRITE [(key,value),(key2,value2),...]\n"
-                 "  READ [key,key2,...]\n"
-                 "  DELETE [key,key2,...]\n"
-                 "  SHOW\n"
-                 "  WAIT <delay_ms>\n"
-                 "  BACKUP\n"
-                 "  HELP\n");
-          break;
+/*-------------------------------TRANSACTIONS--------------------------------*/
+
+/// Sends the result of an EXEC: the opcode, the result, the length of the
+/// output as a uint32_t and then the output of its READ and DELETE commands.
+static void write_exec_response(int resp_fd, int failed,
+                                const OutputBuffer *output) {
+  char header[2 + sizeof(uint32_t)];
+  uint32_t len = failed ? 0 : (uint32_t)output->len;
+  header[0] = OP_CODE_EXEC;
+  header[1] = (char)(failed ? 1 : 0);
+  memcpy(header + 2, &len, sizeof(len));
+  if (safe_write(resp_fd, header, sizeof(header)) == 0 && len > 0) {
+    safe_write(resp_fd, output->data, output->len);
+  }
+}
 
-        case CMD_EMPTY:
-          break;
+/// Reads an EXEC request, the number of commands and then each command as its
+/// kind, its number of keys, its keys and, for a WRITE, its value and TTL.
+/// The commands are run as one transaction and its result is sent back.
+/// @param req_fd Request pipe of the client.
+/// @param resp_fd Response pipe of the client.
+static void run_exec(int req_fd, int resp_fd) {
+  char keys[MAX_TX_COMMANDS * MAX_NUMBER_SUB][MAX_STRING_SIZE + 1];
+  char values[MAX_TX_COMMANDS][MAX_STRING_SIZE + 1];
+  Slice key_slices[MAX_TX_COMMANDS * MAX_NUMBER_SUB];
+  Slice value_slices[MAX_TX_COMMANDS * MAX_NUMBER_SUB];
+  TxCommand commands[MAX_TX_COMMANDS];
+  unsigned char num_commands;
+  if (read_all(req_fd, &num_commands, 1, 0) != 1) {
+    return;
+  }
+  if (num_commands == 0 || num_commands > MAX_TX_COMMANDS) {
+    write_exec_response(resp_fd, 1, NULL);
+    return;
+  }
 
-        case EOC:
-          should_exit = 1;
-          break;
-        }
-      }
+  // Invalid keys fail the transaction once the whole request is read
+  int valid = 1;
+  size_t num_keys = 0;
+  for (size_t c = 0; c < num_commands; c++) {
+    unsigned char header[2]; // Kind and number of keys
+    if (read_all(req_fd, header, sizeof(header), 0) != 1) {
+      return;
+    }
+    if (header[0] > TX_OP_DELETE || header[1] == 0 ||
+        header[1] > MAX_NUMBER_SUB ||
+        (header[0] == TX_OP_WRITE && header[1] != 1)) {
+      write_exec_response(resp_fd, 1, NULL);
+      return;
+    }
 
-      if (close(jobs_fd) == -1) {
-        fprintf(stderr, "Failed to close .jobs file\n");
-        return NULL;
+    TxCommand *command = &commands[c];
+    command->kind = header[0] == TX_OP_READ    ? TX_READ
+                    : header[0] == TX_OP_WRITE ? TX_WRITE
+                                               : TX_DELETE;
+    command->num_pairs = header[1];
+    command->keys = &key_slices[num_keys];
+    command->hashes = NULL;
+    command->values = &value_slices[num_keys];
+    command->ttl_ms = 0;
+    for (size_t i = 0; i < header[1]; i++, num_keys++) {
+      if (read_key(req_fd, keys[num_keys])) {
+        return;
       }
-      if (close(out_fd) == -1) {
-        fprintf(stderr, "Failed to close .out file\n");
-        return NULL;
+      key_slices[num_keys] = (Slice){keys[num_keys], strlen(keys[num_keys])};
+      valid &= key_slices[num_keys].len > 0 && hash(keys[num_keys]) >= 0;
+    }
+    if (command->kind == TX_WRITE) {
+      uint32_t ttl_ms;
+      if (read_key(req_fd, values[c]) ||
+          read_all(req_fd, &ttl_ms, sizeof(ttl_ms), 0) != 1) {
+        return;
       }
-      free(jobs_file_path);
+      value_slices[num_keys - 1] = (Slice){values[c], strlen(values[c])};
+      command->ttl_ms = ttl_ms;
     }
   }
-  return NULL;
+
+  OutputBuffer output;
+  init_output(&output, -1);
+  int failed =
+      !valid || kvs_transaction(num_commands, commands, &output, subs_list);
+  write_exec_response(resp_fd, failed, &output);
+  free_output(&output);
 }
 
 /*------------------------------CLIENT THREAD--------------------------------*/
@@ -347,6 +247,7 @@ void ClientHandlerFunction() {
 
       //Client was unexpectedly disconnected
       if (read_all(req_fd, &OP_CODE, 1, 0) != 1) {
+        kvs_untail(notif_fd);
         break;
       }
 
@@ -355,6 +256,7 @@ void ClientHandlerFunction() {
 
       // DISCONNECT
       case 2:
+        kvs_untail(notif_fd);
         result = remove_all_subscriptions_from_client(subs_list, notif_fd);
         if (result == 1) {
           write_response(resp_fd, OP_CODE_DISCONNECT, 1);
@@ -365,30 +267,44 @@ void ClientHandlerFunction() {
           break;
         }
         write_response(resp_fd, OP_CODE_DISCONNECT, 0);
+        // Removed before its pipe is closed, or a client connecting meanwhile
+        // could get the same descriptor and be removed instead
+        remove_active_client(active_clients_list, resp_fd);
         safe_close(resp_fd);
         connected = 0;
-        remove_active_client(active_clients_list, resp_fd);
         break;
 
       // SUBSCRIBE
-      case 3:
+      case 3: {
         if (read_all(req_fd, key, MAX_STRING_SIZE, 0) != 1) {
           fprintf(stderr, "Failed to read key from request pipe\n");
           break;
         }
+        key[MAX_STRING_SIZE - 1] = '\0';
 
+        // Read before subscribing, so no change after it is left out
+        uint64_t seq = key_change_seq(key);
         result = add_subscription(subs_list, key, notif_fd);
+        // The sequence number of the key's last change follows the result,
+        // as a native uint64
+        char sub_response[2 + sizeof(seq)];
+        sub_response[0] = OP_CODE_SUB;
         if (result == 0) {
           // Key doesn't exist, subscription failed
-          write_response(resp_fd, OP_CODE_SUB, 0);
+          sub_response[1] = 0;
           // Key exists, subscription successful
         } else if (result == 1) {
-          write_response(resp_fd, OP_CODE_SUB, 1);
+          sub_response[1] = 1;
           // Subscription failed unexpectedly
         } else {
-          write_response(resp_fd, OP_CODE_SUB, 2);
+          sub_response[1] = 2;
+        }
+        memcpy(sub_response + 2, &seq, sizeof(seq));
+        if (safe_write(resp_fd, sub_response, sizeof(sub_response)) != 0) {
+          fprintf(stderr, "Failed to write subscribe response\n");
         }
         break;
+      }
 
       // UNSUBSCRIBE
       case 4:
@@ -409,6 +325,157 @@ void ClientHandlerFunction() {
         }
         break;
 
+      // SCAN
+      case 5: {
+        char start[MAX_STRING_SIZE + 1];
+        char end[MAX_STRING_SIZE + 1];
+        uint32_t limit;
+        if (read_key(req_fd, start) || read_key(req_fd, end) ||
+            read_all(req_fd, &limit, sizeof(limit), 0) != 1) {
+          break;
+        }
+        ScanResponse response = {.count = 0};
+        init_output(&response.pairs, -1);
+        result = kvs_scan((Slice){start, strlen(start)},
+                          (Slice){end, strlen(end)}, limit, add_scan_pair,
+                          &response);
+        write_scan_response(resp_fd, OP_CODE_SCAN, result, &response);
+        free_output(&response.pairs);
+        break;
+      }
+
+      // PREFIX
+      case 6: {
+        char prefix[MAX_STRING_SIZE + 1];
+        if (read_key(req_fd, prefix)) {
+          break;
+        }
+        ScanResponse response = {.count = 0};
+        init_output(&response.pairs, -1);
+        result = kvs_prefix((Slice){prefix, strlen(prefix)}, 0, add_scan_pair,
+                            &response);
+        write_scan_response(resp_fd, OP_CODE_PREFIX, result, &response);
+        free_output(&response.pairs);
+        break;
+      }
+
+      // WRITE
+      case 7: {
+        char write_key[MAX_STRING_SIZE + 1];
+        char value[MAX_STRING_SIZE + 1];
+        uint32_t ttl_ms;
+        if (read_key(req_fd, write_key) || read_key(req_fd, value) ||
+            read_all(req_fd, &ttl_ms, sizeof(ttl_ms), 0) != 1) {
+          break;
+        }
+        Slice pair_key = {write_key, strlen(write_key)};
+        Slice pair_value = {value, strlen(value)};
+        if (pair_key.len == 0 || hash(write_key) < 0) {
+          write_response(resp_fd, OP_CODE_WRITE, 1);
+          break;
+        }
+        result = kvs_write(1, &pair_key, &pair_value, ttl_ms, subs_list);
+        write_response(resp_fd, OP_CODE_WRITE, (char)result);
+        break;
+      }
+
+      // CAS and PUTNX
+      case 8:
+      case 9: {
+        char cas_key[MAX_STRING_SIZE + 1];
+        char expected[MAX_STRING_SIZE + 1];
+        char value[MAX_STRING_SIZE + 1];
+        if (read_key(req_fd, cas_key) ||
+            (OP_CODE == OP_CODE_CAS && read_key(req_fd, expected)) ||
+            read_key(req_fd, value)) {
+          break;
+        }
+        Slice expected_value = {expected, strlen(expected)};
+        result = kvs_cas((Slice){cas_key, strlen(cas_key)}, NULL,
+                         OP_CODE == OP_CODE_CAS ? &expected_value : NULL,
+                         (Slice){value, strlen(value)}, subs_list);
+        // 0 written, 1 another value or the key exists, 2 no such key
+        write_response(resp_fd, OP_CODE, (char)(result == -1 ? 3 : result));
+        break;
+      }
+
+      // ADD
+      case 10: {
+        char add_key[MAX_STRING_SIZE + 1];
+        int64_t delta;
+        if (read_key(req_fd, add_key) ||
+            read_all(req_fd, &delta, sizeof(delta), 0) != 1) {
+          break;
+        }
+        int64_t value = 0;
+        result = kvs_add((Slice){add_key, strlen(add_key)}, NULL, delta,
+                         &value, subs_list);
+        // The new value follows the result, as a native int64
+        char response[2 + sizeof(value)];
+        response[0] = OP_CODE_ADD;
+        response[1] = (char)(result == -1 ? 2 : result);
+        memcpy(response + 2, &value, sizeof(value));
+        if (safe_write(resp_fd, response, sizeof(response)) != 0) {
+          fprintf(stderr, "Failed to write add response\n");
+        }
+        break;
+      }
+
+      // EXEC
+      case 11:
+        run_exec(req_fd, resp_fd);
+        break;
+
+      // TAIL
+      case 12: {
+        uint64_t from_seq;
+        if (read_all(req_fd, &from_seq, sizeof(from_seq), 0) != 1) {
+          break;
+        }
+        uint64_t start;
+        result =
+            kvs_tail(notif_fd, client.notif_pipe_path, from_seq, &start);
+        // The first change to be sent, or the oldest one kept, follows the
+        // result as a native uint64
+        char response[2 + sizeof(start)];
+        response[0] = OP_CODE_TAIL;
+        response[1] = (char)result;
+        memcpy(response + 2, &start, sizeof(start));
+        if (safe_write(resp_fd, response, sizeof(response)) != 0) {
+          fprintf(stderr, "Failed to write tail response\n");
+        }
+        break;
+      }
+
+      // RESUME
+      case 13: {
+        unsigned char count;
+        char keys[MAX_NUMBER_SUB][MAX_STRING_SIZE];
+        uint64_t after[MAX_NUMBER_SUB];
+        if (read_all(req_fd, &count, 1, 0) != 1) {
+          break;
+        }
+        int valid = count <= MAX_NUMBER_SUB;
+        for (size_t i = 0; valid && i < count; i++) {
+          valid = read_all(req_fd, keys[i], MAX_STRING_SIZE, 0) == 1 &&
+                  read_all(req_fd, &after[i], sizeof(uint64_t), 0) == 1;
+          keys[i][MAX_STRING_SIZE - 1] = '\0';
+        }
+        if (!valid) {
+          break;
+        }
+        // The status of every key follows the result
+        char response[2 + MAX_NUMBER_SUB];
+        response[0] = OP_CODE_RESUME;
+        response[1] =
+            (char)kvs_resume(notif_fd, keys, after, count, response + 2,
+                             subs_list);
+        if (safe_write(resp_fd, response, 2 + (size_t)count) != 0) {
+          fprintf(stderr, "Failed to write resume response\n");
+        }
+        break;
+      }
+
       // UNKNOWN
       default:
         fprintf(stderr, "Unknown command received: %c\n", OP_CODE);
@@ -453,6 +520,7 @@ void HostThreadFunction() {
     if (received_sigusr1) {
       safe_mutex_lock(&active_clients_list->active_clients_lock);
       // Clean up all subscriptions and client connections
+      kvs_untail_all();
       free_subs_list(subs_list);
       disconnect_all_clients(active_clients_list);
       subs_list = create_subscription_list();
@@ -501,6 +569,54 @@ void HostThreadFunction() {
 
 /*----------------------------------MAIN------------------------------------*/
 
+/// Parses a number of bytes, optionally followed by a K, M or G suffix.
+/// @param str String to be parsed.
+/// @param size Where the number of bytes is stored.
+/// @return 0 on success, 1 if the string isn't a valid size.
+static int parse_size(const char *str, size_t *size) {
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(str, &end, 10);
+  if (end == str || errno != 0) {
+    return 1;
+  }
+  int shift = *end == 'K' ? 10 : *end == 'M' ? 20 : *end == 'G' ? 30 : 0;
+  if (shift != 0) {
+    end++;
+  }
+  if (*end != '\0' || value > (SIZE_MAX >> shift)) {
+    return 1;
+  }
+  *size = (size_t)value << shift;
+  return 0;
+}
+
+void print_usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [-z] [-p] [-s] [-c] [-b <batch_size>] [-r <backup_file>] "
+          "[-l <load_file>] [-m <bytes>] [-n <ms>] [-H <versions>] "
+          "[-f <changes>] "
+          "<dir_path> <MAX_PROC> <MAX_THREADS> <REGISTER_PIPE_NAME>\n"
+          "  -z  Compress the backup files\n"
+          "  -p  Run independent commands of a job file in parallel\n"
+          "  -s  Keep running .job files added to dir_path later\n"
+          "  -c  Run .jobc files compiled by jobc instead of .job files\n"
+          "  -b  Max adjacent WRITEs or DELETEs run as one (1 to %d, "
+          "default %d)\n"
+          "  -r  Restore a (compressed or not) backup file on startup\n"
+          "  -l  Load the (key, value) lines of a file on startup, on "
+          "MAX_THREADS threads\n"
+          "  -m  Evict the pairs used least lately to keep them under a "
+          "memory budget\n      (bytes, or with a K, M or G suffix)\n"
+          "  -n  Notify subscribers of INCR, DECR and ADD at most once per "
+          "counter every ms\n      milliseconds, with its latest value\n"
+          "  -H  Keep up to versions older values per key for READ @<version> "
+          "and\n      HISTORY (1 to %d)\n"
+          "  -f  Keep a feed of the last changes clients can TAIL (1 to %d)\n",
+          name, JOB_MAX_BATCH_SIZE, JOB_BATCH_SIZE, MAX_HISTORY_LEN,
+          CDC_MAX_RECORDS);
+}
+
 int main(int argc, char *argv[]) {
   /*---------Blocking the signal----------*/
   sigset_t set;
@@ -509,24 +625,110 @@ int main(int argc, char *argv[]) {
   pthread_sigmask(SIG_BLOCK, &set, NULL);
   /*--------------------------------------*/
 
-  if (argc != 5) {
-    fprintf(
-        stderr,
-        "Usage: %s <dir_path> <MAX_PROC> <MAX_THREADS> <REGISTER_PIPE_NAME>\n",
-        argv[0]);
+  /*-----------------------------OPTIONS-----------------------------------*/
+  char *restore_path = NULL;
+  char *load_path = NULL;
+  size_t memory_budget = 0;
+  unsigned int notice_interval_ms = 0;
+  unsigned int history_len = 0;
+  unsigned int feed_len = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "zpscb:r:l:m:n:H:f:")) != -1) {
+    switch (opt) {
+    case 'z':
+      compress_backups = 1;
+      break;
+    case 'p':
+      parallel_commands = 1;
+      break;
+    case 's':
+      streaming = 1;
+      break;
+    case 'c':
+      compiled_jobs = 1;
+      break;
+    case 'b':
+      if (sscanf(optarg, "%zu", &batch_size) != 1 || batch_size < 1 ||
+          batch_size > JOB_MAX_BATCH_SIZE) {
+        fprintf(stderr, "Invalid batch size: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'r':
+      restore_path = optarg;
+      break;
+    case 'l':
+      load_path = optarg;
+      break;
+    case 'm':
+      if (parse_size(optarg, &memory_budget) || memory_budget == 0) {
+        fprintf(stderr, "Invalid memory budget: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'n':
+      if (sscanf(optarg, "%u", &notice_interval_ms) != 1 ||
+          notice_interval_ms == 0) {
+        fprintf(stderr, "Invalid notification interval: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'H':
+      if (sscanf(optarg, "%u", &history_len) != 1 || history_len == 0 ||
+          history_len > MAX_HISTORY_LEN) {
+        fprintf(stderr, "Invalid history length: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'f':
+      if (sscanf(optarg, "%u", &feed_len) != 1 || feed_len == 0 ||
+          feed_len > CDC_MAX_RECORDS) {
+        fprintf(stderr, "Invalid feed length: %s\n", optarg);
+        return 1;
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - optind != 4) {
+    print_usage(argv[0]);
     return 1;
   }
+  argv += optind - 1; // Positional arguments start at argv[1]
 
-  if (kvs_init()) {
+  if (kvs_init(&subs_list)) {
     fprintf(stderr, "Failed to initialize KVS\n");
     return 1;
   }
 
+  kvs_set_memory_budget(memory_budget);
+  kvs_set_notice_interval(notice_interval_ms);
+  kvs_set_history(history_len);
+  if (feed_len > 0) {
+    kvs_set_feed(feed_len);
+  }
   subs_list = create_subscription_list();
   active_clients_list = create_active_clients_list();
 
+  if (restore_path != NULL) {
+    int restore_fd = open(restore_path, O_RDONLY);
+    if (restore_fd == -1) {
+      fprintf(stderr, "Failed to open backup to restore\n");
+      return 1;
+    }
+    if (kvs_restore(restore_fd, subs_list)) {
+      fprintf(stderr, "Failed to restore backup\n");
+      close(restore_fd);
+      return 1;
+    }
+    close(restore_fd);
+  }
+
   char *dir_path = argv[1];
-  dir = opendir(dir_path);
+  DIR *dir = opendir(dir_path);
   if (dir == NULL) {
     fprintf(stderr, "Failed to open directory\n");
     return 1;
@@ -537,6 +739,11 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (backup_workers_start(MAX_PROC, compress_backups)) {
+    fprintf(stderr, "Failed to start backup workers\n");
+    return 1;
+  }
+
   int MAX_THREADS = 0;
   if (sscanf(argv[3], "%d", &MAX_THREADS) != 1) {
     fprintf(stderr, "Invalid number provided for MAX_THREADS\n");
@@ -552,18 +759,22 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Invalid number of threads: %d\n", MAX_THREADS);
     return 1;
   }
+
+  // Expires the pairs written with a TTL, and resumes WAITing jobs
+  if (timer_start()) {
+    return 1;
+  }
+
+  // Before any client connects, so no subscriber has to be notified
+  if (load_path != NULL && kvs_load(load_path, MAX_THREADS, subs_list)) {
+    fprintf(stderr, "Failed to load %s\n", load_path);
+    return 1;
+  }
   
   pthread_t HostThread;
   pthread_t clientThreads[S];
   sem_init(&empty, 0, S);
   sem_init(&full, 0, 0);
-  pthread_t threads[MAX_THREADS];
-  int thread_created[MAX_THREADS];
-  ThreadArgs args = {argv[1]};
-
-  for (int i = 0; i < MAX_THREADS; i++) {
-    thread_created[i] = 0;
-  }
   if (pthread_create(&HostThread, NULL, (void *)HostThreadFunction, NULL) !=
       0) {
     fprintf(stderr, "Error creating HostThread\n");
@@ -574,22 +785,14 @@ int main(int argc, char *argv[]) {
       fprintf(stderr, "Error creating client thread number: %d\n", i);
     }
   }
-  for (int i = 0; i < MAX_THREADS; i++) {
-    if (pthread_create(&threads[i], NULL, thread_operation, (void *)&args) !=
-        0) {
-      fprintf(stderr, "Error creating thread number: %d\n", i);
-    } else {
-      thread_created[i] = 1;
-    }
-  }
 
-  for (int i = 0; i < MAX_THREADS; i++) {
-    if (thread_created[i]) {
-      if (pthread_join(threads[i], NULL) != 0) {
-        fprintf(stderr, "Error joining thread number: %d\n", i);
-      }
-    }
+  /*RUNNING THE JOBS ON MAX_THREADS WORKERS*/
+  JobsOptions jobs_options = {MAX_THREADS, parallel_commands, batch_size,
+                              streaming, compiled_jobs};
+  if (jobs_run(dir, dir_path, &jobs_options, &subs_list)) {
+    fprintf(stderr, "Failed to run the jobs\n");
   }
+
   for (int i = 0; i < S; i++) {
     if (pthread_join(clientThreads[i], NULL) != 0) {
       fprintf(stderr, "Error joining client thread number: %d\n", i);
@@ -600,14 +803,11 @@ int main(int argc, char *argv[]) {
   }
 
   closedir(dir);
+  timer_stop();
   free_subs_list(subs_list);
   kvs_terminate();
 
   /*WAITING FOR ALL THE BACKUPS TO FINISH*/
-  while (active_child > 0) {
-    if (wait(NULL) > 0) {
-      active_child--;
-    }
-  }
+  backup_workers_stop();
   return 0;
 }
\ No newline at end of file
@@ -1,17 +1,77 @@
+#include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "backup.h"
+#include "bloom.h"
+#include "cdc.h"
 #include "constants.h"
+#include "io.h"
 #include "kvs.h"
+#include "load.h"
+#include "lz.h"
 #include "operations.h"
+#include "parser.h"
+#include "snapshot.h"
 #include "src/common/io.h"
+#include "timer.h"
 
 static struct HashTable *kvs_table = NULL;
+static SubscriptionList **timer_subs = NULL; // Notified by timer callbacks
+
+// Every WRITE with a TTL gets its own id, so a timer expires a pair only if
+// no later write replaced its TTL
+static uint64_t last_ttl_id = 0;
+static pthread_mutex_t ttl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Pair waiting for its TTL to expire on the timer's wheel.
+typedef struct {
+  char key[MAX_STRING_SIZE + 1];
+  uint64_t ttl_id;
+} Expiry;
+
+/// Counter whose subscribers will be notified of its value when the pending
+/// notifications are sent.
+typedef struct {
+  uint64_t key_hash;
+  char key[MAX_STRING_SIZE + 1]; // Empty for a free slot
+} PendingNotice;
+
+// Counters updated since their notifications were last sent, an open
+// addressing set, when notifications are coalesced
+static unsigned int notice_interval_ms = 0;
+static PendingNotice *pending_notices = NULL;
+static size_t num_pending = 0;
+static size_t pending_cap = 0; // Power of two
+static pthread_mutex_t notice_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Lookup of a key shared by every single key READ of it that arrives before
+/// the lookup is over. The copy of the value is freed by the last reader.
+typedef struct ReadFlight {
+  uint64_t key_hash;
+  char key[MAX_STRING_SIZE + 1];
+  char *value;           // NULL if the key doesn't exist
+  int done;              // Set once value is published
+  atomic_int refs;       // Readers sharing the flight
+  pthread_cond_t joined; // Signaled to the readers waiting for value
+  struct ReadFlight *next;
+} ReadFlight;
+
+/// Lookups in progress whose key hashes share the same low bits.
+typedef struct {
+  ReadFlight *head;
+  pthread_mutex_t lock;
+} FlightSlot;
+
+// Lookups in progress, by hash of their key
+static FlightSlot read_flights[READ_FLIGHT_SLOTS];
 
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
@@ -38,7 +98,28 @@ int write_to_file(int out_fd, const char *buffer) {
   return 0;
 }
 
-int *create_alphabetical_index(char keys[][MAX_STRING_SIZE], size_t num_pairs) {
+int compare_keys(Slice a, Slice b) {
+  size_t len = a.len < b.len ? a.len : b.len;
+  int result = strncasecmp(a.ptr, b.ptr, len);
+  if (result != 0 || a.len == b.len) {
+    return result;
+  }
+  return a.len < b.len ? -1 : 1;
+}
+
+int order_keys(Slice a, Slice b) {
+  int result = compare_keys(a, b);
+  if (result != 0) {
+    return result;
+  }
+  result = memcmp(a.ptr, b.ptr, a.len < b.len ? a.len : b.len);
+  if (result != 0 || a.len == b.len) {
+    return result;
+  }
+  return a.len < b.len ? -1 : 1;
+}
+
+int *create_alphabetical_index(const Slice *keys, size_t num_pairs) {
 
   int *sorted_indexes = safe_malloc(num_pairs * sizeof(int));
 
@@ -53,7 +134,7 @@ int *create_alphabetical_index(char keys[][MAX_STRING_SIZE], size_t num_pairs) {
 
     // Find the index of the smallest key in the remaining unsorted portion
     for (size_t j = i + 1; j < num_pairs; j++) {
-      if (strcasecmp(keys[sorted_indexes[j]], keys[sorted_indexes[min_idx]]) <
+      if (compare_keys(keys[sorted_indexes[j]], keys[sorted_indexes[min_idx]]) <
           0) {
         min_idx = j;
       }
@@ -70,21 +151,312 @@ int *create_alphabetical_index(char keys[][MAX_STRING_SIZE], size_t num_pairs) {
   return sorted_indexes;
 }
 
-int printTable(int fd) {
+/// Checks the filter for a key, without taking any lock. Keys without a
+/// bucket never exist, so callers can index the table if it returns 1.
+/// @param key Key to look for.
+/// @param key_hash Hash of the key to look for.
+/// @return 0 if the key certainly doesn't exist, 1 if it may exist.
+static int may_exist(const char *key, uint64_t key_hash) {
+  return hash(key) >= 0 && bloom_may_contain(kvs_table->filter, key_hash);
+}
+
+/// Hashes every key of a request once, for every lookup that follows.
+/// @param keys Keys to be hashed.
+/// @param num_keys Number of keys.
+/// @param known_hashes Hashes given with the request, copied instead of
+///                     hashing the keys, NULL if none.
+/// @param hashes Array where the hashes are stored.
+static void hash_keys(const Slice *keys, size_t num_keys,
+                      const uint64_t *known_hashes, uint64_t *hashes) {
+  if (known_hashes != NULL) {
+    memcpy(hashes, known_hashes, num_keys * sizeof(uint64_t));
+    return;
+  }
+  for (size_t i = 0; i < num_keys; i++) {
+    hashes[i] = hash_key(keys[i]);
+  }
+}
+
+/// Locks the marked buckets in increasing bucket order, so that concurrent
+/// operations never wait for each other in a cycle.
+/// @param locked Array with the buckets to be locked marked.
+/// @param write 1 to lock the buckets for writing, 0 for reading.
+static void lock_marked(const int locked[TABLE_SIZE], int write) {
   for (int i = 0; i < TABLE_SIZE; i++) {
-    KeyNode *keyNode = kvs_table->table[i].head;
-    while (keyNode != NULL) {
-      char buf[BUF_SIZE];
-      snprintf(buf, sizeof(buf), "(%s, %s)\n", keyNode->key, keyNode->value);
-      if (write_to_file(fd, buf)) {
-        fprintf(stderr, "Error writing to file\n");
-        safe_rdwrunlock(&kvs_table->global_lock);
-        return 1;
+    if (locked[i]) {
+      if (write) {
+        safe_wrlock(&kvs_table->table[i].list_lock);
+      } else {
+        safe_rdlock(&kvs_table->table[i].list_lock);
       }
-      keyNode = keyNode->next; // Move to the next node
     }
   }
-  return 0;
+}
+
+/// Locks the buckets of the given keys, as lock_marked does.
+/// @param keys Keys whose buckets will be locked.
+/// @param num_keys Number of keys.
+/// @param locked Array where the locked buckets are marked.
+/// @param write 1 to lock the buckets for writing, 0 for reading.
+static void lock_buckets(const Slice *keys, size_t num_keys,
+                         int locked[TABLE_SIZE], int write) {
+  for (size_t i = 0; i < num_keys; i++) {
+    int index = hash(keys[i].ptr);
+    if (index >= 0) { // Keys without a bucket are never stored
+      locked[index] = 1;
+    }
+  }
+  lock_marked(locked, write);
+}
+
+/// Unlocks the buckets marked by lock_buckets.
+/// @param locked Array with the locked buckets marked.
+static void unlock_buckets(const int locked[TABLE_SIZE]) {
+  for (int i = TABLE_SIZE - 1; i >= 0; i--) {
+    if (locked[i]) {
+      safe_rdwrunlock(&kvs_table->table[i].list_lock);
+    }
+  }
+}
+
+/// Finds the staged change of a key in an open addressing index of changes.
+/// @param slots Index of every change plus one, 0 for a free slot, with a
+///              power of two number of slots, never full.
+/// @param mask Number of slots minus one.
+/// @param staged Changes staged so far.
+/// @param key Key to look for.
+/// @param key_hash Hash of the key.
+/// @return Slot holding the key's change, or the free slot where it belongs.
+static size_t *find_staged(size_t *slots, size_t mask,
+                           const StagedPair *staged, Slice key,
+                           uint64_t key_hash) {
+  size_t slot = (size_t)key_hash & mask;
+  while (slots[slot] != 0) {
+    const StagedPair *pair = &staged[slots[slot] - 1];
+    if (pair->key_hash == key_hash && pair->key.len == key.len &&
+        memcmp(pair->key.ptr, key.ptr, key.len) == 0) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return &slots[slot];
+}
+
+/// Reads a key, sharing the lookup and the copy of its value with every
+/// concurrent reader of the same key. The flight can be joined until its
+/// leader unlocks the bucket, and no write can complete while the bucket is
+/// read locked, so every reader gets a value that was current during its
+/// own read.
+/// @param key Key to be read.
+/// @param key_hash Hash of the key.
+/// @return Flight holding the value, to be released with leave_flight, or
+///         NULL if memory couldn't be allocated.
+static ReadFlight *read_shared(Slice key, uint64_t key_hash) {
+  FlightSlot *slot = &read_flights[key_hash & (READ_FLIGHT_SLOTS - 1)];
+  safe_mutex_lock(&slot->lock);
+  for (ReadFlight *flight = slot->head; flight != NULL;
+       flight = flight->next) {
+    if (flight->key_hash == key_hash &&
+        strncmp(flight->key, key.ptr, key.len) == 0 &&
+        flight->key[key.len] == '\0') {
+      atomic_fetch_add(&flight->refs, 1);
+      while (!flight->done) {
+        pthread_cond_wait(&flight->joined, &slot->lock);
+      }
+      safe_mutex_unlock(&slot->lock);
+      return flight;
+    }
+  }
+
+  ReadFlight *flight = malloc(sizeof(ReadFlight));
+  if (flight == NULL) {
+    safe_mutex_unlock(&slot->lock);
+    return NULL;
+  }
+  flight->key_hash = key_hash;
+  memcpy(flight->key, key.ptr, key.len);
+  flight->key[key.len] = '\0';
+  flight->value = NULL;
+  flight->done = 0;
+  atomic_init(&flight->refs, 1);
+  pthread_cond_init(&flight->joined, NULL);
+  flight->next = slot->head;
+  slot->head = flight;
+  safe_mutex_unlock(&slot->lock);
+
+  int index = hash(key.ptr);
+  safe_rdlock(&kvs_table->table[index].list_lock);
+  char *value = read_pair(kvs_table, key, key_hash);
+  safe_mutex_lock(&slot->lock);
+  flight->value = value;
+  flight->done = 1;
+  // Readers arriving from now on start a lookup of their own
+  ReadFlight **link = &slot->head;
+  while (*link != flight) {
+    link = &(*link)->next;
+  }
+  *link = flight->next;
+  if (atomic_load(&flight->refs) > 1) {
+    pthread_cond_broadcast(&flight->joined);
+  }
+  safe_mutex_unlock(&slot->lock);
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
+  return flight;
+}
+
+/// Releases a flight, freeing it once its last reader is done.
+/// @param flight Flight returned by read_shared.
+static void leave_flight(ReadFlight *flight) {
+  if (atomic_fetch_sub(&flight->refs, 1) == 1) {
+    pthread_cond_destroy(&flight->joined);
+    free(flight->value);
+    free(flight);
+  }
+}
+
+/// Deletes a pair whose TTL expired, called by the timer thread. Subscribers
+/// of the key get the same notification as for a DELETE.
+/// @param arg Expiry of the pair, freed here.
+static void expire_key(void *arg) {
+  Expiry *expiry = arg;
+  Slice key = {expiry->key, strlen(expiry->key)};
+  int index = hash(key.ptr);
+
+  safe_rdlock(&kvs_table->global_lock);
+  safe_wrlock(&kvs_table->table[index].list_lock);
+  expire_pair(kvs_table, *timer_subs, key, hash_key(key), expiry->ttl_id);
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
+  safe_rdwrunlock(&kvs_table->global_lock);
+  free(expiry);
+}
+
+/// Schedules the expiry of the pairs of a WRITE.
+/// @param keys Keys of the pairs.
+/// @param num_pairs Number of pairs.
+/// @param ttl_ms Milliseconds until the pairs expire.
+/// @param ttl_id TTL the pairs were written with.
+static void schedule_expiries(const Slice *keys, size_t num_pairs,
+                              unsigned int ttl_ms, uint64_t ttl_id) {
+  for (size_t i = 0; i < num_pairs; i++) {
+    if (hash(keys[i].ptr) < 0) {
+      continue; // Never written
+    }
+    Expiry *expiry = safe_malloc(sizeof(Expiry));
+    memcpy(expiry->key, keys[i].ptr, keys[i].len);
+    expiry->key[keys[i].len] = '\0';
+    expiry->ttl_id = ttl_id;
+    timer_schedule(ttl_ms, expire_key, expiry);
+  }
+}
+
+/// Evicts pairs until the KVS fits its memory budget, sweeping one bucket at a
+/// time in turn. Must be called without any bucket locked. Only one thread
+/// evicts at a time: the others go on, since it evicts for them too.
+/// @param sub_list Subscription list to notify of evicted keys.
+static void enforce_budget(SubscriptionList *sub_list) {
+  if (kvs_table->memory_budget == 0 ||
+      atomic_load(&kvs_table->memory_used) <= kvs_table->memory_budget ||
+      pthread_mutex_trylock(&kvs_table->eviction_lock) != 0) {
+    return;
+  }
+
+  // A pair gets a second chance at most once, so two turns are enough
+  int finished = 0;
+  for (int swept = 0; swept <= 2 * TABLE_SIZE && !finished; swept++) {
+    int index = kvs_table->clock_hand;
+    safe_rdlock(&kvs_table->global_lock);
+    safe_wrlock(&kvs_table->table[index].list_lock);
+    if (evict_bucket(kvs_table, sub_list, index)) {
+      kvs_table->clock_hand = (index + 1) % TABLE_SIZE;
+    } else {
+      finished = 1;
+    }
+    safe_rdwrunlock(&kvs_table->table[index].list_lock);
+    safe_rdwrunlock(&kvs_table->global_lock);
+  }
+  safe_mutex_unlock(&kvs_table->eviction_lock);
+}
+
+/// Sends the pending notifications, each with the current value of its
+/// counter, called by the timer thread.
+/// @param arg Unused.
+static void send_notices(void *arg) {
+  (void)arg;
+  safe_mutex_lock(&notice_lock);
+  PendingNotice *notices = pending_notices;
+  size_t cap = pending_cap;
+  pending_notices = NULL;
+  num_pending = pending_cap = 0;
+  safe_mutex_unlock(&notice_lock);
+
+  for (size_t i = 0; i < cap; i++) {
+    if (notices[i].key[0] == '\0') {
+      continue;
+    }
+    Slice key = {notices[i].key, strlen(notices[i].key)};
+    int index = hash(key.ptr);
+    safe_rdlock(&kvs_table->global_lock);
+    safe_rdlock(&kvs_table->table[index].list_lock);
+    notify_pair(kvs_table, *timer_subs, key, notices[i].key_hash);
+    safe_rdwrunlock(&kvs_table->table[index].list_lock);
+    safe_rdwrunlock(&kvs_table->global_lock);
+  }
+  free(notices);
+}
+
+/// Finds the slot of a key in a set of pending notifications.
+/// @return Slot holding the key, or the free slot where it belongs.
+static PendingNotice *find_notice(PendingNotice *notices, size_t cap,
+                                  Slice key, uint64_t key_hash) {
+  size_t slot = (size_t)key_hash & (cap - 1);
+  while (notices[slot].key[0] != '\0' &&
+         (notices[slot].key_hash != key_hash ||
+          strncmp(notices[slot].key, key.ptr, key.len) != 0 ||
+          notices[slot].key[key.len] != '\0')) {
+    slot = (slot + 1) & (cap - 1);
+  }
+  return &notices[slot];
+}
+
+/// Adds a counter to the pending notifications, which are sent once the
+/// interval after the first of them is over. A counter updated many times
+/// meanwhile is only notified once, with its latest value.
+/// @param key Key of the counter.
+/// @param key_hash Hash of the key.
+static void defer_notice(Slice key, uint64_t key_hash) {
+  safe_mutex_lock(&notice_lock);
+  if (2 * (num_pending + 1) > pending_cap) {
+    size_t cap = pending_cap ? 2 * pending_cap : 64;
+    PendingNotice *notices = calloc(cap, sizeof(PendingNotice));
+    if (notices == NULL) {
+      safe_mutex_unlock(&notice_lock);
+      fprintf(stderr, "Failed to allocate memory\n");
+      return;
+    }
+    for (size_t i = 0; i < pending_cap; i++) {
+      if (pending_notices[i].key[0] != '\0') {
+        Slice old_key = {pending_notices[i].key,
+                         strlen(pending_notices[i].key)};
+        *find_notice(notices, cap, old_key, pending_notices[i].key_hash) =
+            pending_notices[i];
+      }
+    }
+    free(pending_notices);
+    pending_notices = notices;
+    pending_cap = cap;
+  }
+
+  PendingNotice *notice =
+      find_notice(pending_notices, pending_cap, key, key_hash);
+  if (notice->key[0] == '\0') {
+    notice->key_hash = key_hash;
+    memcpy(notice->key, key.ptr, key.len);
+    notice->key[key.len] = '\0';
+    if (num_pending++ == 0) {
+      timer_schedule(notice_interval_ms, send_notices, NULL);
+    }
+  }
+  safe_mutex_unlock(&notice_lock);
 }
 
 /*-------------------------TABLE SETTERS/GETTERS-----------------------------*/
@@ -93,19 +465,39 @@ void lock_table() { safe_wrlock(&kvs_table->global_lock); }
 
 void unlock_table() { safe_rdwrunlock(&kvs_table->global_lock); }
 
-int key_exists(char *key) {
+int key_exists(const char *key, uint64_t key_hash) {
+  if (!may_exist(key, key_hash)) {
+    return 0;
+  }
   safe_rdlock(&kvs_table->global_lock);
   int index = hash(key);
   KeyNode *keyNode = kvs_table->table[index].head;
   // Search for the key node
   while (keyNode != NULL) {
-    if (strcmp(keyNode->key, key) == 0) {
+    if (keyNode->key_hash == key_hash && strcmp(keyNode->key, key) == 0) {
+      safe_rdwrunlock(&kvs_table->global_lock);
       return 1;
     }
     keyNode = keyNode->next; // Move to the next node
   }
+  safe_rdwrunlock(&kvs_table->global_lock);
   return 0;
+}
+
+uint64_t key_change_seq(const char *key) {
+  Slice key_slice = {key, strlen(key)};
+  int index = hash(key);
+  if (kvs_table->feed == NULL || index < 0) {
+    return 0;
+  }
+  safe_rdlock(&kvs_table->global_lock);
+  safe_rdlock(&kvs_table->table[index].list_lock);
+  const KeyNode *keyNode =
+      find_pair(kvs_table, key_slice, hash_key(key_slice));
+  uint64_t seq = keyNode != NULL ? keyNode->change_seq : 0;
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
   safe_rdwrunlock(&kvs_table->global_lock);
+  return seq;
 }
 
 /*-----------------------------SAFE FUNCTIONS--------------------------------*/
@@ -167,9 +559,10 @@ void write_response(int resp_fd, char op_code, char result) {
 }
 
 void write_notification(int notif_fd, const char *key, const char *value,
-                        int type) {
+                        int type, uint64_t seq) {
   // Prepare the message: OP_CODE followed by the result
-  char output[1 + 2 * MAX_STRING_SIZE] = {0};
+  char output[1 + 2 * MAX_STRING_SIZE + sizeof(uint64_t)] = {0};
+  memcpy(output + 1 + 2 * MAX_STRING_SIZE, &seq, sizeof(seq));
   switch (type) {
   case 1: // Key was changed
     output[0] = 1;
@@ -197,80 +590,200 @@ void write_notification(int notif_fd, const char *key, const char *value,
 
 /*-------------------------------OPERATIONS----------------------------------*/
 
-int kvs_init() {
+int kvs_init(SubscriptionList **sub_list) {
   if (kvs_table != NULL) {
     fprintf(stderr, "KVS state has already been initialized\n");
     return 1;
   }
 
+  timer_subs = sub_list;
+  for (int i = 0; i < READ_FLIGHT_SLOTS; i++) {
+    read_flights[i].head = NULL;
+    pthread_mutex_init(&read_flights[i].lock, NULL);
+  }
   kvs_table = create_hash_table();
   return kvs_table == NULL;
 }
 
+void kvs_set_memory_budget(size_t budget) { kvs_table->memory_budget = budget; }
+
+void kvs_set_notice_interval(unsigned int interval_ms) {
+  notice_interval_ms = interval_ms;
+}
+
+void kvs_set_history(size_t len) { kvs_table->history_len = len; }
+
+void kvs_set_feed(size_t cap) { kvs_table->feed = cdc_create(cap); }
+
 int kvs_terminate() {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
   free_table(kvs_table);
+  free(pending_notices);
   return 0;
 }
 
 // Modified write function to work with sorted indexes
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE],
-              char values[][MAX_STRING_SIZE], SubscriptionList *sub_list) {
+int kvs_write(size_t num_pairs, const Slice *keys, const Slice *values,
+              unsigned int ttl_ms, SubscriptionList *sub_list) {
+  return kvs_write_batch(1, &num_pairs, keys, NULL, values, &ttl_ms,
+                         sub_list);
+}
+
+int kvs_write_batch(size_t num_commands, const size_t *num_pairs,
+                    const Slice *keys, const uint64_t *known_hashes,
+                    const Slice *values, const unsigned int *ttl_ms,
+                    SubscriptionList *sub_list) {
 
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
-  // Create sorted index array
-  int *sorted_indexes = create_alphabetical_index(keys, num_pairs);
-  if (sorted_indexes == NULL) {
-    fprintf(stderr, "Failed to create sorted indexes\n");
-    return 1;
+  size_t total_pairs = 0;
+  for (size_t c = 0; c < num_commands; c++) {
+    total_pairs += num_pairs[c];
   }
 
+  uint64_t ttl_ids[num_commands];
+  safe_mutex_lock(&ttl_lock);
+  for (size_t c = 0; c < num_commands; c++) {
+    ttl_ids[c] = ttl_ms[c] > 0 ? ++last_ttl_id : 0;
+  }
+  safe_mutex_unlock(&ttl_lock);
+
+  uint64_t hashes[total_pairs];
+  hash_keys(keys, total_pairs, known_hashes, hashes);
+  const uint64_t *command_hashes = hashes;
+
+  const Slice *batch_keys = keys;
   int locked[TABLE_SIZE] = {0};
   safe_rdlock(&kvs_table->global_lock);
+  lock_buckets(keys, total_pairs, locked, 1);
 
-  // Perform write operations in alphabetical order
-  for (size_t i = 0; i < num_pairs; i++) {
-    int original_index = sorted_indexes[i];
-    int hashed_index = hash(keys[original_index]);
-    if (!locked[hashed_index]) {
-      locked[hashed_index] = 1;
-      safe_wrlock(&kvs_table->table[hashed_index].list_lock);
+  // Perform write operations in alphabetical order, one command at a time
+  for (size_t c = 0; c < num_commands; c++) {
+    int *sorted_indexes = create_alphabetical_index(keys, num_pairs[c]);
+    for (size_t i = 0; i < num_pairs[c]; i++) {
+      int original_index = sorted_indexes[i];
+      if (write_pair(kvs_table, sub_list, keys[original_index],
+                     command_hashes[original_index], values[original_index],
+                     ttl_ids[c]) != 0) {
+        fprintf(stderr, "Failed to write keypair (%.*s,%.*s)\n",
+                (int)keys[original_index].len, keys[original_index].ptr,
+                (int)values[original_index].len, values[original_index].ptr);
+      }
     }
+    free(sorted_indexes);
+    keys += num_pairs[c];
+    values += num_pairs[c];
+    command_hashes += num_pairs[c];
+  }
+
+  unlock_buckets(locked);
+  safe_rdwrunlock(&kvs_table->global_lock);
 
-    if (write_pair(kvs_table, sub_list, keys[original_index],
-                   values[original_index]) != 0) {
-      fprintf(stderr, "Failed to write keypair (%s,%s)\n", keys[original_index],
-              values[original_index]);
+  enforce_budget(sub_list);
+
+  // A timer firing before its pairs were written would find nothing to
+  // expire, so timers are only set once every write is done
+  for (size_t c = 0; c < num_commands; c++) {
+    if (ttl_ids[c] != 0) {
+      schedule_expiries(batch_keys, num_pairs[c], ttl_ms[c], ttl_ids[c]);
     }
+    batch_keys += num_pairs[c];
   }
+  return 0;
+}
 
-  // Unlock all acquired read locks
-  for (int i = TABLE_SIZE - 1; i >= 0; i--) {
-    if (locked[i]) {
-      safe_rdwrunlock(&kvs_table->table[i].list_lock);
-    }
+int kvs_cas(Slice key, const uint64_t *known_hash, const Slice *expected,
+            Slice value, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return -1;
+  }
+  int index = hash(key.ptr);
+  if (index < 0) {
+    return -1;
+  }
+  uint64_t key_hash = known_hash != NULL ? *known_hash : hash_key(key);
+  if (expected != NULL && !may_exist(key.ptr, key_hash)) {
+    return 2;
   }
 
+  safe_rdlock(&kvs_table->global_lock);
+  safe_wrlock(&kvs_table->table[index].list_lock);
+  int result =
+      cas_pair(kvs_table, sub_list, key, key_hash, expected, value);
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
   safe_rdwrunlock(&kvs_table->global_lock);
-  free(sorted_indexes);
-  return 0;
+
+  if (result == 0) {
+    enforce_budget(sub_list);
+  }
+  return result;
+}
+
+int kvs_add(Slice key, const uint64_t *known_hash, int64_t delta,
+            int64_t *result, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return -1;
+  }
+  int index = hash(key.ptr);
+  if (index < 0) {
+    return -1;
+  }
+  uint64_t key_hash = known_hash != NULL ? *known_hash : hash_key(key);
+
+  safe_rdlock(&kvs_table->global_lock);
+  safe_wrlock(&kvs_table->table[index].list_lock);
+  int status = add_pair(kvs_table, notice_interval_ms ? NULL : sub_list, key,
+                        key_hash, delta, result);
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
+  safe_rdwrunlock(&kvs_table->global_lock);
+
+  if (status == 0) {
+    if (notice_interval_ms) {
+      defer_notice(key, key_hash);
+    }
+    enforce_budget(sub_list);
+  }
+  return status;
 }
 
 // Modified read function to work with sorted indexes
-int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int out_fd) {
+int kvs_read(size_t num_pairs, const Slice *keys,
+             const uint64_t *known_hashes, OutputBuffer *out) {
 
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
+  // Reads of a single key share their lookup with concurrent ones. Reads of
+  // many keys hold every bucket at once instead, so they can't wait on others
+  if (num_pairs == 1) {
+    uint64_t key_hash =
+        known_hashes != NULL ? known_hashes[0] : hash_key(keys[0]);
+    int present = may_exist(keys[0].ptr, key_hash);
+    ReadFlight *flight = present ? read_shared(keys[0], key_hash) : NULL;
+    if (flight != NULL || !present) {
+      char buf[BUF_SIZE];
+      snprintf(buf, sizeof(buf), "[(%.*s,%s)]\n", (int)keys[0].len,
+               keys[0].ptr,
+               flight != NULL && flight->value != NULL ? flight->value
+                                                       : "KVSERROR");
+      output_str(out, buf);
+      if (flight != NULL) {
+        leave_flight(flight);
+      }
+      return 0;
+    }
+  }
+
   // Create sorted index array
   int *sorted_indexes = create_alphabetical_index(keys, num_pairs);
   if (sorted_indexes == NULL) {
@@ -278,106 +791,782 @@ int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int out_fd) {
     return 1;
   }
 
+  // Keys ruled out by the filter are missing, their buckets aren't locked
+  uint64_t hashes[num_pairs];
+  hash_keys(keys, num_pairs, known_hashes, hashes);
+  char present[num_pairs];
   int locked[TABLE_SIZE] = {0};
+  for (size_t i = 0; i < num_pairs; i++) {
+    present[i] = (char)may_exist(keys[i].ptr, hashes[i]);
+    if (present[i]) {
+      locked[hash(keys[i].ptr)] = 1;
+    }
+  }
+  lock_marked(locked, 0);
   // Perform read operations in alphabetical order
-  write_to_file(out_fd, "[");
+  output_str(out, "[");
   for (size_t i = 0; i < num_pairs; i++) {
     int original_index = sorted_indexes[i];
-    int hashed_index = hash(keys[original_index]);
-    if (!locked[hashed_index]) {
-      locked[hashed_index] = 1;
-      safe_rdlock(&kvs_table->table[hashed_index].list_lock);
-    }
-
-    char *result = read_pair(kvs_table, keys[original_index]);
+    char *result = present[original_index]
+                       ? read_pair(kvs_table, keys[original_index],
+                                   hashes[original_index])
+                       : NULL;
 
     if (result == NULL) {
       char buf[MAX_WRITE_SIZE];
-      snprintf(buf, sizeof(buf), "(%s,KVSERROR)", keys[original_index]);
-      write_to_file(out_fd, buf);
+      snprintf(buf, sizeof(buf), "(%.*s,KVSERROR)",
+               (int)keys[original_index].len, keys[original_index].ptr);
+      output_str(out, buf);
     }
 
     else {
       char buf[BUF_SIZE];
-      snprintf(buf, sizeof(buf), "(%s,%s)", keys[original_index], result);
-      write_to_file(out_fd, buf);
+      snprintf(buf, sizeof(buf), "(%.*s,%s)", (int)keys[original_index].len,
+               keys[original_index].ptr, result);
+      output_str(out, buf);
       free(result);
     }
   }
 
-  write_to_file(out_fd, "]\n");
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    if (locked[i]) {
-      safe_rdwrunlock(&kvs_table->table[i].list_lock);
-    }
-  }
+  output_str(out, "]\n");
+  unlock_buckets(locked);
   free(sorted_indexes);
   return 0;
 }
 
-// Modified delete function to work with sorted indexes
-int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int out_fd,
-               SubscriptionList *sub_list) {
+int kvs_read_at(size_t num_pairs, const Slice *keys,
+                const uint64_t *known_hashes, uint64_t version,
+                OutputBuffer *out) {
   if (kvs_table == NULL) {
     fprintf(stderr, "KVS state must be initialized\n");
     return 1;
   }
 
-  // Create sorted index array
   int *sorted_indexes = create_alphabetical_index(keys, num_pairs);
   if (sorted_indexes == NULL) {
     fprintf(stderr, "Failed to create sorted indexes\n");
     return 1;
   }
 
-  safe_rdlock(&kvs_table->global_lock);
+  // Keys without a bucket can't exist, their reads fail without a lookup
+  uint64_t hashes[num_pairs];
+  hash_keys(keys, num_pairs, known_hashes, hashes);
   int locked[TABLE_SIZE] = {0};
-  // Perform delete operations in alphabetical order
-  int aux = 0;
+  for (size_t i = 0; i < num_pairs; i++) {
+    int index = hash(keys[i].ptr);
+    if (index >= 0) {
+      locked[index] = 1;
+    }
+  }
+  lock_marked(locked, 0);
+  output_str(out, "[");
   for (size_t i = 0; i < num_pairs; i++) {
     int original_index = sorted_indexes[i];
-    int hashed_index = hash(keys[original_index]);
-    if (!locked[hashed_index]) {
-      locked[hashed_index] = 1;
-      safe_wrlock(&kvs_table->table[hashed_index].list_lock);
-    }
-    if (delete_pair(kvs_table, sub_list, keys[original_index]) != 0) {
-      if (!aux) {
-        write_to_file(out_fd, "[");
-        aux = 1;
+    Slice key = keys[original_index];
+    const KeyNode *node =
+        hash(key.ptr) < 0
+            ? NULL
+            : find_pair(kvs_table, key, hashes[original_index]);
+    char buf[BUF_SIZE];
+    if (node == NULL) {
+      snprintf(buf, sizeof(buf), "(%.*s,KVSERROR)", (int)key.len, key.ptr);
+      output_str(out, buf);
+      continue;
+    }
+
+    // Versions only grow, so the first one not newer is the one to read
+    uint64_t value_version = 0;
+    const char *value = NULL;
+    for (size_t age = 0;; age++) {
+      value = node_version(node, age, &value_version);
+      if (value == NULL || value_version <= version) {
+        break;
+      }
+    }
+    if (value == NULL) {
+      snprintf(buf, sizeof(buf), "(%.*s,KVSNOVERSION)", (int)key.len,
+               key.ptr);
+    } else {
+      snprintf(buf, sizeof(buf), "(%.*s@%" PRIu64 ",%s)", (int)key.len,
+               key.ptr, value_version, value);
+    }
+    output_str(out, buf);
+  }
+  output_str(out, "]\n");
+  unlock_buckets(locked);
+  free(sorted_indexes);
+  return 0;
+}
+
+int kvs_history(Slice key, const uint64_t *known_hash, size_t limit,
+                OutputBuffer *out) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  int index = hash(key.ptr);
+  char buf[BUF_SIZE];
+  if (index < 0) {
+    snprintf(buf, sizeof(buf), "[(%.*s,KVSERROR)]\n", (int)key.len,
+             key.ptr);
+    output_str(out, buf);
+    return 0;
+  }
+  safe_rdlock(&kvs_table->table[index].list_lock);
+  const KeyNode *node = find_pair(
+      kvs_table, key, known_hash != NULL ? *known_hash : hash_key(key));
+  if (node == NULL) {
+    snprintf(buf, sizeof(buf), "[(%.*s,KVSERROR)]\n", (int)key.len,
+             key.ptr);
+    output_str(out, buf);
+    safe_rdwrunlock(&kvs_table->table[index].list_lock);
+    return 0;
+  }
+
+  output_str(out, "[");
+  for (size_t age = 0; limit == 0 || age < limit; age++) {
+    uint64_t version;
+    const char *value = node_version(node, age, &version);
+    if (value == NULL) {
+      break;
+    }
+    snprintf(buf, sizeof(buf), "(%.*s@%" PRIu64 ",%s)", (int)key.len,
+             key.ptr, version, value);
+    output_str(out, buf);
+  }
+  output_str(out, "]\n");
+  safe_rdwrunlock(&kvs_table->table[index].list_lock);
+  return 0;
+}
+
+int kvs_tail(int notif_fd, const char *notif_path, uint64_t from_seq,
+             uint64_t *start) {
+  *start = 0;
+  if (kvs_table == NULL || kvs_table->feed == NULL) {
+    return 2;
+  }
+  return cdc_tail(kvs_table->feed, notif_fd, notif_path, from_seq, start);
+}
+
+int kvs_resume(int notif_fd, char keys[][MAX_STRING_SIZE],
+               const uint64_t *after, size_t count, char *status,
+               SubscriptionList *sub_list) {
+  int missed[MAX_NUMBER_SUB] = {0};
+  for (size_t i = 0; i < count; i++) {
+    missed[i] = 1;
+  }
+  // Changes made meanwhile are sent by the subscription, the feed or both
+  for (size_t i = 0; i < count; i++) {
+    status[i] = add_subscription(sub_list, keys[i], notif_fd) == 0 ? 2 : 0;
+  }
+  if (kvs_table != NULL && kvs_table->feed != NULL) {
+    cdc_replay(kvs_table->feed, notif_fd, keys, after, count, missed);
+  }
+
+  int result = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (status[i] == 0 && missed[i]) {
+      status[i] = 1;
+    }
+    result |= status[i] != 0;
+  }
+  return result;
+}
+
+void kvs_untail(int notif_fd) {
+  if (kvs_table != NULL && kvs_table->feed != NULL) {
+    cdc_untail(kvs_table->feed, notif_fd);
+  }
+}
+
+void kvs_untail_all() {
+  if (kvs_table != NULL && kvs_table->feed != NULL) {
+    cdc_untail_all(kvs_table->feed);
+  }
+}
+
+int kvs_delete(size_t num_pairs, const Slice *keys, OutputBuffer *out,
+               SubscriptionList *sub_list) {
+  return kvs_delete_batch(1, &num_pairs, keys, NULL, out, sub_list);
+}
+
+int kvs_delete_batch(size_t num_commands, const size_t *num_pairs,
+                     const Slice *keys, const uint64_t *known_hashes,
+                     OutputBuffer *out, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  size_t total_pairs = 0;
+  for (size_t c = 0; c < num_commands; c++) {
+    total_pairs += num_pairs[c];
+  }
+
+  // Deletes only ever rule more keys out, so the filter is checked once for
+  // the whole batch and keys it rules out are missing without locking
+  uint64_t hashes[total_pairs];
+  hash_keys(keys, total_pairs, known_hashes, hashes);
+  char present[total_pairs];
+  int locked[TABLE_SIZE] = {0};
+  for (size_t i = 0; i < total_pairs; i++) {
+    present[i] = (char)may_exist(keys[i].ptr, hashes[i]);
+    if (present[i]) {
+      locked[hash(keys[i].ptr)] = 1;
+    }
+  }
+  safe_rdlock(&kvs_table->global_lock);
+  lock_marked(locked, 1);
+
+  // Perform delete operations in alphabetical order, one command at a time
+  const char *command_present = present;
+  const uint64_t *command_hashes = hashes;
+  for (size_t c = 0; c < num_commands; c++) {
+    int *sorted_indexes = create_alphabetical_index(keys, num_pairs[c]);
+    int aux = 0;
+    for (size_t i = 0; i < num_pairs[c]; i++) {
+      int original_index = sorted_indexes[i];
+      if (!command_present[original_index] ||
+          delete_pair(kvs_table, sub_list, keys[original_index],
+                      command_hashes[original_index]) != 0) {
+        if (!aux) {
+          output_str(out, "[");
+          aux = 1;
+        }
+        char buf[BUF_SIZE];
+        snprintf(buf, sizeof(buf), "(%.*s,KVSMISSING)",
+                 (int)keys[original_index].len, keys[original_index].ptr);
+        output_str(out, buf);
+      }
+    }
+    if (aux) {
+      output_str(out, "]\n");
+    }
+    free(sorted_indexes);
+    keys += num_pairs[c];
+    command_present += num_pairs[c];
+    command_hashes += num_pairs[c];
+  }
+
+  unlock_buckets(locked);
+  safe_rdwrunlock(&kvs_table->global_lock);
+  return 0;
+}
+
+int kvs_transaction(size_t num_commands, const TxCommand *commands,
+                    OutputBuffer *out, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  size_t total_keys = 0;
+  uint64_t ttl_ids[num_commands];
+  safe_mutex_lock(&ttl_lock);
+  for (size_t c = 0; c < num_commands; c++) {
+    total_keys += commands[c].num_pairs;
+    ttl_ids[c] = commands[c].kind == TX_WRITE && commands[c].ttl_ms > 0
+                     ? ++last_ttl_id
+                     : 0;
+  }
+  safe_mutex_unlock(&ttl_lock);
+
+  size_t cap = 16;
+  while (cap < 2 * total_keys) {
+    cap *= 2;
+  }
+  size_t *slots = calloc(cap, sizeof(size_t));
+  StagedPair *staged = malloc((total_keys + 1) * sizeof(StagedPair));
+  unsigned int *ttl_ms = malloc((total_keys + 1) * sizeof(unsigned int));
+  if (slots == NULL || staged == NULL || ttl_ms == NULL) {
+    free(slots);
+    free(staged);
+    free(ttl_ms);
+    fprintf(stderr, "Failed to allocate memory\n");
+    return 1;
+  }
+  size_t num_staged = 0;
+  OutputBuffer tx_out;
+  init_output(&tx_out, -1);
+
+  int locked[TABLE_SIZE] = {0};
+  for (size_t c = 0; c < num_commands; c++) {
+    for (size_t i = 0; i < commands[c].num_pairs; i++) {
+      int index = hash(commands[c].keys[i].ptr);
+      if (index >= 0) { // Keys without a bucket are never stored
+        locked[index] = 1;
       }
+    }
+  }
+  safe_rdlock(&kvs_table->global_lock);
+  lock_marked(locked, 1);
+
+  // Run every command against the staged changes, in alphabetical order
+  int failed = 0;
+  for (size_t c = 0; c < num_commands && !failed; c++) {
+    const TxCommand *command = &commands[c];
+    int *sorted_indexes =
+        create_alphabetical_index(command->keys, command->num_pairs);
+    if (sorted_indexes == NULL) {
+      failed = 1;
+      break;
+    }
+    int aux = command->kind == TX_READ;
+    if (aux) {
+      output_str(&tx_out, "[");
+    }
+    for (size_t i = 0; i < command->num_pairs; i++) {
+      int original_index = sorted_indexes[i];
+      Slice key = command->keys[original_index];
+      uint64_t key_hash = command->hashes != NULL
+                              ? command->hashes[original_index]
+                              : hash_key(key);
+      int stored = hash(key.ptr) >= 0;
+      size_t *slot = find_staged(slots, cap - 1, staged, key, key_hash);
+      StagedPair *pair = *slot ? &staged[*slot - 1] : NULL;
+      const KeyNode *node =
+          stored && pair == NULL && command->kind != TX_WRITE
+              ? find_pair(kvs_table, key, key_hash)
+              : NULL;
       char buf[BUF_SIZE];
-      snprintf(buf, sizeof(buf), "(%s,KVSMISSING)", keys[original_index]);
-      write_to_file(out_fd, buf);
+
+      switch (command->kind) {
+      case TX_READ:
+        if (pair != NULL ? pair->deleted : node == NULL) {
+          snprintf(buf, sizeof(buf), "(%.*s,KVSERROR)", (int)key.len,
+                   key.ptr);
+        } else if (pair != NULL) {
+          snprintf(buf, sizeof(buf), "(%.*s,%.*s)", (int)key.len, key.ptr,
+                   (int)pair->value.len, pair->value.ptr);
+        } else {
+          snprintf(buf, sizeof(buf), "(%.*s,%s)", (int)key.len, key.ptr,
+                   node->value);
+        }
+        output_str(&tx_out, buf);
+        break;
+
+      case TX_DELETE:
+        if (pair != NULL ? pair->deleted : node == NULL) {
+          if (!aux) {
+            output_str(&tx_out, "[");
+            aux = 1;
+          }
+          snprintf(buf, sizeof(buf), "(%.*s,KVSMISSING)", (int)key.len,
+                   key.ptr);
+          output_str(&tx_out, buf);
+          break;
+        }
+        // fall through
+      case TX_WRITE:
+        if (!stored) {
+          fprintf(stderr, "Failed to write keypair (%.*s,%.*s)\n",
+                  (int)key.len, key.ptr,
+                  (int)command->values[original_index].len,
+                  command->values[original_index].ptr);
+          break;
+        }
+        if (pair == NULL) {
+          pair = &staged[num_staged];
+          *slot = ++num_staged;
+          pair->key = key;
+          pair->key_hash = key_hash;
+        }
+        pair->deleted = command->kind == TX_DELETE;
+        if (!pair->deleted) {
+          pair->value = command->values[original_index];
+        }
+        pair->ttl_id = ttl_ids[c];
+        ttl_ms[*slot - 1] = command->ttl_ms;
+        break;
+      }
+    }
+    if (aux) {
+      output_str(&tx_out, "]\n");
     }
+    free(sorted_indexes);
   }
-  if (aux) {
-    write_to_file(out_fd, "]\n");
+
+  size_t prepared = 0;
+  while (!failed && prepared < num_staged) {
+    failed = prepare_pair(kvs_table, &staged[prepared++]);
   }
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    if (locked[i]) {
-      safe_rdwrunlock(&kvs_table->table[i].list_lock);
+  if (!failed) {
+    for (size_t i = 0; i < num_staged; i++) {
+      commit_pair(kvs_table, &staged[i]);
+    }
+    // Subscribers only ever see the state after the whole transaction
+    for (size_t i = 0; i < num_staged; i++) {
+      notify_commit(kvs_table, sub_list, &staged[i]);
     }
   }
+
+  unlock_buckets(locked);
   safe_rdwrunlock(&kvs_table->global_lock);
 
-  free(sorted_indexes);
+  for (size_t i = 0; i < prepared; i++) {
+    discard_pair(&staged[i]); // Nothing left once committed
+  }
+  if (failed) {
+    fprintf(stderr, "Failed to allocate memory\n");
+  } else {
+    if (tx_out.len > 0) {
+      output_write(out, tx_out.data, tx_out.len);
+    }
+    enforce_budget(sub_list);
+    for (size_t i = 0; i < num_staged; i++) {
+      if (staged[i].ttl_id != 0 && staged[i].changed) {
+        schedule_expiries(&staged[i].key, 1, ttl_ms[i], staged[i].ttl_id);
+      }
+    }
+  }
+
+  free_output(&tx_out);
+  free(slots);
+  free(staged);
+  free(ttl_ms);
+  return failed;
+}
+
+/// Read locks every bucket at once, keeping every writer out while readers
+/// still run.
+static void lock_all_buckets() {
+  safe_rdlock(&kvs_table->global_lock);
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    safe_rdlock(&kvs_table->table[i].list_lock);
+  }
+}
+
+/// Unlocks the buckets locked by lock_all_buckets.
+static void unlock_all_buckets() {
+  for (int i = TABLE_SIZE - 1; i >= 0; i--) {
+    safe_rdwrunlock(&kvs_table->table[i].list_lock);
+  }
+  safe_rdwrunlock(&kvs_table->global_lock);
+}
+
+/// Copies the pairs of the KVS with every bucket read locked at once, so
+/// readers aren't blocked and writers only wait for the copy.
+/// @return Newly created snapshot.
+static Snapshot *take_snapshot() {
+  lock_all_buckets();
+  Snapshot *snapshot = snapshot_take(kvs_table);
+  unlock_all_buckets();
+  return snapshot;
+}
+
+/// State of a scan of the key index.
+typedef struct {
+  Slice last;     // Last key of a range, or the prefix of the keys
+  int prefix;     // Set if last is a prefix
+  size_t limit;   // 0 for no limit
+  size_t count;   // Pairs visited so far
+  size_t visited; // Nodes visited in the current pass
+  int done;       // Set once the scan is over
+  int resumed;    // Set until the first node of a resumed pass is visited
+  char *after;    // Key the last pass ended at
+  size_t after_len;
+  size_t after_cap;
+  SkipListCallback callback;
+  void *arg;
+} ScanState;
+
+/// Visits a node of the key index if it is still in the scanned keys, ending
+/// the pass after SCAN_CHUNK_SIZE nodes.
+/// @return 1 once the scan or the pass is over, 0 otherwise.
+static int scan_node(const KeyNode *node, void *arg) {
+  ScanState *state = arg;
+  Slice key = {node->key, node->key_len};
+  if (state->resumed) {
+    state->resumed = 0;
+    Slice after = {state->after, state->after_len};
+    if (order_keys(key, after) == 0) {
+      return 0; // Visited by the last pass
+    }
+  }
+
+  int matches = 1;
+  if (state->prefix) {
+    // Every key starting with the prefix, whatever the case, comes together
+    if (key.len < state->last.len ||
+        strncasecmp(key.ptr, state->last.ptr, state->last.len) != 0) {
+      state->done = 1;
+      return 1;
+    }
+    matches = strncmp(key.ptr, state->last.ptr, state->last.len) == 0;
+  } else if (order_keys(key, state->last) > 0) {
+    state->done = 1;
+    return 1;
+  }
+
+  if (matches && (state->callback(node, state->arg) ||
+                  ++state->count == state->limit)) {
+    state->done = 1;
+    return 1;
+  }
+  if (++state->visited < SCAN_CHUNK_SIZE) {
+    return 0;
+  }
+
+  // Node keys may be freed once the buckets are unlocked
+  if (key.len > state->after_cap) {
+    free(state->after);
+    state->after_cap = key.len;
+    state->after = safe_malloc(state->after_cap);
+  }
+  memcpy(state->after, key.ptr, key.len);
+  state->after_len = key.len;
+  return 1;
+}
+
+/// Scans the key index from a key in passes of SCAN_CHUNK_SIZE nodes, each
+/// with every bucket read locked, so writers only wait for one pass. Each
+/// pass resumes after the key the last one ended at.
+/// @param start Key to start at.
+/// @param state State of the scan.
+static void scan_index(Slice start, ScanState *state) {
+  Slice from = start;
+  do {
+    state->visited = 0;
+    lock_all_buckets();
+    skiplist_scan(kvs_table->index, from, scan_node, state);
+    unlock_all_buckets();
+    from = (Slice){state->after, state->after_len};
+    state->resumed = 1;
+  } while (!state->done && state->visited == SCAN_CHUNK_SIZE);
+  free(state->after);
+}
+
+int kvs_show(OutputBuffer *out, int num_threads) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  Snapshot *snapshot = take_snapshot();
+  int result = snapshot_write_sorted(snapshot, out, num_threads);
+  snapshot_free(snapshot);
+  if (result) {
+    fprintf(stderr, "Error writing to file\n");
+  }
+  return result;
+}
+
+int kvs_scan(Slice start, Slice end, size_t limit, SkipListCallback callback,
+             void *arg) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  ScanState state = {.last = end, .limit = limit, .callback = callback,
+                     .arg = arg};
+  if (order_keys(start, end) <= 0) {
+    scan_index(start, &state);
+  }
+  return 0;
+}
+
+int kvs_prefix(Slice prefix, size_t limit, SkipListCallback callback,
+               void *arg) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  ScanState state = {.last = prefix, .prefix = 1, .limit = limit,
+                     .callback = callback, .arg = arg};
+  scan_index(prefix, &state);
+  return 0;
+}
+
+int kvs_export(const char *path, int num_threads) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to create export file: %s\n", path);
+    return 1;
+  }
+
+  Snapshot *snapshot = take_snapshot();
+  OutputBuffer out;
+  init_output(&out, fd); // Written as it is merged
+  int result = snapshot_write_sorted(snapshot, &out, num_threads);
+  snapshot_free(snapshot);
+  result |= output_flush(&out, fd);
+  free_output(&out);
+  if (close(fd) == -1 || result) {
+    fprintf(stderr, "Failed to write export file: %s\n", path);
+    return 1;
+  }
   return 0;
 }
 
-int kvs_show(int out_fd) {
+int kvs_backup(int bck_fd, int mft_fd) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  // The table is only locked while it is copied, the workers write the copy
   lock_table();
-  printTable(out_fd);
+  HashTable *snapshot = copy_table(kvs_table);
   unlock_table();
+  if (snapshot == NULL) {
+    return 1;
+  }
+
+  backup_enqueue(snapshot, bck_fd, mft_fd);
   return 0;
 }
 
-int kvs_backup(int bck_fd) {
-  if (printTable(bck_fd))
+int kvs_restore(int fd, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  /*READING THE WHOLE SNAPSHOT*/
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror("Failed to stat snapshot");
     return 1;
+  }
+  size_t len = (size_t)st.st_size;
+  char *data = safe_malloc(len + 1);
+  size_t total_read = 0;
+  while (total_read < len) {
+    ssize_t num_read = read(fd, data + total_read, len - total_read);
+    if (num_read <= 0) {
+      perror("Failed to read snapshot");
+      free(data);
+      return 1;
+    }
+    total_read += (size_t)num_read;
+  }
+  data[len] = '\0';
+
+  if (lz_is_compressed(data, len)) {
+    char *raw;
+    if (lz_decompress(data, len, &raw, &len)) {
+      fprintf(stderr, "Corrupted compressed snapshot\n");
+      free(data);
+      return 1;
+    }
+    free(data);
+    data = raw;
+  }
+
+  /*SPLITTING THE "(key, value)" LINES IN PLACE*/
+  size_t num_pairs = 0;
+  size_t capacity = 64;
+  char **pairs = safe_malloc(capacity * 2 * sizeof(char *));
+  char *line = data;
+  char *end = data + len;
+  while (line < end) {
+    char *newline = memchr(line, '\n', (size_t)(end - line));
+    char *line_end = newline ? newline : end;
+    char *separator = memchr(line, ',', (size_t)(line_end - line));
+
+    if (line_end - line >= 5 && line[0] == '(' && line_end[-1] == ')' &&
+        separator != NULL && separator > line + 1 && separator[1] == ' ' &&
+        separator - line - 1 < MAX_STRING_SIZE &&
+        line_end - separator - 3 < MAX_STRING_SIZE) {
+      // Keys without a bucket are skipped, like kvs_load does
+      *separator = '\0';
+      if (hash(line + 1) < 0) {
+        fprintf(stderr, "Skipping malformed snapshot line\n");
+        line = line_end + 1;
+        continue;
+      }
+      if (num_pairs == capacity) {
+        capacity *= 2;
+        char **grown = realloc(pairs, capacity * 2 * sizeof(char *));
+        if (grown == NULL) {
+          fprintf(stderr, "Failed to allocate memory\n");
+          free(pairs);
+          free(data);
+          return 1;
+        }
+        pairs = grown;
+      }
+      line_end[-1] = '\0';
+      pairs[2 * num_pairs] = line + 1;
+      pairs[2 * num_pairs + 1] = separator + 2;
+      num_pairs++;
+    } else if (line_end > line) {
+      fprintf(stderr, "Skipping malformed snapshot line\n");
+    }
+    line = line_end + 1;
+  }
+
+  /*INSERTING BACKWARDS SO EVERY BUCKET KEEPS ITS ORIGINAL ORDER*/
+  lock_table();
+  for (size_t i = num_pairs; i > 0; i--) {
+    Slice key = {pairs[2 * (i - 1)], strlen(pairs[2 * (i - 1)])};
+    Slice value = {pairs[2 * (i - 1) + 1], strlen(pairs[2 * (i - 1) + 1])};
+    write_pair(kvs_table, sub_list, key, hash_key(key), value, 0);
+  }
+  unlock_table();
+  enforce_budget(sub_list);
+
+  free(pairs);
+  free(data);
   return 0;
 }
 
+int kvs_load(const char *path, int num_threads, SubscriptionList *sub_list) {
+  if (kvs_table == NULL) {
+    fprintf(stderr, "KVS state must be initialized\n");
+    return 1;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open load file: %s\n", path);
+    return 1;
+  }
+  // Mapped when possible, the pairs are never copied before being written
+  JobReader reader;
+  if (init_reader(&reader, fd)) {
+    fprintf(stderr, "Failed to read load file: %s\n", path);
+    close(fd);
+    return 1;
+  }
+  close(fd);
+
+  const char *data = reader.data;
+  size_t len = reader.len;
+  char *raw = NULL;
+  if (lz_is_compressed(data, len)) {
+    if (lz_decompress(data, len, &raw, &len)) {
+      fprintf(stderr, "Corrupted compressed load file: %s\n", path);
+      close_reader(&reader);
+      return 1;
+    }
+    data = raw;
+  }
+
+  // Without subscribers there is nobody to notify, so nothing is looked up
+  safe_rdlock(&sub_list->subs_lock);
+  int has_subscribers = sub_list->head != NULL;
+  safe_rdwrunlock(&sub_list->subs_lock);
+
+  safe_rdlock(&kvs_table->global_lock);
+  int result = load_pairs(kvs_table, has_subscribers ? sub_list : NULL, data,
+                          len, num_threads);
+  safe_rdwrunlock(&kvs_table->global_lock);
+  enforce_budget(sub_list);
+
+  free(raw);
+  close_reader(&reader);
+  return result;
+}
+
 void kvs_wait(unsigned int delay_ms) {
   struct timespec delay = delay_to_timespec(delay_ms);
   nanosleep(&delay, NULL);
@@ -6,7 +6,22 @@
 #include <stddef.h>
 
 #include "constants.h"
+#include "io.h"
 #include "kvs.h"
+#include "skiplist.h"
+
+/// Kind of a command queued in a transaction.
+typedef enum { TX_READ, TX_WRITE, TX_DELETE } TxKind;
+
+/// Command queued in a transaction, whose slices stay owned by the caller.
+typedef struct {
+  TxKind kind;
+  size_t num_pairs;
+  const Slice *keys;
+  const uint64_t *hashes; // hash_key of each key, NULL to hash them when run
+  const Slice *values;    // Values of a WRITE
+  unsigned int ttl_ms;    // TTL of a WRITE, 0 if its pairs never expire
+} TxCommand;
 
 /*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
 
@@ -18,21 +33,28 @@
 /// @return 0 if the buffer is written successfully, 1 otherwise.
 int write_to_file(int out_fd, const char *buf);
 
+/// Compares two keys alphabetically, ignoring case.
+/// @param a First key.
+/// @param b Second key.
+/// @return Negative if a comes first, positive if b comes first, 0 otherwise.
+int compare_keys(Slice a, Slice b);
+
+/// Compares two keys alphabetically, ignoring case, and breaks ties between
+/// keys that only differ in case by their bytes. This is the order of SHOW
+/// and of the key index.
+/// @param a First key.
+/// @param b Second key.
+/// @return Negative if a comes first, positive if b comes first, 0 if they
+///         are the same key.
+int order_keys(Slice a, Slice b);
+
 /// Creates an array of indices that sorts the keys in alphabetical order.
 /// Sorting is case-insensitive.
-/// @param keys Array of key strings to sort.
+/// @param keys Array of keys to sort.
 /// @param num_pairs Number of keys in the array.
 /// @return Pointer to the dynamically allocated array of sorted indices,
 ///         or NULL if memory allocation fails.
-int *create_alphabetical_index(char keys[][MAX_STRING_SIZE], size_t num_pairs);
-
-/// Prints the contents of the key-value store's table to the specified output
-/// file. Each key-value pair is written in the format "(key, value)", followed
-/// by a newline. The function iterates over the entire table and writes the
-/// data to the provided file descriptor.
-/// @param fd File descriptor to which the key-value pairs will be written.
-/// @return 0 on success, or 1 if there is an error writing to the file.
-int printTable(int fd);
+int *create_alphabetical_index(const Slice *keys, size_t num_pairs);
 
 /*-------------------------TABLE SETTERS/GETTERS-----------------------------*/
 
@@ -55,10 +77,18 @@ void unlock_table();
 /// and determines whether it is currently stored.
 /// @param key The key to search for in the hashtable. Must be a null-terminated 
 ///            string.
+/// @param key_hash Hash of the key.
 /// @return 1 if the key exists, 0 otherwise.
-/// @note The caller must ensure that the hashtable is locked for reading or 
-///       writing when calling this function to maintain thread safety.
-int key_exists(char *key);
+/// @note Keys ruled out by the table's Bloom filter are answered without
+///       taking any lock.
+int key_exists(const char *key, uint64_t key_hash);
+
+/// Gets the feed sequence number of the last change of a key, which a client
+/// subscribing to it is sent, so it knows which changes it has seen.
+/// @param key Key to look for, null-terminated.
+/// @return Sequence number of the change, 0 without a feed or if the key
+///         doesn't exist.
+uint64_t key_change_seq(const char *key);
 
 /*-----------------------------SAFE FUNCTIONS--------------------------------*/
 
@@ -117,14 +147,43 @@ void write_response(int resp_fd, char op_code, char result);
 /// @param value The value related to the key (max 40 chars). NULL for deletions
 ///              and termination.
 /// @param type 0 for update, 1 for delete, 2 for termination.
-void write_notification(int notif_fd, const char *key, const char *value, 
-                        int type);
+/// @param seq Feed sequence number of the change, sent after the value as a
+///            native uint64. 0 without a feed or for termination.
+void write_notification(int notif_fd, const char *key, const char *value,
+                        int type, uint64_t seq);
 
 /*-------------------------------OPERATIONS----------------------------------*/
 
 /// Initializes the KVS state.
+/// @param sub_list Where the subscription list notified of expired pairs is
+///                 kept. It is read again at every expiry, since it may be
+///                 replaced meanwhile.
 /// @return 0 if the KVS state was initialized successfully, 1 otherwise.
-int kvs_init();
+int kvs_init(SubscriptionList **sub_list);
+
+/// Caps the memory taken by the pairs of the KVS. Once a write goes over the
+/// budget, pairs not used lately are evicted until it fits again, with their
+/// subscribers notified as for a DELETE.
+/// @param budget Bytes of nodes, keys and values allowed, 0 for no limit.
+void kvs_set_memory_budget(size_t budget);
+
+/// Coalesces the notifications of counter updates: instead of one per
+/// update, the subscribers of a counter get its latest value once the
+/// interval after its first pending update is over.
+/// @param interval_ms Milliseconds between notifications, 0 to notify every
+///                    update at once.
+void kvs_set_notice_interval(unsigned int interval_ms);
+
+/// Keeps the values every key held before its current one, up to a number
+/// per key, for reads at a version. Must be set before any pair is written.
+/// @param len Older values kept per key, 0 to keep none.
+void kvs_set_history(size_t len);
+
+/// Keeps a feed of every insert, update and delete of the KVS, which clients
+/// can tail from any change it still keeps. Must be set before any pair is
+/// written.
+/// @param cap Number of changes kept.
+void kvs_set_feed(size_t cap);
 
 /// Destroys the KVS state.
 /// @return 0 if the KVS state was terminated successfully, 1 otherwise.
@@ -132,36 +191,227 @@ int kvs_terminate();
 
 /// Writes a key value pair to the KVS. If key already exists it is updated.
 /// @param num_pairs Number of pairs being written.
-/// @param keys Array of keys' strings.
-/// @param values Array of values' strings.
+/// @param keys Array of keys' slices.
+/// @param values Array of values' slices.
+/// @param ttl_ms Milliseconds until the pairs expire, 0 if they never do.
+/// @return 0 if the pairs were written successfully, 1 otherwise.
+int kvs_write(size_t num_pairs, const Slice *keys, const Slice *values,
+              unsigned int ttl_ms, SubscriptionList *sub_list);
+
+/// Writes the pairs of consecutive WRITE commands to the KVS, locking every
+/// bucket they use once. The pairs are written exactly as if each command was
+/// given to kvs_write in turn, notifications included.
+/// @param num_commands Number of commands in the batch.
+/// @param num_pairs Number of pairs of each command.
+/// @param keys Keys of every command, one command after the other.
+/// @param known_hashes hash_key of every key, e.g. read from a compiled job
+///                     file, NULL to hash the keys here.
+/// @param values Values of every command, one command after the other.
+/// @param ttl_ms TTL of each command in milliseconds, 0 for none. Expiries
+///               are kept on the timer's wheel, so each costs O(1) and no
+///               scan of the table is ever needed.
 /// @return 0 if the pairs were written successfully, 1 otherwise.
-int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE],
-              char values[][MAX_STRING_SIZE], SubscriptionList *sub_list);
+int kvs_write_batch(size_t num_commands, const size_t *num_pairs,
+                    const Slice *keys, const uint64_t *known_hashes,
+                    const Slice *values, const unsigned int *ttl_ms,
+                    SubscriptionList *sub_list);
+
+/// Writes a pair atomically under its bucket lock, if the key holds the
+/// expected value (CAS) or doesn't exist (PUTNX).
+/// @param key Key of the pair.
+/// @param known_hash hash_key of the key, NULL to hash it here.
+/// @param expected Value the key must hold, NULL if it must not exist.
+/// @param value Value to be written.
+/// @param sub_list Subscription list to notify of the write.
+/// @return 0 if the pair was written, 1 if the key holds another value or
+///         exists, 2 if the key doesn't exist but was expected to, -1 if the
+///         key is invalid or the write failed.
+int kvs_cas(Slice key, const uint64_t *known_hash, const Slice *expected,
+            Slice value, SubscriptionList *sub_list);
+
+/// Adds a delta to a counter atomically under its bucket lock. A missing key
+/// counts as 0.
+/// @param key Key of the counter.
+/// @param known_hash hash_key of the key, NULL to hash it here.
+/// @param delta Value to be added.
+/// @param result Where the new value of the counter is stored.
+/// @param sub_list Subscription list to notify of the update.
+/// @return 0 if the counter was updated, 1 if the key holds something else
+///         or the sum overflows, -1 if the key is invalid or the update
+///         failed.
+int kvs_add(Slice key, const uint64_t *known_hash, int64_t delta,
+            int64_t *result, SubscriptionList *sub_list);
 
 /// Reads values from the KVS.
 /// @param num_pairs Number of pairs to read.
-/// @param keys Array of keys' strings.
-/// @param fd File descriptor to write the (successful) output.
+/// @param keys Array of keys' slices.
+/// @param known_hashes hash_key of every key, NULL to hash the keys here.
+/// @param out Output buffer to write the (successful) output.
 /// @return 0 if the key reading, 1 otherwise.
-int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd);
+int kvs_read(size_t num_pairs, const Slice *keys,
+             const uint64_t *known_hashes, OutputBuffer *out);
+
+/// Reads values as they were at a version: the newest value each key kept
+/// that isn't newer, written as "(key@version,value)". A missing key is
+/// written as KVSERROR, and a key keeping only newer values as KVSNOVERSION.
+/// @param num_pairs Number of pairs to read.
+/// @param keys Array of keys' slices.
+/// @param known_hashes hash_key of every key, NULL to hash the keys here.
+/// @param version Version to read at.
+/// @param out Output buffer to write the output.
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read_at(size_t num_pairs, const Slice *keys,
+                const uint64_t *known_hashes, uint64_t version,
+                OutputBuffer *out);
+
+/// Writes the values a key keeps, newest first, as "(key@version,value)".
+/// A missing key is written as KVSERROR.
+/// @param key Key whose values will be written.
+/// @param known_hash hash_key of the key, NULL to hash it here.
+/// @param limit Maximum number of values, 0 for every one kept.
+/// @param out Output buffer to write the output.
+/// @return 0 if the key was read, 1 otherwise.
+int kvs_history(Slice key, const uint64_t *known_hash, size_t limit,
+                OutputBuffer *out);
+
+/// Sends a client the changes of the feed from a sequence number on, then
+/// every new change, through its notification pipe. A client that falls a
+/// whole pipe behind stops being sent changes.
+/// @param notif_fd Notification pipe of the client.
+/// @param notif_path Path of the notification pipe of the client.
+/// @param from_seq First change to be sent, 0 for the next one.
+/// @param start Where the first change to be sent is stored, or the oldest
+///              one kept if from_seq isn't.
+/// @return 0 on success, 1 if from_seq isn't kept anymore, 2 if there is no
+///         feed or the client can't tail it.
+int kvs_tail(int notif_fd, const char *notif_path, uint64_t from_seq,
+             uint64_t *start);
+
+/// Resumes the subscriptions of a client that reconnected: it is subscribed
+/// to every key again, then sent the last change of each key it missed, as
+/// found in the feed.
+/// @param notif_fd Notification pipe of the client.
+/// @param keys Keys the client was subscribed to.
+/// @param after Sequence number of the last notification of each key the
+///              client got, 0 if none.
+/// @param count Number of keys, at most MAX_NUMBER_SUB.
+/// @param status Where the result of each key is stored: 0 if the client is
+///               caught up, 1 if it was subscribed but may have missed
+///               changes the feed no longer keeps, or there is no feed, so
+///               it must read the key again, 2 if the key doesn't exist.
+/// @param sub_list Subscription list the client is added to.
+/// @return 0 if every key is caught up, 1 otherwise.
+int kvs_resume(int notif_fd, char keys[][MAX_STRING_SIZE],
+               const uint64_t *after, size_t count, char *status,
+               SubscriptionList *sub_list);
+
+/// Stops sending the changes of the feed to a client, if it was tailing it.
+/// @param notif_fd Notification pipe of the client.
+void kvs_untail(int notif_fd);
+
+/// Stops sending the changes of the feed to every client.
+void kvs_untail_all();
 
 /// Deletes key value pairs from the KVS.
 /// @param num_pairs Number of pairs to read.
-/// @param keys Array of keys' strings.
+/// @param keys Array of keys' slices.
+/// @param out Output buffer to write the missing keys.
+/// @return 0 if the pairs were deleted successfully, 1 otherwise.
+int kvs_delete(size_t num_pairs, const Slice *keys, OutputBuffer *out,
+               SubscriptionList *sub_list);
+
+/// Deletes the keys of consecutive DELETE commands from the KVS, locking every
+/// bucket they use once. The output is the same as giving each command to
+/// kvs_delete in turn.
+/// @param num_commands Number of commands in the batch.
+/// @param num_pairs Number of keys of each command.
+/// @param keys Keys of every command, one command after the other.
+/// @param known_hashes hash_key of every key, NULL to hash the keys here.
+/// @param out Output buffer to write the missing keys.
 /// @return 0 if the pairs were deleted successfully, 1 otherwise.
-int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd, 
-    SubscriptionList *sub_list);
+int kvs_delete_batch(size_t num_commands, const size_t *num_pairs,
+                     const Slice *keys, const uint64_t *known_hashes,
+                     OutputBuffer *out, SubscriptionList *sub_list);
+
+/// Runs the commands of a transaction atomically. The buckets of every key
+/// are write locked in a single ordered pass, then the commands run in order
+/// against a staged copy of their keys, each seeing the changes of the ones
+/// before. The memory of every change is allocated before the table is
+/// modified, so either every change is committed or none is. Subscribers are
+/// notified once every change is committed, once per key. READ and DELETE
+/// output is the same as kvs_read and kvs_delete would write.
+/// @param num_commands Number of commands.
+/// @param commands Commands of the transaction, in order.
+/// @param out Output buffer to write the output of a committed transaction.
+/// @param sub_list Subscription list to notify of the committed changes.
+/// @return 0 if the transaction was committed, 1 if memory couldn't be
+///         allocated, in which case nothing is written or output.
+int kvs_transaction(size_t num_commands, const TxCommand *commands,
+                    OutputBuffer *out, SubscriptionList *sub_list);
+
+/// Writes the state of the KVS as "(key, value)" lines sorted by key. The
+/// pairs are copied at once with the buckets read locked, then sorted and
+/// merged into the output without holding any lock.
+/// @param out Output buffer to write the output.
+/// @param num_threads Maximum number of threads sorting the pairs.
+/// @return 0 if the state was written successfully, 1 otherwise.
+int kvs_show(OutputBuffer *out, int num_threads);
+
+/// Visits the pairs whose keys are between start and end, both included, in
+/// the order of order_keys. The callback runs with every bucket read locked,
+/// but only SCAN_CHUNK_SIZE pairs at a time: writes run between them, so a
+/// pair written or deleted meanwhile after the last key visited may or may
+/// not be visited.
+/// @param start First key of the range.
+/// @param end Last key of the range.
+/// @param limit Maximum number of pairs to visit, 0 for no limit.
+/// @param callback Function called for every pair until it returns nonzero.
+/// @param arg Argument given to the callback.
+/// @return 0 if the range was scanned successfully, 1 otherwise.
+int kvs_scan(Slice start, Slice end, size_t limit, SkipListCallback callback,
+             void *arg);
 
-/// Writes the state of the KVS.
-/// @param fd File descriptor to write the output.
-/// @return 0 if the backup was successful, 1 otherwise.
-int kvs_show(int fd);
+/// Visits the pairs whose keys start with a prefix, in the order of
+/// order_keys, with the same locking as kvs_scan.
+/// @param prefix Prefix of the keys, matched with case.
+/// @param limit Maximum number of pairs to visit, 0 for no limit.
+/// @param callback Function called for every pair until it returns nonzero.
+/// @param arg Argument given to the callback.
+/// @return 0 if the keys were scanned successfully, 1 otherwise.
+int kvs_prefix(Slice prefix, size_t limit, SkipListCallback callback,
+               void *arg);
+
+/// Writes the state of the KVS to a file, in the same format and order as
+/// kvs_show. The file can be loaded back with kvs_load.
+/// @param path Path of the file, created or truncated.
+/// @param num_threads Maximum number of threads sorting the pairs.
+/// @return 0 if the file was written successfully, 1 otherwise.
+int kvs_export(const char *path, int num_threads);
 
 /// Creates a backup of the KVS state and stores it in the correspondent
-/// backup file
-/// @param fd File descriptor to write the output.
-/// @return 0 if the backup was successful, 1 otherwise.
-int kvs_backup(int bck_fd);
+/// backup file. The table is copied while locked and the copy is handed to
+/// the backup workers, so the call returns before the backup is written.
+/// @param bck_fd File descriptor to write the output, owned by the workers
+///               from now on.
+/// @param mft_fd File descriptor to write the manifest, -1 to skip it.
+/// @return 0 if the backup was queued successfully, 1 otherwise.
+int kvs_backup(int bck_fd, int mft_fd);
+
+/// Restores the pairs of a backup file, compressed or not, into the KVS.
+/// Every bucket ends up with its pairs in the same order as in the backup.
+/// @param fd File descriptor of the backup file.
+/// @param sub_list Subscription list to notify of overwritten pairs.
+/// @return 0 if the backup was restored successfully, 1 otherwise.
+int kvs_restore(int fd, SubscriptionList *sub_list);
+
+/// Loads the "(key, value)" lines of a file, compressed or not, into the KVS,
+/// with the same result as writing the pairs one at a time in order. The
+/// lines are parsed and the buckets written by up to num_threads threads.
+/// @param path Path of the file to be loaded.
+/// @param num_threads Maximum number of threads to use.
+/// @param sub_list Subscription list to notify of overwritten pairs.
+/// @return 0 if the file was loaded successfully, 1 otherwise.
+int kvs_load(const char *path, int num_threads, SubscriptionList *sub_list);
 
 /// Waits for the last backup to be called.
 void kvs_wait_backup();
@@ -1,21 +1,120 @@
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "constants.h"
 #include "parser.h"
 
-static int read_string(int fd, char *buffer, size_t max) {
-  ssize_t bytes_read;
+#define MAX_VERSION_DIGITS 20 // Digits of the largest 64-bit version
+
+/// Reads up to count bytes from a reader, only returning less than that at the
+/// end of the file.
+/// @param reader Reader to read from.
+/// @param dest Buffer where the bytes will be stored.
+/// @param count Number of bytes to read.
+/// @return Number of bytes read.
+static size_t read_bytes(JobReader *reader, char *dest, size_t count) {
+  size_t available = reader->len - reader->pos;
+  if (count > available) {
+    count = available;
+  }
+  memcpy(dest, reader->data + reader->pos, count);
+  reader->pos += count;
+  return count;
+}
+
+/// Reads a single byte from a reader.
+/// @param reader Reader to read from.
+/// @param ch Pointer where the byte will be stored.
+/// @return 1 if a byte was read, 0 on end of file.
+static int read_char(JobReader *reader, char *ch) {
+  if (reader->pos == reader->len) {
+    return 0;
+  }
+  *ch = reader->data[reader->pos++];
+  return 1;
+}
+
+int init_reader(JobReader *reader, int fd) {
+  reader->data = NULL;
+  reader->len = 0;
+  reader->pos = 0;
+  reader->mapped = 0;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    return 1;
+  }
+
+  if (S_ISREG(st.st_mode)) {
+    if (st.st_size == 0) {
+      return 0;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      reader->data = data;
+      reader->len = (size_t)st.st_size;
+      reader->mapped = 1;
+      return 0;
+    }
+  }
+
+  // Not mappable, read it whole so slices stay valid until the reader closes
+  size_t capacity = 0;
+  char *buffer = NULL;
+  while (1) {
+    if (reader->len == capacity) {
+      capacity = capacity ? capacity * 2 : JOB_READ_BUFFER_SIZE;
+      char *grown = realloc(buffer, capacity);
+      if (grown == NULL) {
+        free(buffer);
+        return 1;
+      }
+      buffer = grown;
+    }
+    ssize_t bytes_read = read(fd, buffer + reader->len, capacity - reader->len);
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      break;
+    }
+    reader->len += (size_t)bytes_read;
+  }
+  reader->data = buffer;
+  return 0;
+}
+
+void close_reader(JobReader *reader) {
+  if (reader->mapped) {
+    munmap((void *)reader->data, reader->len);
+  } else {
+    free((void *)reader->data);
+  }
+  reader->data = NULL;
+  reader->len = 0;
+  reader->pos = 0;
+}
+
+/// Reads a key or value up to the next delimiter, without copying it.
+/// @param reader Reader to read from.
+/// @param slice Slice that will point to the string inside the reader.
+/// @param max Maximum string size, including the terminator of the original
+///            buffers.
+/// @return 0 if the string ended in ',', 1 if in ')', 2 if in ']', -1 on
+///         error.
+static int read_string(JobReader *reader, Slice *slice, size_t max) {
+  const char *start = reader->data + reader->pos;
   char ch;
   size_t i = 0;
   int value = -1;
 
   while (i < max) {
-    bytes_read = read(fd, &ch, 1);
-
-    if (bytes_read <= 0) {
+    if (read_char(reader, &ch) != 1) {
       return -1;
     }
 
@@ -34,20 +133,26 @@ static int read_string(int fd, char *buffer, size_t max) {
       break;
     }
 
-    buffer[i++] = ch;
+    i++;
   }
 
-  buffer[i] = '\0';
+  slice->ptr = start;
+  slice->len = i;
 
   return value;
 }
 
-static int read_uint(int fd, unsigned int *value, char *next) {
+static int read_uint(JobReader *reader, unsigned int *value, char *next) {
   char buf[16];
 
   int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (i == (int)sizeof(buf) - 1) {
+      *next = '\0';
+      return 1;
+    }
+
+    if (read_char(reader, buf + i) == 0) {
       *next = '\0';
       break;
     }
@@ -73,23 +178,58 @@ static int read_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-static void cleanup(int fd) {
+static void cleanup(JobReader *reader) {
   char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
+  while (read_char(reader, &ch) == 1 && ch != '\n')
     ;
 }
 
-enum Command get_next(int fd) {
+/// Reads a word up to the next space or the end of the line, without copying
+/// it.
+/// @param reader Reader to read from.
+/// @param word Slice that will point to the word inside the reader.
+/// @param max Maximum word size, including the terminator of the original
+///            buffers.
+/// @return The character that ended the word, '\0' at the end of the file,
+///         or -1 if the word is empty or too long. A newline ending an
+///         invalid word is left for cleanup.
+static int read_word(JobReader *reader, Slice *word, size_t max) {
+  const char *start = reader->data + reader->pos;
+  size_t i = 0;
+  char ch = '\0';
+
+  while (read_char(reader, &ch) == 1 && ch != ' ' && ch != '\n') {
+    if (++i == max) {
+      return -1;
+    }
+    ch = '\0';
+  }
+
+  if (i == 0) {
+    if (ch == '\n') {
+      reader->pos--;
+    }
+    return -1;
+  }
+
+  word->ptr = start;
+  word->len = i;
+  return ch;
+}
+
+enum Command get_next(JobReader *reader) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (read_char(reader, buf) != 1) {
     return EOC;
   }
 
   switch (buf[0]) {
   case 'W':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-      if (read(fd, buf + 5, 1) != 1 || strncmp(buf, "WRITE ", 6) != 0) {
-        cleanup(fd);
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "WAIT ", 5) != 0) {
+      if (read_bytes(reader, buf + 5, 1) != 1 ||
+          strncmp(buf, "WRITE ", 6) != 0) {
+        cleanup(reader);
         return CMD_INVALID;
       }
       return CMD_WRITE;
@@ -98,116 +238,234 @@ enum Command get_next(int fd) {
     return CMD_WAIT;
 
   case 'R':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "READ ", 5) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_READ;
 
   case 'D':
-    if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "DECR ", 5) != 0) {
+      if (read_bytes(reader, buf + 5, 2) != 2 ||
+          strncmp(buf, "DELETE ", 7) != 0) {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+      return CMD_DELETE;
+    }
+
+    return CMD_DECR;
+
+  case 'I':
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "INCR ", 5) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    return CMD_INCR;
+
+  case 'A':
+    if (read_bytes(reader, buf + 1, 3) != 3 ||
+        strncmp(buf, "ADD ", 4) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    return CMD_DELETE;
+    return CMD_ADD;
 
   case 'S':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "SHOW", 4) != 0) {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 1, 3) != 3) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    if (strncmp(buf, "SCAN", 4) == 0) {
+      if (read_bytes(reader, buf + 4, 1) != 1 || buf[4] != ' ') {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+      return CMD_SCAN;
+    }
+
+    if (strncmp(buf, "SHOW", 4) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 4, 1) != 0 && buf[4] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_SHOW;
 
   case 'B':
-    if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "BACKUP", 6) != 0) {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 1, 5) != 5 ||
+        strncmp(buf, "BACKUP", 6) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 6, 1) != 0 && buf[6] != '\n') {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 6, 1) != 0 && buf[6] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_BACKUP;
 
   case 'H':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-      cleanup(fd);
+    if (read_bytes(reader, buf + 1, 3) != 3) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    if (strncmp(buf, "HIST", 4) == 0) {
+      if (read_bytes(reader, buf + 4, 4) != 4 ||
+          strncmp(buf, "HISTORY ", 8) != 0) {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+      return CMD_HISTORY;
+    }
+
+    if (strncmp(buf, "HELP", 4) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    if (read_bytes(reader, buf + 4, 1) != 0 && buf[4] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_HELP;
 
+  case 'L':
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "LOAD ", 5) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    return CMD_LOAD;
+
+  case 'E':
+    if (read_bytes(reader, buf + 1, 3) != 3) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    if (strncmp(buf, "EXEC", 4) == 0) {
+      if (read_bytes(reader, buf + 4, 1) != 0 && buf[4] != '\n') {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+      return CMD_EXEC;
+    }
+
+    if (read_bytes(reader, buf + 4, 3) != 3 ||
+        strncmp(buf, "EXPORT ", 7) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    return CMD_EXPORT;
+
+  case 'M':
+    if (read_bytes(reader, buf + 1, 4) != 4 ||
+        strncmp(buf, "MULTI", 5) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    if (read_bytes(reader, buf + 5, 1) != 0 && buf[5] != '\n') {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    return CMD_MULTI;
+
+  case 'P':
+    if (read_bytes(reader, buf + 1, 5) != 5 ||
+        strncmp(buf, "PUTNX ", 6) != 0) {
+      if (read_bytes(reader, buf + 6, 1) != 1 ||
+          strncmp(buf, "PREFIX ", 7) != 0) {
+        cleanup(reader);
+        return CMD_INVALID;
+      }
+      return CMD_PREFIX;
+    }
+
+    return CMD_PUTNX;
+
+  case 'C':
+    if (read_bytes(reader, buf + 1, 3) != 3 ||
+        strncmp(buf, "CAS ", 4) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    return CMD_CAS;
+
   case '#':
-    cleanup(fd);
+    cleanup(reader);
     return CMD_EMPTY;
 
   case '\n':
     return CMD_EMPTY;
 
   default:
-    cleanup(fd);
+    cleanup(reader);
     return CMD_INVALID;
   }
 }
 
-int parse_pair(int fd, char *key, char *value) {
-  if (read_string(fd, key, MAX_STRING_SIZE) != 0) {
-    cleanup(fd);
+static int parse_pair(JobReader *reader, Slice *key, Slice *value,
+                      size_t max_string_size) {
+  if (read_string(reader, key, max_string_size) != 0) {
+    cleanup(reader);
     return 0;
   }
 
-  if (read_string(fd, value, MAX_STRING_SIZE) != 1) {
-    cleanup(fd);
+  if (read_string(reader, value, max_string_size) != 1) {
+    cleanup(reader);
     return 0;
   }
 
   return 1;
 }
 
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE],
-                   char values[][MAX_STRING_SIZE], size_t max_pairs,
-                   size_t max_string_size) {
+size_t parse_write(JobReader *reader, Slice *keys, Slice *values,
+                   size_t max_pairs, size_t max_string_size,
+                   unsigned int *ttl_ms) {
   char ch;
+  *ttl_ms = 0;
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1 || ch != '[') {
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '(') {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1 || ch != '(') {
+    cleanup(reader);
     return 0;
   }
 
   size_t num_pairs = 0;
-  char key[max_string_size];
-  char value[max_string_size];
   while (num_pairs < max_pairs) {
-    if (parse_pair(fd, key, value) == 0) {
-      cleanup(fd);
+    if (parse_pair(reader, &keys[num_pairs], &values[num_pairs],
+                   max_string_size) == 0) {
+      cleanup(reader);
       return 0;
     }
+    num_pairs++;
 
-    strcpy(keys[num_pairs], key);
-    strcpy(values[num_pairs++], value);
-
-    if (read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
-      cleanup(fd);
+    if (read_char(reader, &ch) != 1 || (ch != '(' && ch != ']')) {
+      cleanup(reader);
       return 0;
     }
 
@@ -217,37 +475,94 @@ size_t parse_write(int fd, char keys[][MAX_STRING_SIZE],
   }
 
   if (num_pairs == max_pairs) {
-    cleanup(fd);
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1) {
+    cleanup(reader);
+    return 0;
+  }
+
+  if (ch == ' ') {
+    // The trailer can end the line anywhere, so the newline is only skipped
+    // when it wasn't read yet
+    Slice word;
+    int next = read_word(reader, &word, sizeof("TTL"));
+    if (next != ' ' || word.len != 3 || strncmp(word.ptr, "TTL", 3) != 0) {
+      if (next == -1 || next == ' ') {
+        cleanup(reader);
+      }
+      return 0;
+    }
+    if (read_uint(reader, ttl_ms, &ch) != 0 || *ttl_ms == 0) {
+      if (ch != '\n') {
+        cleanup(reader);
+      }
+      return 0;
+    }
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(reader);
     return 0;
   }
 
   return num_pairs;
 }
 
-size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
-                         size_t max_string_size) {
+/// Reads the "@<version>" ending a READ, up to the end of the line.
+/// @param reader Reader positioned at the '@'.
+/// @param version Slice that will point to the digits of the version.
+/// @return 0 if a version was read, -1 on error.
+static int read_version(JobReader *reader, Slice *version) {
+  Slice word;
+  int next = read_word(reader, &word, MAX_VERSION_DIGITS + 2);
+  uint64_t parsed;
+  if (next == -1 || next == ' ') {
+    cleanup(reader);
+    return -1;
+  }
+  version->ptr = word.ptr + 1;
+  version->len = word.len - 1;
+  return word.ptr[0] == '@' && parse_version(*version, &parsed) == 0 ? 0 : -1;
+}
+
+size_t parse_read_delete(JobReader *reader, Slice *keys, size_t max_keys,
+                         size_t max_string_size, Slice *version) {
   char ch;
+  if (version != NULL) {
+    *version = (Slice){NULL, 0};
+  }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1) {
+    cleanup(reader);
     return 0;
   }
 
+  if (ch != '[') {
+    // Only a single key read at a version goes without brackets
+    reader->pos--;
+    int next = version != NULL
+                   ? read_word(reader, &keys[0], max_string_size)
+                   : -1;
+    if (next != ' ') {
+      if (next == -1) {
+        cleanup(reader);
+      }
+      return 0;
+    }
+    return read_version(reader, version) == 0 ? 1 : 0;
+  }
+
   size_t num_keys = 0;
-  char key[max_string_size];
   while (num_keys < max_keys) {
-    int output = read_string(fd, key, max_string_size);
+    int output = read_string(reader, &keys[num_keys], max_string_size);
     if (output < 0 || output == 1) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
-
-    strcpy(keys[num_keys++], key);
+    num_keys++;
 
     if (output == 2) {
       break;
@@ -255,34 +570,44 @@ size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
   }
 
   if (num_keys == max_keys) {
-    cleanup(fd);
+    cleanup(reader);
     return 0;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_char(reader, &ch) != 1) {
+    cleanup(reader);
+    return 0;
+  }
+
+  if (ch == ' ' && version != NULL) {
+    return read_version(reader, version) == 0 ? num_keys : 0;
+  }
+
+  if (ch != '\n' && ch != '\0') {
+    cleanup(reader);
     return 0;
   }
 
   return num_keys;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(JobReader *reader, unsigned int *delay,
+               unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (read_uint(reader, delay, &ch) != 0) {
+    cleanup(reader);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(reader);
       return -1;
     }
 
@@ -290,7 +615,130 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
+
+int parse_path(JobReader *reader, Slice *path, size_t max_path_size) {
+  const char *start = reader->data + reader->pos;
+  size_t available = reader->len - reader->pos;
+  const char *newline = memchr(start, '\n', available);
+  size_t len = newline ? (size_t)(newline - start) : available;
+  reader->pos += newline ? len + 1 : len;
+
+  if (len == 0 || len >= max_path_size || memchr(start, '\0', len) != NULL) {
+    return -1;
+  }
+
+  path->ptr = start;
+  path->len = len;
+  return 0;
+}
+
+int parse_scan(JobReader *reader, Slice *start, Slice *end, unsigned int *limit,
+               size_t max_string_size) {
+  *limit = 0;
+  int next = read_word(reader, start, max_string_size);
+  if (next != ' ') {
+    if (next == -1) {
+      cleanup(reader);
+    }
+    return -1;
+  }
+
+  next = read_word(reader, end, max_string_size);
+  if (next == ' ') {
+    char ch;
+    size_t pos = reader->pos;
+    int failed = read_uint(reader, limit, &ch);
+    size_t digits = reader->pos - pos - (ch == '\0' ? 0 : 1);
+    if (failed || digits == 0 || (ch != '\n' && ch != '\0')) {
+      if (ch != '\n') {
+        cleanup(reader);
+      }
+      return -1;
+    }
+  } else if (next == -1) {
+    cleanup(reader);
+    return -1;
+  }
+
+  return 0;
+}
+
+int parse_prefix(JobReader *reader, Slice *prefix, size_t max_string_size) {
+  int next = read_word(reader, prefix, max_string_size);
+  if (next == '\n' || next == '\0') {
+    return 0;
+  }
+  cleanup(reader);
+  return -1;
+}
+
+int parse_cas(JobReader *reader, Slice *key, Slice *expected, Slice *value,
+              size_t max_string_size) {
+  Slice *words[] = {key, expected, value};
+  for (int i = 0; i < 3; i++) {
+    if (words[i] == NULL) {
+      continue;
+    }
+    int next = read_word(reader, words[i], max_string_size);
+    int last = i == 2;
+    if (next == -1 || (last && next == ' ')) {
+      cleanup(reader);
+      return -1;
+    }
+    if (last != (next != ' ')) {
+      return -1; // The line ended before the last word
+    }
+  }
+  return 0;
+}
+
+int parse_add(JobReader *reader, Slice *key, Slice *delta,
+              size_t max_string_size) {
+  int next = read_word(reader, key, max_string_size);
+  if (delta != NULL) {
+    if (next != ' ') {
+      if (next == -1) {
+        cleanup(reader);
+      }
+      return -1;
+    }
+    next = read_word(reader, delta, max_string_size);
+  }
+
+  if (next == -1 || next == ' ') {
+    cleanup(reader);
+    return -1;
+  }
+  int64_t value;
+  if (delta != NULL && parse_counter(*delta, &value)) {
+    return -1;
+  }
+  return 0;
+}
+
+int parse_history(JobReader *reader, Slice *key, unsigned int *limit,
+                  size_t max_string_size) {
+  *limit = 0;
+  int next = read_word(reader, key, max_string_size);
+  if (next == ' ') {
+    char ch;
+    size_t pos = reader->pos;
+    int failed = read_uint(reader, limit, &ch);
+    size_t digits = reader->pos - pos - (ch == '\0' ? 0 : 1);
+    if (failed || digits == 0 || (ch != '\n' && ch != '\0')) {
+      if (ch != '\n') {
+        cleanup(reader);
+      }
+      return -1;
+    }
+  } else if (next == -1) {
+    cleanup(reader);
+    return -1;
+  }
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 #define KVS_PARSER_H
 
 #include "constants.h"
+#include "keys.h"
 #include <stddef.h>
 
 enum Command {
@@ -12,43 +13,137 @@ enum Command {
   CMD_WAIT,
   CMD_BACKUP,
   CMD_HELP,
+  CMD_LOAD,
+  CMD_EXPORT,
+  CMD_SCAN,
+  CMD_PREFIX,
+  CMD_CAS,
+  CMD_PUTNX,
+  CMD_INCR,
+  CMD_DECR,
+  CMD_ADD,
+  CMD_MULTI,
+  CMD_EXEC,
+  CMD_HISTORY,
   CMD_EMPTY,
   CMD_INVALID,
   EOC // End of commands
 };
 
-/// Reads a line and returns the corresponding command.
+/// Reader over a job file mapped in memory. Parsed keys and values are slices
+/// into the mapping, so they stay valid until the reader is closed.
+typedef struct {
+  const char *data; // Contents of the job file
+  size_t len;       // Number of bytes in data
+  size_t pos;       // Position of the next byte to be parsed
+  int mapped;       // Set if data is a mapping, otherwise it is heap memory
+} JobReader;
+
+/// Initializes a reader over the given file descriptor, mapping the file in
+/// memory or reading it whole when it can't be mapped.
+/// @param reader Reader to be initialized.
 /// @param fd File descriptor to read from.
+/// @return 0 if the reader was initialized successfully, 1 otherwise.
+int init_reader(JobReader *reader, int fd);
+
+/// Releases the contents of a reader, invalidating every slice into them.
+/// @param reader Reader to be closed.
+void close_reader(JobReader *reader);
+
+/// Reads a line and returns the corresponding command.
+/// @param reader Reader to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(JobReader *reader);
 
-/// Parses a WRITE command.
-/// @param fd File descriptor to read from.
-/// @param keys Array of keys to be written.
-/// @param values Array of values to be written.
+/// Parses a WRITE command, optionally followed by "TTL <ms>".
+/// @param reader Reader to read from.
+/// @param keys Array of slices to store the keys to be written.
+/// @param values Array of slices to store the values to be written.
 /// @param max_pairs number of pairs to be written.
 /// @param max_string_size maximum size for keys and values.
-/// @return 0 if the command was parsed successfully, 1 otherwise.
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE],
-                   char values[][MAX_STRING_SIZE], size_t max_pairs,
-                   size_t max_string_size);
+/// @param ttl_ms Pointer to the variable to store the TTL in, 0 if none.
+/// @return Number of pairs parsed. 0 on failure.
+size_t parse_write(JobReader *reader, Slice *keys, Slice *values,
+                   size_t max_pairs, size_t max_string_size,
+                   unsigned int *ttl_ms);
 
-/// Parses a READ or DELETE command.
-/// @param fd File descriptor to read from.
-/// @param keys Array of keys to be written.
+/// Parses a READ or DELETE command. A READ may be followed by "@<version>",
+/// and a READ of a single key at a version may leave out the brackets.
+/// @param reader Reader to read from.
+/// @param keys Array of slices to store the keys to be read or deleted.
 /// @param max_keys number of keys to be iread or deleted.
 /// @param max_string_size maximum size for keys and values.
+/// @param version Slice that will point to the digits of the version, empty
+///                if none, or NULL for a DELETE.
 /// @return Number of keys read or deleted. 0 on failure.
-size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys,
-                         size_t max_string_size);
+size_t parse_read_delete(JobReader *reader, Slice *keys, size_t max_keys,
+                         size_t max_string_size, Slice *version);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not
 /// be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on
 /// error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(JobReader *reader, unsigned int *delay, unsigned int *thread_id);
+
+/// Parses a LOAD or EXPORT command.
+/// @param reader Reader to read from.
+/// @param path Slice that will point to the path, up to the end of the line.
+/// @param max_path_size Maximum size for the path, including a terminator.
+/// @return 0 if the path was parsed, -1 on error.
+int parse_path(JobReader *reader, Slice *path, size_t max_path_size);
+
+/// Parses a SCAN command: a first key, a last key and an optional limit,
+/// separated by spaces.
+/// @param reader Reader to read from.
+/// @param start Slice that will point to the first key.
+/// @param end Slice that will point to the last key.
+/// @param limit Pointer to the variable to store the limit in, 0 if none.
+/// @param max_string_size maximum size for keys.
+/// @return 0 if the command was parsed, -1 on error.
+int parse_scan(JobReader *reader, Slice *start, Slice *end, unsigned int *limit,
+               size_t max_string_size);
+
+/// Parses a PREFIX command.
+/// @param reader Reader to read from.
+/// @param prefix Slice that will point to the prefix.
+/// @param max_string_size maximum size for the prefix.
+/// @return 0 if the command was parsed, -1 on error.
+int parse_prefix(JobReader *reader, Slice *prefix, size_t max_string_size);
+
+/// Parses a CAS command, a key, the value it must hold and the value to be
+/// written, or a PUTNX command, a key and its value, separated by spaces.
+/// @param reader Reader to read from.
+/// @param key Slice that will point to the key.
+/// @param expected Slice that will point to the expected value of a CAS, NULL
+///                 for a PUTNX.
+/// @param value Slice that will point to the value to be written.
+/// @param max_string_size maximum size for keys and values.
+/// @return 0 if the command was parsed, -1 on error.
+int parse_cas(JobReader *reader, Slice *key, Slice *expected, Slice *value,
+              size_t max_string_size);
+
+/// Parses an INCR or DECR command, a key, or an ADD command, a key and a
+/// signed delta, separated by a space.
+/// @param reader Reader to read from.
+/// @param key Slice that will point to the key.
+/// @param delta Slice that will point to the delta of an ADD, checked to be
+///              a counter, NULL for an INCR or DECR.
+/// @param max_string_size maximum size for keys and deltas.
+/// @return 0 if the command was parsed, -1 on error.
+int parse_add(JobReader *reader, Slice *key, Slice *delta,
+              size_t max_string_size);
+
+/// Parses a HISTORY command: a key and an optional limit, separated by a
+/// space.
+/// @param reader Reader to read from.
+/// @param key Slice that will point to the key.
+/// @param limit Pointer to the variable to store the limit in, 0 if none.
+/// @param max_string_size maximum size for keys.
+/// @return 0 if the command was parsed, -1 on error.
+int parse_history(JobReader *reader, Slice *key, unsigned int *limit,
+                  size_t max_string_size);
 
 #endif // KVS_PARSER_H
@@ -0,0 +1,260 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "operations.h"
+#include "pool.h"
+
+typedef struct {
+  TaskFunction function;
+  void *arg;
+} Task;
+
+/// Circular double-ended queue of tasks.
+typedef struct {
+  Task *tasks;
+  size_t head;  // Index of the oldest task
+  size_t count; // Number of tasks in the deque
+  size_t cap;   // Number of slots in tasks
+  pthread_mutex_t lock;
+} TaskDeque;
+
+/*----------------------------GLOBAL VARIABLES-------------------------------*/
+
+static pthread_t *workers = NULL;
+static int num_workers = 0;
+
+// One deque per worker, plus the shared queue for external submissions
+static TaskDeque *deques = NULL;
+
+static size_t queued = 0;  // Tasks submitted and not taken by a worker yet
+static size_t pending = 0; // Tasks submitted and not finished yet
+static int stopping = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+
+// Index of the deque owned by the calling thread, -1 outside the pool
+static _Thread_local int worker_id = -1;
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+static void push_back(TaskDeque *deque, Task task) {
+  safe_mutex_lock(&deque->lock);
+  if (deque->count == deque->cap) {
+    size_t cap = deque->cap ? deque->cap * 2 : 16;
+    Task *tasks = safe_malloc(cap * sizeof(Task));
+    for (size_t i = 0; i < deque->count; i++) {
+      tasks[i] = deque->tasks[(deque->head + i) % deque->cap];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->head = 0;
+    deque->cap = cap;
+  }
+  deque->tasks[(deque->head + deque->count) % deque->cap] = task;
+  deque->count++;
+  safe_mutex_unlock(&deque->lock);
+}
+
+/// Takes the newest task of a deque.
+/// @return 1 if a task was taken, 0 if the deque is empty.
+static int pop_back(TaskDeque *deque, Task *task) {
+  int taken = 0;
+  safe_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    deque->count--;
+    *task = deque->tasks[(deque->head + deque->count) % deque->cap];
+    taken = 1;
+  }
+  safe_mutex_unlock(&deque->lock);
+  return taken;
+}
+
+/// Takes the oldest task of a deque.
+/// @return 1 if a task was taken, 0 if the deque is empty.
+static int pop_front(TaskDeque *deque, Task *task) {
+  int taken = 0;
+  safe_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    *task = deque->tasks[deque->head];
+    deque->head = (deque->head + 1) % deque->cap;
+    deque->count--;
+    taken = 1;
+  }
+  safe_mutex_unlock(&deque->lock);
+  return taken;
+}
+
+/// Finds a task for a worker: its own newest task first, then the oldest
+/// external submission, then the oldest task of another worker.
+/// @param id Index of the worker.
+/// @param task Where the task found is stored.
+/// @return 1 if a task was found, 0 otherwise.
+static int find_task(int id, Task *task) {
+  if (pop_back(&deques[id], task) || pop_front(&deques[num_workers], task)) {
+    return 1;
+  }
+  for (int i = 1; i < num_workers; i++) {
+    if (pop_front(&deques[(id + i) % num_workers], task)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Main loop of a pool worker.
+/// @param arg Index of the worker.
+/// @return NULL.
+static void *pool_worker(void *arg) {
+  /*---------Blocking the signal----------*/
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  /*--------------------------------------*/
+
+  worker_id = (int)(size_t)arg;
+  while (1) {
+    safe_mutex_lock(&pool_lock);
+    while (queued == 0 && !stopping) {
+      pthread_cond_wait(&work_cond, &pool_lock);
+    }
+    if (queued == 0) { // Stopping and nothing left to do
+      safe_mutex_unlock(&pool_lock);
+      return NULL;
+    }
+    queued--; // Reserves one of the queued tasks
+    safe_mutex_unlock(&pool_lock);
+
+    // There are at least as many queued tasks as reservations, but other
+    // workers may take the ones seen in a scan, so keep looking until found
+    Task task;
+    while (!find_task(worker_id, &task)) {
+      sched_yield();
+    }
+    task.function(task.arg);
+
+    safe_mutex_lock(&pool_lock);
+    if (--pending == 0) {
+      pthread_cond_broadcast(&idle_cond);
+    }
+    safe_mutex_unlock(&pool_lock);
+  }
+}
+
+/*-----------------------------POOL FUNCTIONS--------------------------------*/
+
+int pool_start(int workers_count) {
+  if (workers_count < 1) {
+    workers_count = 1;
+  }
+  stopping = 0;
+  deques = safe_malloc((size_t)(workers_count + 1) * sizeof(TaskDeque));
+  for (int i = 0; i <= workers_count; i++) {
+    deques[i] = (TaskDeque){.tasks = NULL, .head = 0, .count = 0, .cap = 0};
+    pthread_mutex_init(&deques[i].lock, NULL);
+  }
+  // Workers look at every deque, so their number is fixed before any starts
+  num_workers = workers_count;
+
+  workers = safe_malloc((size_t)workers_count * sizeof(pthread_t));
+  for (int i = 0; i < workers_count; i++) {
+    if (pthread_create(&workers[i], NULL, pool_worker, (void *)(size_t)i) !=
+        0) {
+      fprintf(stderr, "Error creating thread number: %d\n", i);
+      safe_mutex_lock(&pool_lock);
+      stopping = 1;
+      pthread_cond_broadcast(&work_cond);
+      safe_mutex_unlock(&pool_lock);
+      for (int j = 0; j < i; j++) {
+        pthread_join(workers[j], NULL);
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void pool_submit(TaskFunction function, void *arg) {
+  int id = worker_id >= 0 ? worker_id : num_workers;
+  push_back(&deques[id], (Task){function, arg});
+
+  safe_mutex_lock(&pool_lock);
+  queued++;
+  pending++;
+  pthread_cond_signal(&work_cond);
+  safe_mutex_unlock(&pool_lock);
+}
+
+void pool_hold() {
+  safe_mutex_lock(&pool_lock);
+  pending++;
+  safe_mutex_unlock(&pool_lock);
+}
+
+void pool_release() {
+  safe_mutex_lock(&pool_lock);
+  if (--pending == 0) {
+    pthread_cond_broadcast(&idle_cond);
+  }
+  safe_mutex_unlock(&pool_lock);
+}
+
+void pool_wait() {
+  safe_mutex_lock(&pool_lock);
+  while (pending > 0) {
+    pthread_cond_wait(&idle_cond, &pool_lock);
+  }
+  safe_mutex_unlock(&pool_lock);
+}
+
+void pool_stop() {
+  safe_mutex_lock(&pool_lock);
+  stopping = 1;
+  pthread_cond_broadcast(&work_cond);
+  safe_mutex_unlock(&pool_lock);
+
+  for (int i = 0; i < num_workers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  for (int i = 0; i <= num_workers; i++) {
+    free(deques[i].tasks);
+    pthread_mutex_destroy(&deques[i].lock);
+  }
+  free(deques);
+  free(workers);
+  deques = NULL;
+  workers = NULL;
+  num_workers = 0;
+}
+
+int pool_size() { return num_workers; }
+
+/*---------------------------TEMPORARY THREADS-------------------------------*/
+
+void run_threads(int num_threads, void *(*function)(void *), void *args,
+                 size_t arg_size) {
+  pthread_t *threads = safe_malloc((size_t)num_threads * sizeof(pthread_t));
+  int created = 1;
+  for (; created < num_threads; created++) {
+    void *arg = (char *)args + (size_t)created * arg_size;
+    if (pthread_create(&threads[created], NULL, function, arg) != 0) {
+      // Shared work is left to the running threads, the rest is run here
+      fprintf(stderr, "Error creating thread\n");
+      if (arg_size != 0) {
+        for (int i = created; i < num_threads; i++) {
+          function((char *)args + (size_t)i * arg_size);
+        }
+      }
+      break;
+    }
+  }
+  function(args);
+  for (int i = 1; i < created; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
@@ -0,0 +1,51 @@
+#ifndef KVS_POOL_H
+#define KVS_POOL_H
+
+#include <stddef.h>
+
+/// Function run by a pool worker for a submitted task.
+typedef void (*TaskFunction)(void *arg);
+
+/// Starts a work-stealing pool. Every worker owns a deque of tasks: tasks
+/// submitted by a worker go to its own deque and are taken back newest first,
+/// while idle workers steal the oldest tasks of the others. Tasks submitted
+/// from outside the pool go to a shared queue, taken in submission order.
+/// @param num_workers Number of worker threads to create.
+/// @return 0 if the pool was started successfully, 1 otherwise.
+int pool_start(int num_workers);
+
+/// Submits a task to the pool.
+/// @param function Function to be run.
+/// @param arg Argument given to the function.
+void pool_submit(TaskFunction function, void *arg);
+
+/// Counts a task that will only be submitted later, e.g. by a timer, as
+/// pending, so pool_wait keeps waiting for it.
+void pool_hold();
+
+/// Stops counting a task counted by pool_hold. Must be called after the task
+/// is submitted, or if it is dropped.
+void pool_release();
+
+/// Waits until every submitted task, including the ones submitted by other
+/// tasks meanwhile, has finished.
+void pool_wait();
+
+/// Stops the workers, after they finish every submitted task.
+void pool_stop();
+
+/// Gets the number of workers of the pool.
+/// @return Number of workers, 0 if the pool isn't running.
+int pool_size();
+
+/// Runs a function on temporary threads, the calling thread being the first
+/// of them, and waits for all of them to return. If a thread can't be
+/// created, the caller runs the arguments left itself.
+/// @param num_threads Number of threads, at least 1.
+/// @param function Function to be run.
+/// @param args Argument of the first thread, followed by the others.
+/// @param arg_size Size of each argument, 0 if every thread gets args.
+void run_threads(int num_threads, void *(*function)(void *), void *args,
+                 size_t arg_size);
+
+#endif // KVS_POOL_H
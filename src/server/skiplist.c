@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "operations.h"
+#include "skiplist.h"
+
+struct SkipNode {
+  KeyNode *node; // NULL for the head
+  int level;
+  SkipNode *next[]; // Next node of each level
+};
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Compares the key of a node with a key, in the order of the list.
+/// @return Negative if the node comes first, positive if the key comes first,
+///         0 if they are the same key.
+static int compare_node(const SkipNode *skip, Slice key) {
+  Slice node_key = {skip->node->key, skip->node->key_len};
+  return order_keys(node_key, key);
+}
+
+static SkipNode *alloc_node(KeyNode *node, int level) {
+  SkipNode *skip =
+      safe_malloc(sizeof(SkipNode) + (size_t)level * sizeof(SkipNode *));
+  skip->node = node;
+  skip->level = level;
+  for (int i = 0; i < level; i++) {
+    skip->next[i] = NULL;
+  }
+  return skip;
+}
+
+/// Draws the level of a new node, each level half as likely as the one below.
+/// Must be called with the list locked.
+static int random_level(SkipList *list) {
+  // xorshift64
+  list->seed ^= list->seed << 13;
+  list->seed ^= list->seed >> 7;
+  list->seed ^= list->seed << 17;
+  uint64_t bits = list->seed;
+  int level = 1;
+  while (level < SKIPLIST_MAX_LEVEL && (bits & 1)) {
+    level++;
+    bits >>= 1;
+  }
+  return level;
+}
+
+/// Finds the last node before a key on every level.
+/// @param list Skip list to be searched.
+/// @param key Key to look for.
+/// @param update Where the last node before the key on each level is stored.
+static void find_before(const SkipList *list, Slice key,
+                        SkipNode *update[SKIPLIST_MAX_LEVEL]) {
+  SkipNode *current = list->head;
+  for (int i = list->level - 1; i >= 0; i--) {
+    while (current->next[i] != NULL &&
+           compare_node(current->next[i], key) < 0) {
+      current = current->next[i];
+    }
+    update[i] = current;
+  }
+}
+
+/*----------------------------SKIPLIST FUNCTIONS-----------------------------*/
+
+SkipList *skiplist_create() {
+  SkipList *list = safe_malloc(sizeof(SkipList));
+  list->head = alloc_node(NULL, SKIPLIST_MAX_LEVEL);
+  list->level = 1;
+  list->seed = 0x9E3779B97F4A7C15u;
+  pthread_mutex_init(&list->lock, NULL);
+  return list;
+}
+
+void skiplist_insert(SkipList *list, KeyNode *node) {
+  Slice key = {node->key, node->key_len};
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+
+  safe_mutex_lock(&list->lock);
+  find_before(list, key, update);
+  int level = random_level(list);
+  for (int i = list->level; i < level; i++) {
+    update[i] = list->head;
+  }
+  if (level > list->level) {
+    list->level = level;
+  }
+
+  SkipNode *skip = alloc_node(node, level);
+  for (int i = 0; i < level; i++) {
+    skip->next[i] = update[i]->next[i];
+    update[i]->next[i] = skip;
+  }
+  safe_mutex_unlock(&list->lock);
+}
+
+void skiplist_remove(SkipList *list, const KeyNode *node) {
+  Slice key = {node->key, node->key_len};
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+
+  safe_mutex_lock(&list->lock);
+  find_before(list, key, update);
+  SkipNode *skip = update[0]->next[0];
+  if (skip != NULL && skip->node == node) {
+    for (int i = 0; i < skip->level; i++) {
+      update[i]->next[i] = skip->next[i];
+    }
+    while (list->level > 1 && list->head->next[list->level - 1] == NULL) {
+      list->level--;
+    }
+    free(skip);
+  }
+  safe_mutex_unlock(&list->lock);
+}
+
+void skiplist_scan(const SkipList *list, Slice start, SkipListCallback callback,
+                   void *arg) {
+  SkipNode *update[SKIPLIST_MAX_LEVEL];
+  find_before(list, start, update);
+  for (SkipNode *skip = update[0]->next[0]; skip != NULL;
+       skip = skip->next[0]) {
+    if (callback(skip->node, arg)) {
+      return;
+    }
+  }
+}
+
+void skiplist_free(SkipList *list) {
+  if (list == NULL) {
+    return;
+  }
+  SkipNode *skip = list->head;
+  while (skip != NULL) {
+    SkipNode *next = skip->next[0];
+    free(skip);
+    skip = next;
+  }
+  pthread_mutex_destroy(&list->lock);
+  free(list);
+}
@@ -0,0 +1,57 @@
+#ifndef KVS_SKIPLIST_H
+#define KVS_SKIPLIST_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "kvs.h"
+
+#define SKIPLIST_MAX_LEVEL 24
+
+typedef struct SkipNode SkipNode;
+
+/// Index of the nodes of a hash table in alphabetical order of their keys,
+/// ignoring case, with ties between keys that only differ in case broken by
+/// their bytes. Insertions and removals are serialized by the list's own
+/// lock, so they may come from threads holding different bucket locks. A
+/// scan must keep every writer out, e.g. by read locking every bucket.
+typedef struct SkipList {
+  SkipNode *head;
+  int level;     // Number of levels in use
+  uint64_t seed; // State of the generator of node levels
+  pthread_mutex_t lock;
+} SkipList;
+
+/// Called for every node visited by a scan.
+/// @param node Node of the hash table.
+/// @param arg Argument given to the scan.
+/// @return 0 to keep scanning, anything else to stop.
+typedef int (*SkipListCallback)(const KeyNode *node, void *arg);
+
+/// Creates an empty skip list.
+/// @return Newly created skip list.
+SkipList *skiplist_create();
+
+/// Adds a node that isn't in the list yet.
+/// @param list Skip list to be modified.
+/// @param node Node to be added.
+void skiplist_insert(SkipList *list, KeyNode *node);
+
+/// Removes a node, which must be called before the node is freed.
+/// @param list Skip list to be modified.
+/// @param node Node to be removed.
+void skiplist_remove(SkipList *list, const KeyNode *node);
+
+/// Visits the nodes in order, starting at the first key not before start.
+/// @param list Skip list to be scanned.
+/// @param start Key to start at.
+/// @param callback Function called for every node until it returns nonzero.
+/// @param arg Argument given to the callback.
+void skiplist_scan(const SkipList *list, Slice start, SkipListCallback callback,
+                   void *arg);
+
+/// Frees a skip list, but not the nodes it indexes.
+/// @param list Skip list to be freed, may be NULL.
+void skiplist_free(SkipList *list);
+
+#endif // KVS_SKIPLIST_H
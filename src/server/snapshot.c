@@ -0,0 +1,178 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "operations.h"
+#include "pool.h"
+#include "snapshot.h"
+
+typedef struct {
+  Slice key;
+  Slice value;
+} SnapshotPair;
+
+/// Pairs copied from one bucket, whose strings share a single allocation.
+typedef struct {
+  char *strings;
+  SnapshotPair *pairs;
+  size_t count;
+  size_t next; // Next pair to be merged
+} SnapshotBucket;
+
+struct Snapshot {
+  SnapshotBucket buckets[TABLE_SIZE];
+  int next_bucket; // First bucket not taken by a sorting thread yet
+  pthread_mutex_t lock;
+};
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Orders pairs by key, as order_keys does.
+static int compare_pairs(const void *a, const void *b) {
+  const SnapshotPair *pair_a = a;
+  const SnapshotPair *pair_b = b;
+  return order_keys(pair_a->key, pair_b->key);
+}
+
+/// Sorts the buckets not taken by other threads yet.
+/// @param arg Snapshot whose buckets will be sorted.
+/// @return NULL.
+static void *sort_buckets(void *arg) {
+  Snapshot *snapshot = arg;
+  while (1) {
+    safe_mutex_lock(&snapshot->lock);
+    int index = snapshot->next_bucket++;
+    safe_mutex_unlock(&snapshot->lock);
+    if (index >= TABLE_SIZE) {
+      return NULL;
+    }
+    SnapshotBucket *bucket = &snapshot->buckets[index];
+    if (bucket->count > 1) {
+      qsort(bucket->pairs, bucket->count, sizeof(SnapshotPair), compare_pairs);
+    }
+  }
+}
+
+/// Checks if the next pair of bucket a comes before the next pair of bucket b.
+static int merges_first(const Snapshot *snapshot, int a, int b) {
+  const SnapshotBucket *bucket_a = &snapshot->buckets[a];
+  const SnapshotBucket *bucket_b = &snapshot->buckets[b];
+  return compare_pairs(&bucket_a->pairs[bucket_a->next],
+                       &bucket_b->pairs[bucket_b->next]) < 0;
+}
+
+/// Moves the bucket at the given position of a heap down to its place.
+/// @param snapshot Snapshot whose buckets are in the heap.
+/// @param heap Heap of bucket indexes, ordered by their next pair.
+/// @param size Number of buckets in the heap.
+/// @param i Position to be fixed.
+static void sift_down(const Snapshot *snapshot, int *heap, int size, int i) {
+  while (1) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < size && merges_first(snapshot, heap[left], heap[smallest])) {
+      smallest = left;
+    }
+    if (right < size && merges_first(snapshot, heap[right], heap[smallest])) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    int temp = heap[i];
+    heap[i] = heap[smallest];
+    heap[smallest] = temp;
+    i = smallest;
+  }
+}
+
+/*----------------------------SNAPSHOT FUNCTIONS-----------------------------*/
+
+Snapshot *snapshot_take(HashTable *ht) {
+  Snapshot *snapshot = safe_malloc(sizeof(Snapshot));
+  snapshot->next_bucket = 0;
+  pthread_mutex_init(&snapshot->lock, NULL);
+
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    SnapshotBucket *bucket = &snapshot->buckets[i];
+    size_t count = 0;
+    size_t bytes = 0;
+    for (KeyNode *node = ht->table[i].head; node; node = node->next) {
+      count++;
+      bytes += node->key_len + strlen(node->value) + 2;
+    }
+
+    bucket->count = count;
+    bucket->next = 0;
+    bucket->pairs = count ? safe_malloc(count * sizeof(SnapshotPair)) : NULL;
+    bucket->strings = count ? safe_malloc(bytes) : NULL;
+    char *ptr = bucket->strings;
+    SnapshotPair *pair = bucket->pairs;
+    for (KeyNode *node = ht->table[i].head; node; node = node->next, pair++) {
+      pair->key.ptr = ptr;
+      pair->key.len = node->key_len;
+      memcpy(ptr, node->key, pair->key.len + 1);
+      ptr += pair->key.len + 1;
+      pair->value.ptr = ptr;
+      pair->value.len = strlen(node->value);
+      memcpy(ptr, node->value, pair->value.len + 1);
+      ptr += pair->value.len + 1;
+    }
+  }
+  return snapshot;
+}
+
+int snapshot_write_sorted(Snapshot *snapshot, OutputBuffer *out,
+                          int num_threads) {
+  snapshot->next_bucket = 0;
+  run_threads(num_threads < 1            ? 1
+              : num_threads > TABLE_SIZE ? TABLE_SIZE
+                                         : num_threads,
+              sort_buckets, snapshot, 0);
+
+  int heap[TABLE_SIZE];
+  int size = 0;
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    if (snapshot->buckets[i].count > 0) {
+      heap[size++] = i;
+    }
+  }
+  for (int i = size / 2 - 1; i >= 0; i--) {
+    sift_down(snapshot, heap, size, i);
+  }
+
+  while (size > 0) {
+    SnapshotBucket *bucket = &snapshot->buckets[heap[0]];
+    const SnapshotPair *pair = &bucket->pairs[bucket->next++];
+    char line[2 * MAX_STRING_SIZE + 8];
+    char *ptr = line;
+    *ptr++ = '(';
+    memcpy(ptr, pair->key.ptr, pair->key.len);
+    ptr += pair->key.len;
+    *ptr++ = ',';
+    *ptr++ = ' ';
+    memcpy(ptr, pair->value.ptr, pair->value.len);
+    ptr += pair->value.len;
+    *ptr++ = ')';
+    *ptr++ = '\n';
+    if (output_write(out, line, (size_t)(ptr - line))) {
+      return 1;
+    }
+
+    if (bucket->next == bucket->count) {
+      heap[0] = heap[--size];
+    }
+    sift_down(snapshot, heap, size, 0);
+  }
+  return 0;
+}
+
+void snapshot_free(Snapshot *snapshot) {
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    free(snapshot->buckets[i].pairs);
+    free(snapshot->buckets[i].strings);
+  }
+  pthread_mutex_destroy(&snapshot->lock);
+  free(snapshot);
+}
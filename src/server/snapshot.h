@@ -0,0 +1,33 @@
+#ifndef KVS_SNAPSHOT_H
+#define KVS_SNAPSHOT_H
+
+#include "io.h"
+#include "kvs.h"
+
+/// Copy of the pairs of a hash table, taken at once and written later without
+/// holding any lock.
+typedef struct Snapshot Snapshot;
+
+/// Copies the pairs of every bucket of a hash table. The caller must ensure
+/// the table isn't modified while it is copied, e.g. by read locking every
+/// bucket.
+/// @param ht Hash table to be copied.
+/// @return Newly created snapshot.
+Snapshot *snapshot_take(HashTable *ht);
+
+/// Writes the pairs of a snapshot to an output buffer as "(key, value)" lines
+/// in alphabetical order of the keys, ignoring case. Every bucket is sorted
+/// separately by up to num_threads threads, then the sorted buckets are
+/// merged into the output.
+/// @param snapshot Snapshot to be written.
+/// @param out Output buffer to write the pairs.
+/// @param num_threads Maximum number of threads to use.
+/// @return 0 on success, 1 if writing failed.
+int snapshot_write_sorted(Snapshot *snapshot, OutputBuffer *out,
+                          int num_threads);
+
+/// Frees a snapshot.
+/// @param snapshot Snapshot to be freed.
+void snapshot_free(Snapshot *snapshot);
+
+#endif // KVS_SNAPSHOT_H
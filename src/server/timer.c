@@ -0,0 +1,206 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "operations.h"
+#include "timer.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+typedef struct Timer {
+  uint64_t expires; // Tick at which the timer expires
+  TimerCallback callback;
+  void *arg;
+  struct Timer *next;
+} Timer;
+
+/*----------------------------GLOBAL VARIABLES-------------------------------*/
+
+// Level l holds timers expiring within WHEEL_SLOTS^(l+1) ticks, each slot of
+// it covering WHEEL_SLOTS^l ticks
+static Timer *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t current = 0; // Last tick processed
+static size_t num_timers = 0;
+static struct timespec start_time;
+
+static int stopping = 0;
+static pthread_t timer_thread;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+
+/*---------------------------AUXILIARY FUNCTIONS-----------------------------*/
+
+/// Gets the number of milliseconds since the timer thread started.
+static uint64_t now_ms() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - start_time.tv_sec) * 1000 +
+         (uint64_t)((now.tv_nsec - start_time.tv_nsec) / 1000000);
+}
+
+/// Puts a timer in the slot of the lowest level covering its expiry.
+/// @param timer Timer to be inserted, expiring at current or later.
+static void insert_timer(Timer *timer) {
+  uint64_t delta = timer->expires - current;
+  uint64_t expires = timer->expires;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= (uint64_t)1 << (WHEEL_BITS * (level + 1))) {
+    level++;
+  }
+  if (delta >= (uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) {
+    // Beyond the wheel, parked in the furthest slot and reinserted from there
+    expires = current + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+  }
+  size_t slot = (size_t)(expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  timer->next = wheel[level][slot];
+  wheel[level][slot] = timer;
+}
+
+/// Moves the timers of a slot of an upper level to the lower levels.
+/// @param level Level whose current slot is cascaded.
+/// @return 1 if the level above also has to be cascaded, 0 otherwise.
+static int cascade(int level) {
+  size_t slot = (size_t)(current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  Timer *timer = wheel[level][slot];
+  wheel[level][slot] = NULL;
+  while (timer != NULL) {
+    Timer *next = timer->next;
+    insert_timer(timer);
+    timer = next;
+  }
+  return slot == 0;
+}
+
+/// Advances the wheel by one tick.
+/// @return List of the timers that expired.
+static Timer *advance() {
+  current++;
+  if ((current & WHEEL_MASK) == 0) {
+    for (int level = 1; level < WHEEL_LEVELS && cascade(level); level++) {
+    }
+  }
+  size_t slot = (size_t)current & WHEEL_MASK;
+  Timer *expired = wheel[0][slot];
+  wheel[0][slot] = NULL;
+  return expired;
+}
+
+/// Main loop of the timer thread.
+/// @return NULL.
+static void *timer_loop(void *arg) {
+  (void)arg;
+  /*---------Blocking the signal----------*/
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  /*--------------------------------------*/
+
+  safe_mutex_lock(&timer_lock);
+  while (!stopping) {
+    uint64_t now = now_ms();
+    Timer *expired = NULL;
+    while (current < now && expired == NULL) {
+      expired = advance();
+    }
+
+    if (expired != NULL) {
+      safe_mutex_unlock(&timer_lock);
+      while (expired != NULL) {
+        Timer *next = expired->next;
+        expired->callback(expired->arg);
+        free(expired);
+        expired = next;
+        safe_mutex_lock(&timer_lock);
+        num_timers--;
+        safe_mutex_unlock(&timer_lock);
+      }
+      safe_mutex_lock(&timer_lock);
+      continue;
+    }
+
+    if (num_timers == 0) {
+      pthread_cond_wait(&timer_cond, &timer_lock);
+    } else {
+      uint64_t next_ms = current + 1;
+      struct timespec deadline = start_time;
+      deadline.tv_sec += (time_t)(next_ms / 1000);
+      deadline.tv_nsec += (long)(next_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+    }
+  }
+  safe_mutex_unlock(&timer_lock);
+  return NULL;
+}
+
+/*-----------------------------TIMER FUNCTIONS-------------------------------*/
+
+int timer_start() {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&timer_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  current = 0;
+  stopping = 0;
+  if (pthread_create(&timer_thread, NULL, timer_loop, NULL) != 0) {
+    fprintf(stderr, "Error creating timer thread\n");
+    pthread_cond_destroy(&timer_cond);
+    return 1;
+  }
+  return 0;
+}
+
+void timer_schedule(unsigned int delay_ms, TimerCallback callback, void *arg) {
+  Timer *timer = safe_malloc(sizeof(Timer));
+  timer->callback = callback;
+  timer->arg = arg;
+
+  safe_mutex_lock(&timer_lock);
+  uint64_t now = now_ms();
+  if (num_timers == 0 && current < now) {
+    current = now; // Nothing in the wheel, so it can skip ahead at once
+  }
+  // Expiring within the tick being processed would wait for a whole turn
+  timer->expires = now + delay_ms;
+  if (timer->expires <= current) {
+    timer->expires = current + 1;
+  }
+  insert_timer(timer);
+  num_timers++;
+  pthread_cond_signal(&timer_cond);
+  safe_mutex_unlock(&timer_lock);
+}
+
+void timer_stop() {
+  safe_mutex_lock(&timer_lock);
+  stopping = 1;
+  pthread_cond_signal(&timer_cond);
+  safe_mutex_unlock(&timer_lock);
+  pthread_join(timer_thread, NULL);
+
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+      while (wheel[level][slot] != NULL) {
+        Timer *next = wheel[level][slot]->next;
+        free(wheel[level][slot]);
+        wheel[level][slot] = next;
+      }
+    }
+  }
+  num_timers = 0;
+  pthread_cond_destroy(&timer_cond);
+}
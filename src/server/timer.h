@@ -0,0 +1,22 @@
+#ifndef KVS_TIMER_H
+#define KVS_TIMER_H
+
+/// Function called by the timer thread when a timer expires. It must be quick,
+/// since every other timer waits for it.
+typedef void (*TimerCallback)(void *arg);
+
+/// Starts the timer thread, which keeps timers in a hierarchical timing wheel
+/// with a resolution of one millisecond.
+/// @return 0 if the timer thread was started successfully, 1 otherwise.
+int timer_start();
+
+/// Schedules a callback to run after a delay.
+/// @param delay_ms Delay in milliseconds.
+/// @param callback Function to be called.
+/// @param arg Argument given to the function.
+void timer_schedule(unsigned int delay_ms, TimerCallback callback, void *arg);
+
+/// Stops the timer thread. Timers that didn't expire yet never run.
+void timer_stop();
+
+#endif // KVS_TIMER_H